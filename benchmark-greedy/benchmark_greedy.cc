@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <founder_sequences/benchmark_greedy.hh>
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/greedy_matcher.hh>
+#include <iostream>
+#include <new>
+#include <vector>
+
+
+namespace fseq	= founder_sequences;
+namespace lb	= libbio;
+namespace lsr	= libbio::sequence_reader;
+
+
+namespace {
+
+	std::atomic_size_t s_allocation_count{0};
+	
+	
+	class greedy_benchmark_context final : public fseq::greedy_matcher_delegate
+	{
+	protected:
+		std::vector <fseq::pbwt_sample_type>	m_samples;
+		std::vector <std::size_t>				m_allocation_counts;	// Allocations made before matching, before taking each sample but the first one and after finishing.
+		fseq::permutation_matrix				m_permutations;
+		fseq::segmentation_traceback_vector		m_traceback;			// Not needed by the matcher.
+		std::size_t								m_next_sample_idx{};
+		std::uint32_t							m_sequence_count{};
+		std::uint32_t							m_max_segment_size{};
+	
+	public:
+		greedy_benchmark_context(std::vector <fseq::pbwt_sample_type> &&samples, std::uint32_t const sequence_count):
+			m_samples(std::move(samples)),
+			m_sequence_count(sequence_count)
+		{
+		}
+		
+		void prepare();
+		void run();
+		void output_allocation_counts() const;
+		
+		lb::dispatch_ptr <dispatch_queue_t> producer_queue() const override { return {}; }
+		lb::dispatch_ptr <dispatch_queue_t> consumer_queue() const override { return {}; }
+		std::vector <fseq::pbwt_sample_type> const &pbwt_samples() const override { return m_samples; }
+		fseq::pbwt_sample_type const *next_pbwt_sample() override;
+		bool is_streaming_pbwt_samples() const override { return false; }
+		fseq::segmentation_traceback_vector const &reduced_traceback() const override { return m_traceback; }
+		fseq::permutation_matrix &permutations() override { return m_permutations; }
+		fseq::bipartite_set_scoring bipartite_set_scoring_method() const override { return fseq::bipartite_set_scoring::SYMMETRIC_DIFFERENCE; }
+		fseq::matching_backend bipartite_matching_backend() const override { return fseq::matching_backend::GREEDY; }
+		double auction_optimality_gap() const override { return 0.0; }
+		std::uint32_t hybrid_matching_threshold() const override { return UINT32_MAX; }
+		fseq::matching_backend hybrid_approximate_backend() const override { return fseq::matching_backend::GREEDY; }
+		bool should_run_single_threaded() const override { return true; }
+		std::uint32_t sequence_count() const override { return m_sequence_count; }
+		std::uint32_t max_segment_size() const override { return m_max_segment_size; }
+		
+		void matcher_did_finish(fseq::greedy_matcher &matcher) override { m_allocation_counts.push_back(s_allocation_count.load(std::memory_order_relaxed)); }
+	};
+	
+	
+	void greedy_benchmark_context::prepare()
+	{
+		// Count the distinct substrings in each segment.
+		std::size_t seg_start_idx(0);
+		for (auto const &sample : m_samples)
+		{
+			auto const &divergence(sample.input_divergence());
+			std::uint32_t const distinct_count(std::count_if(divergence.begin(), divergence.end(), [seg_start_idx](auto const val){ return seg_start_idx < val; }));
+			m_max_segment_size = std::max(m_max_segment_size, distinct_count);
+			seg_start_idx = sample.sequence_idx();
+		}
+		
+		auto const permutation_bits_needed(lb::bits::highest_bit_set(m_sequence_count));
+		m_permutations.clear();
+		m_permutations.resize(m_samples.size(), fseq::permutation_vector(m_max_segment_size, 0, permutation_bits_needed));
+	}
+	
+	
+	fseq::pbwt_sample_type const *greedy_benchmark_context::next_pbwt_sample()
+	{
+		// The setup and the first sample are counted together.
+		if (m_next_sample_idx)
+			m_allocation_counts.push_back(s_allocation_count.load(std::memory_order_relaxed));
+		
+		if (m_next_sample_idx < m_samples.size())
+			return &m_samples[m_next_sample_idx++];
+		return nullptr;
+	}
+	
+	
+	void greedy_benchmark_context::run()
+	{
+		auto const permutation_bits_needed(lb::bits::highest_bit_set(m_sequence_count));
+		fseq::substring_copy_number_matrix const substrings_to_output;
+		fseq::greedy_matcher matcher(*this, substrings_to_output, (1 << permutation_bits_needed) - 1, permutation_bits_needed);
+		
+		m_next_sample_idx = 0;
+		m_allocation_counts.clear();
+		m_allocation_counts.reserve(2 + m_samples.size());
+		m_allocation_counts.push_back(s_allocation_count.load(std::memory_order_relaxed));
+		matcher.match();
+	}
+	
+	
+	void greedy_benchmark_context::output_allocation_counts() const
+	{
+		// The first interval, [1] - [0], contains the setup and the first sample. Joining pair i is [i + 2] - [i + 1].
+		// The final interval contains the matcher’s own clean-up.
+		if (m_allocation_counts.size() < 3)
+			return;
+		
+		std::cout << "SEGMENT_PAIR\tALLOCATIONS\n";
+		std::size_t pair_total(0);
+		std::size_t pair_max(0);
+		auto const pair_count(m_allocation_counts.size() - 3);
+		for (std::size_t i(0); i < pair_count; ++i)
+		{
+			auto const count(m_allocation_counts[i + 2] - m_allocation_counts[i + 1]);
+			pair_total += count;
+			pair_max = std::max(pair_max, count);
+			std::cout << i << '\t' << count << '\n';
+		}
+		std::cout << std::flush;
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Joined " << m_samples.size() << " segments of at most " << m_max_segment_size << " distinct substrings." << std::endl;
+		std::cerr << "\tsetup and the first sample: " << (m_allocation_counts[1] - m_allocation_counts[0]) << " allocations" << std::endl;
+		std::cerr << "\tsegment pairs: " << pair_total << " allocations in total, " << (pair_count ? double(pair_total) / pair_count : 0.0) << " per pair on average, " << pair_max << " at most." << std::endl;
+	}
+}
+
+
+// Count the allocations made by the whole program. The array forms call these by default.
+void *operator new(std::size_t const size)
+{
+	s_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (auto *ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+
+namespace founder_sequences {
+
+	void benchmark_greedy(
+		char const *input_path,
+		lsr::input_format const input_format,
+		std::size_t const segment_length
+	)
+	{
+		lb::log_time(std::cerr);
+		std::cerr << "Loading the input…" << std::endl;
+		
+		std::unique_ptr <lsr::sequence_container> sequence_container;
+		sequence_vector sequences;
+		lsr::read_input(input_path, input_format, sequence_container);
+		sequence_container->to_spans(sequences);
+		
+		if (0 == sequences.size())
+		{
+			std::cerr << "The input file contained no sequences." << std::endl;
+			std::exit(EXIT_SUCCESS);
+		}
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Generating a compressed alphabet…" << std::endl;
+		
+		alphabet_type alphabet;
+		{
+			lb::consecutive_alphabet_as_builder <std::uint8_t> builder;
+			builder.init();
+			for (auto const &vec : sequences)
+				builder.prepare(vec);
+			builder.compress();
+			
+			using std::swap;
+			swap(alphabet, builder.alphabet());
+		}
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Sampling the PBWT at the segment boundaries…" << std::endl;
+		
+		std::vector <pbwt_sample_type> samples;
+		{
+			pbwt_context pbwt_ctx(sequences, alphabet, lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS);
+			pbwt_ctx.set_sample_rate(segment_length);
+			pbwt_ctx.prepare();
+			
+			auto const seq_length(pbwt_ctx.sequence_length());
+			for (std::size_t limit(0); limit < seq_length;)
+			{
+				limit = std::min(seq_length, limit + segment_length);
+				pbwt_ctx.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(limit, [](){});
+				
+				auto &pbwt_samples(pbwt_ctx.samples());
+				for (auto &sample : pbwt_samples)
+					samples.emplace_back(std::move(sample));
+				pbwt_samples.clear();
+			}
+		}
+		
+		if (samples.size() < 2)
+		{
+			std::cerr << "The segment length needs to be less than the sequence length." << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		
+		greedy_benchmark_context ctx(std::move(samples), sequences.size());
+		ctx.prepare();
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Measuring…" << std::endl;
+		
+		ctx.run();
+		ctx.output_allocation_counts();
+	}
+}
@@ -0,0 +1,66 @@
+/*
+ Copyright (c) 2018 Tuukka Norri
+ This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <cstdlib>
+#include <founder_sequences/benchmark_greedy.hh>
+#include <iostream>
+#include <libbio/assert.hh>
+#include <libbio/sequence_reader/sequence_reader.hh>
+
+#include "cmdline.h"
+
+
+namespace fseq	= founder_sequences;
+namespace lsr	= libbio::sequence_reader;
+
+
+namespace {
+
+	lsr::input_format input_file_format(enum_input_format const fmt)
+	{
+		switch (fmt)
+		{
+			case input_format_arg_FASTA:
+				return lsr::input_format::FASTA;
+			
+			case input_format_arg_listMINUS_file:
+				return lsr::input_format::LIST_FILE;
+			
+			case input_format__NULL:
+			default:
+				libbio_fail("Unexpected value for input_format");
+				return lsr::input_format::LIST_FILE; // Not reached.
+		}
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	gengetopt_args_info args_info;
+	if (0 != cmdline_parser(argc, argv, &args_info))
+		std::exit(EXIT_FAILURE);
+	
+	std::ios_base::sync_with_stdio(false);	// Don't use C style IO after calling cmdline_parser.
+
+#ifndef NDEBUG
+	std::cerr << "Assertions have been enabled." << std::endl;
+#endif
+
+	if (args_info.segment_length_arg <= 0)
+	{
+		std::cerr << "Segment length must be positive." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	
+	fseq::benchmark_greedy(
+		args_info.input_arg,
+		input_file_format(args_info.input_format_arg),
+		args_info.segment_length_arg
+	);
+	
+	cmdline_parser_free(&args_info);
+	return EXIT_SUCCESS;
+}
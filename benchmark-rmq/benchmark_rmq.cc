@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <founder_sequences/benchmark_rmq.hh>
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/range_maximum.hh>
+#include <iostream>
+#include <random>
+#include <sdsl/rmq_support.hpp>
+#include <vector>
+
+
+namespace fseq	= founder_sequences;
+namespace lb	= libbio;
+namespace lsr	= libbio::sequence_reader;
+
+
+namespace {
+
+	typedef sdsl::int_vector <32>						divergence_vector;
+	typedef std::pair <std::size_t, std::size_t>		query_range;
+	typedef std::chrono::steady_clock					benchmark_clock;
+	
+	
+	struct benchmark_result
+	{
+		std::uint64_t	build_ns{};
+		std::uint64_t	query_ns{};
+		std::uint64_t	checksum{};		// Sum of the maxima, for checking that the variants agree.
+	};
+	
+	
+	struct benchmark_total
+	{
+		char const		*name{};
+		std::uint64_t	build_ns{};
+		std::uint64_t	query_ns{};
+		
+		explicit benchmark_total(char const *name_):
+			name(name_)
+		{
+		}
+	};
+	
+	
+	template <typename t_rmq>
+	benchmark_result run_benchmark(divergence_vector const &divergence, std::vector <query_range> const &queries)
+	{
+		benchmark_result retval;
+		
+		auto const build_start(benchmark_clock::now());
+		t_rmq rmq(&divergence);
+		auto const query_start(benchmark_clock::now());
+		for (auto const &[lb, rb] : queries)
+			retval.checksum += divergence[rmq(lb, rb)];
+		auto const query_end(benchmark_clock::now());
+		
+		retval.build_ns = std::chrono::duration_cast <std::chrono::nanoseconds>(query_start - build_start).count();
+		retval.query_ns = std::chrono::duration_cast <std::chrono::nanoseconds>(query_end - query_start).count();
+		return retval;
+	}
+	
+	
+	void generate_queries(
+		std::size_t const seq_count,
+		fseq::rmq_benchmark_parameters const &parameters,
+		std::vector <query_range> &dst
+	)
+	{
+		// Generate the ranges once s.t. every variant answers the same queries.
+		std::mt19937 urbg(parameters.random_seed);
+		std::uniform_int_distribution <std::size_t> lb_dist(0, seq_count - 1);
+		dst.clear();
+		dst.reserve(parameters.query_count);
+		for (std::size_t i(0); i < parameters.query_count; ++i)
+		{
+			auto const lb(lb_dist(urbg));
+			auto max_length(seq_count - lb);
+			if (parameters.max_query_length)
+				max_length = std::min(max_length, parameters.max_query_length);
+			
+			std::uniform_int_distribution <std::size_t> length_dist(1, max_length);
+			dst.emplace_back(lb, lb + length_dist(urbg) - 1);
+		}
+	}
+}
+
+
+namespace founder_sequences {
+
+	void benchmark_rmq(
+		char const *input_path,
+		lsr::input_format const input_format,
+		rmq_benchmark_parameters const &parameters
+	)
+	{
+		lb::log_time(std::cerr);
+		std::cerr << "Loading the input…" << std::endl;
+		
+		std::unique_ptr <lsr::sequence_container> sequence_container;
+		sequence_vector sequences;
+		lsr::read_input(input_path, input_format, sequence_container);
+		sequence_container->to_spans(sequences);
+		
+		if (0 == sequences.size())
+		{
+			std::cerr << "The input file contained no sequences." << std::endl;
+			std::exit(EXIT_SUCCESS);
+		}
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Generating a compressed alphabet…" << std::endl;
+		
+		alphabet_type alphabet;
+		{
+			lb::consecutive_alphabet_as_builder <std::uint8_t> builder;
+			builder.init();
+			for (auto const &vec : sequences)
+				builder.prepare(vec);
+			builder.compress();
+			
+			using std::swap;
+			swap(alphabet, builder.alphabet());
+		}
+		
+		std::vector <query_range> queries;
+		generate_queries(sequences.size(), parameters, queries);
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Measuring…" << std::endl;
+		
+		// Take the divergence arrays from the PBWT samples and measure each one before continuing s.t. only one needs to be kept in memory.
+		std::array <benchmark_total, 3> totals{{
+			benchmark_total("sct"),
+			benchmark_total("sparse-table"),
+			benchmark_total("block")
+		}};
+		
+		std::cout << "COLUMN\tRMQ\tBUILD_NS\tQUERY_NS\n";
+		
+		pbwt_context pbwt_ctx(sequences, alphabet, lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS);
+		pbwt_ctx.set_sample_rate(parameters.sample_rate);
+		pbwt_ctx.prepare();
+		
+		auto const seq_length(pbwt_ctx.sequence_length());
+		std::size_t sample_count(0);
+		for (std::size_t limit(0); limit < seq_length;)
+		{
+			limit = std::min(seq_length, limit + parameters.sample_rate);
+			pbwt_ctx.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(limit, [](){});
+			
+			auto &samples(pbwt_ctx.samples());
+			for (auto const &sample : samples)
+			{
+				auto const &divergence(sample.input_divergence());
+				std::array <benchmark_result, 3> const results{{
+					run_benchmark <sdsl::range_maximum_sct <>::type>(divergence, queries),
+					run_benchmark <sparse_table_rmq <divergence_vector>>(divergence, queries),
+					run_benchmark <block_sparse_table_rmq <divergence_vector>>(divergence, queries)
+				}};
+				
+				for (std::size_t i(0); i < results.size(); ++i)
+				{
+					auto const &result(results[i]);
+					auto &total(totals[i]);
+					if (result.checksum != results.front().checksum)
+					{
+						std::cerr << "The results of " << total.name << " differ from those of " << totals.front().name << " in column " << sample.sequence_idx() << '.' << std::endl;
+						std::exit(EXIT_FAILURE);
+					}
+					
+					total.build_ns += result.build_ns;
+					total.query_ns += result.query_ns;
+					std::cout << sample.sequence_idx() << '\t' << total.name << '\t' << result.build_ns << '\t' << result.query_ns << '\n';
+				}
+				
+				++sample_count;
+			}
+			samples.clear();
+		}
+		
+		std::cout << std::flush;
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Measured " << sample_count << " divergence arrays of " << sequences.size() << " values with " << queries.size() << " queries each." << std::endl;
+		for (auto const &total : totals)
+		{
+			auto const query_count(sample_count * queries.size());
+			std::cerr << '\t' << total.name << ": build " << total.build_ns / 1000000 << " ms in total, " << (query_count ? double(total.query_ns) / query_count : 0.0) << " ns per query." << std::endl;
+		}
+	}
+}
@@ -22,6 +22,7 @@ SYSTEM_CFLAGS	?=
 SYSTEM_CXXFLAGS	?=
 SYSTEM_CPPFLAGS	?=
 SYSTEM_LDFLAGS	?=
+PBWT_RMQ		?=
 
 CFLAGS			+= -std=c99   $(OPT_FLAGS) $(WARNING_FLAGS) $(SYSTEM_CFLAGS)
 CXXFLAGS		+= -std=c++17 $(OPT_FLAGS) $(WARNING_FLAGS) $(SYSTEM_CXXFLAGS)
@@ -33,6 +34,11 @@ ifeq ($(shell uname -s),Linux)
 	LDFLAGS		+= ../lib/swift-corelibs-libdispatch/build/src/libdispatch.a ../lib/swift-corelibs-libdispatch/build/libBlocksRuntime.a -lbsd -lpthread -lz
 endif
 
+# Range maximum query support used by the PBWT: SCT (default), SPARSE_TABLE, BLOCK or DYNAMIC.
+ifneq ($(PBWT_RMQ),)
+	CPPFLAGS	+= -DFOUNDER_SEQUENCES_PBWT_RMQ=FOUNDER_SEQUENCES_PBWT_RMQ_$(PBWT_RMQ)
+endif
+
 %.o: %.cc
 	$(CXX) -c $(CXXFLAGS) $(CPPFLAGS) -o $@ $<
 
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <founder_sequences/assignment_solver.hh>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define FOUNDER_SEQUENCES_HAVE_X86_KERNELS 1
+#	include <immintrin.h>
+#endif
+
+
+namespace {
+
+	typedef founder_sequences::dense_assignment_solver::cost_type	cost_type;
+	typedef cost_type (*row_minimum_fn)(cost_type const *, std::size_t const);
+	typedef void (*column_minima_fn)(cost_type const *, std::size_t const, cost_type const, cost_type *);
+	
+	
+	cost_type row_minimum_scalar(cost_type const *row, std::size_t const size)
+	{
+		return *std::min_element(row, row + size);
+	}
+	
+	
+	// Update dst[j] to min(dst[j], row[j] - row_potential).
+	void update_column_minima_scalar(cost_type const *row, std::size_t const size, cost_type const row_potential, cost_type *dst)
+	{
+		for (std::size_t i(0); i < size; ++i)
+			dst[i] = std::min(dst[i], row[i] - row_potential);
+	}
+
+
+#if FOUNDER_SEQUENCES_HAVE_X86_KERNELS
+	__attribute__((target("avx2")))
+	cost_type row_minimum_avx2(cost_type const *row, std::size_t const size)
+	{
+		if (size < 8)
+			return row_minimum_scalar(row, size);
+		
+		auto acc(_mm256_loadu_si256(reinterpret_cast <__m256i const *>(row)));
+		std::size_t i(8);
+		for (; i + 8 <= size; i += 8)
+			acc = _mm256_min_epi32(acc, _mm256_loadu_si256(reinterpret_cast <__m256i const *>(row + i)));
+		
+		// Reduce the lanes.
+		auto acc128(_mm_min_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+		acc128 = _mm_min_epi32(acc128, _mm_shuffle_epi32(acc128, _MM_SHUFFLE(1, 0, 3, 2)));
+		acc128 = _mm_min_epi32(acc128, _mm_shuffle_epi32(acc128, _MM_SHUFFLE(2, 3, 0, 1)));
+		auto const retval(_mm_cvtsi128_si32(acc128));
+		
+		return (i < size ? std::min(retval, row_minimum_scalar(row + i, size - i)) : retval);
+	}
+	
+	
+	__attribute__((target("avx2")))
+	void update_column_minima_avx2(cost_type const *row, std::size_t const size, cost_type const row_potential, cost_type *dst)
+	{
+		auto const potential(_mm256_set1_epi32(row_potential));
+		std::size_t i(0);
+		for (; i + 8 <= size; i += 8)
+		{
+			auto const reduced(_mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast <__m256i const *>(row + i)), potential));
+			auto const current(_mm256_loadu_si256(reinterpret_cast <__m256i const *>(dst + i)));
+			_mm256_storeu_si256(reinterpret_cast <__m256i *>(dst + i), _mm256_min_epi32(current, reduced));
+		}
+		
+		update_column_minima_scalar(row + i, size - i, row_potential, dst + i);
+	}
+#endif
+
+
+	struct kernels
+	{
+		row_minimum_fn		row_minimum{&row_minimum_scalar};
+		column_minima_fn	update_column_minima{&update_column_minima_scalar};
+		
+		kernels()
+		{
+#if FOUNDER_SEQUENCES_HAVE_X86_KERNELS
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+			{
+				row_minimum = &row_minimum_avx2;
+				update_column_minima = &update_column_minima_avx2;
+			}
+#endif
+		}
+	};
+	
+	
+	kernels const &selected_kernels()
+	{
+		static kernels const retval;
+		return retval;
+	}
+}
+
+
+namespace founder_sequences {
+
+	void dense_assignment_solver::reduce(cost_type const *costs, std::size_t const size)
+	{
+		// Row reduction followed by column reduction, which makes the reduced costs non-negative.
+		auto const &fns(selected_kernels());
+		m_column_minima.assign(size, std::numeric_limits <cost_type>::max());
+		for (std::size_t i(0); i < size; ++i)
+		{
+			auto const *row(costs + i * size);
+			auto const row_min((*fns.row_minimum)(row, size));
+			m_row_potentials[i] = row_min;
+			(*fns.update_column_minima)(row, size, row_min, m_column_minima.data());
+		}
+		
+		std::copy(m_column_minima.begin(), m_column_minima.end(), m_column_potentials.begin());
+	}
+	
+	
+	void dense_assignment_solver::assign_greedily(cost_type const *costs, std::size_t const size)
+	{
+		// Assign each row to the first free column with zero reduced cost. The assigned edges are tight,
+		// so the partial assignment is optimal w.r.t. the current potentials.
+		for (std::size_t i(0); i < size; ++i)
+		{
+			auto const *row(costs + i * size);
+			auto const row_potential(m_row_potentials[i]);
+			for (std::size_t j(0); j < size; ++j)
+			{
+				if (UNASSIGNED == m_column_rows[j] && row[j] - row_potential - m_column_potentials[j] == 0)
+				{
+					m_column_rows[j] = i;
+					break;
+				}
+			}
+		}
+	}
+	
+	
+	void dense_assignment_solver::augment(cost_type const *costs, std::size_t const size, std::uint32_t const first_row)
+	{
+		// Find the shortest path w.r.t. the reduced costs from first_row to a free column with Dijkstra's algorithm
+		// while updating the potentials s.t. the reduced costs remain non-negative.
+		std::fill(m_min_reduced_costs.begin(), m_min_reduced_costs.end(), std::numeric_limits <potential_type>::max());
+		std::fill(m_visited_columns.begin(), m_visited_columns.end(), 0);
+		
+		std::uint32_t column(UNASSIGNED);	// Virtual column assigned to first_row.
+		while (true)
+		{
+			std::uint32_t row(first_row);
+			if (UNASSIGNED != column)
+			{
+				m_visited_columns[column] = 1;
+				row = m_column_rows[column];
+			}
+			
+			auto const *cost_row(costs + row * size);
+			auto const row_potential(m_row_potentials[row]);
+			potential_type delta(std::numeric_limits <potential_type>::max());
+			std::uint32_t next_column(UNASSIGNED);
+			for (std::size_t j(0); j < size; ++j)
+			{
+				if (m_visited_columns[j])
+					continue;
+				
+				potential_type const reduced_cost(cost_row[j] - row_potential - m_column_potentials[j]);
+				if (reduced_cost < m_min_reduced_costs[j])
+				{
+					m_min_reduced_costs[j] = reduced_cost;
+					m_previous_columns[j] = column;
+				}
+				
+				if (m_min_reduced_costs[j] < delta)
+				{
+					delta = m_min_reduced_costs[j];
+					next_column = j;
+				}
+			}
+			assert(UNASSIGNED != next_column);
+			
+			// Update the potentials.
+			m_row_potentials[first_row] += delta;
+			for (std::size_t j(0); j < size; ++j)
+			{
+				if (m_visited_columns[j])
+				{
+					m_row_potentials[m_column_rows[j]] += delta;
+					m_column_potentials[j] -= delta;
+				}
+				else
+				{
+					m_min_reduced_costs[j] -= delta;
+				}
+			}
+			
+			column = next_column;
+			if (UNASSIGNED == m_column_rows[column])
+				break;
+		}
+		
+		// Flip the edges along the path.
+		while (UNASSIGNED != column)
+		{
+			auto const previous_column(m_previous_columns[column]);
+			m_column_rows[column] = (UNASSIGNED == previous_column ? first_row : m_column_rows[previous_column]);
+			column = previous_column;
+		}
+	}
+	
+	
+	std::int64_t dense_assignment_solver::solve(cost_type const *costs, std::size_t const size, matching_vector &dst)
+	{
+		m_row_potentials.resize(size);
+		m_column_potentials.resize(size);
+		m_min_reduced_costs.resize(size);
+		m_previous_columns.resize(size);
+		m_visited_columns.resize(size);
+		m_column_rows.assign(size, UNASSIGNED);
+		
+		reduce(costs, size);
+		assign_greedily(costs, size);
+		
+		// Find the rows not assigned on the previous step.
+		dst.assign(size, UNASSIGNED);
+		for (std::size_t j(0); j < size; ++j)
+		{
+			if (UNASSIGNED != m_column_rows[j])
+				dst[m_column_rows[j]] = j;
+		}
+		
+		for (std::size_t i(0); i < size; ++i)
+		{
+			if (UNASSIGNED == dst[i])
+				augment(costs, size, i);
+		}
+		
+		// Store the result.
+		std::int64_t retval(0);
+		for (std::size_t j(0); j < size; ++j)
+		{
+			auto const i(m_column_rows[j]);
+			assert(UNASSIGNED != i);
+			dst[i] = j;
+			retval += costs[i * size + j];
+		}
+		
+		return retval;
+	}
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <founder_sequences/auction_assignment_solver.hh>
+#include <limits>
+#include <numeric>
+
+
+namespace {
+
+	// Amount of work below which the rows are handled serially.
+	constexpr std::size_t const PARALLEL_WORK_THRESHOLD{1 << 16};
+	
+	// Factor by which ε is divided after each phase.
+	constexpr std::int64_t const EPSILON_SCALING_FACTOR{5};
+	
+	
+	std::int64_t floor_div(std::int64_t const dividend, std::int64_t const divisor)
+	{
+		assert(0 < divisor);
+		auto const quotient(dividend / divisor);
+		return (dividend % divisor < 0 ? quotient - 1 : quotient);
+	}
+}
+
+
+namespace founder_sequences {
+
+	template <typename t_fn>
+	void auction_assignment_solver::apply(std::size_t const count, std::size_t const work_per_item, t_fn &&fn) const
+	{
+		if (!m_queue || count * work_per_item < PARALLEL_WORK_THRESHOLD)
+		{
+			for (std::size_t i(0); i < count; ++i)
+				fn(i);
+			return;
+		}
+		
+		// dispatch_apply is synchronous, so the function may be passed by pointer.
+		auto *fn_ptr(&fn);
+		dispatch_apply(count, m_queue, ^(std::size_t const idx){
+			(*fn_ptr)(idx);
+		});
+	}
+	
+	
+	void auction_assignment_solver::calculate_bid(
+		weight_type const *weights,
+		std::size_t const size,
+		price_type const scale,
+		price_type const epsilon,
+		std::size_t const bidder_idx
+	)
+	{
+		// Find the best and the second best value. The bid raises the price of the best object s.t.
+		// the bidder becomes indifferent between the two, plus ε.
+		auto const *row(weights + m_bidders[bidder_idx] * size);
+		auto best_value(std::numeric_limits <price_type>::min());
+		auto second_value(std::numeric_limits <price_type>::min());
+		std::uint32_t best_object(UNASSIGNED);
+		for (std::size_t j(0); j < size; ++j)
+		{
+			auto const value(scale * row[j] - m_prices[j]);
+			if (best_value < value)
+			{
+				second_value = best_value;
+				best_value = value;
+				best_object = j;
+			}
+			else if (second_value < value)
+			{
+				second_value = value;
+			}
+		}
+		
+		assert(UNASSIGNED != best_object);
+		m_bid_objects[bidder_idx] = best_object;
+		m_bid_amounts[bidder_idx] = m_prices[best_object] + best_value - second_value + epsilon;
+	}
+	
+	
+	void auction_assignment_solver::run_phase(weight_type const *weights, std::size_t const size, price_type const scale, price_type const epsilon)
+	{
+		// The prices are kept from the previous phase but the assignment is started from scratch.
+		m_object_owners.assign(size, UNASSIGNED);
+		m_assignment.assign(size, UNASSIGNED);
+		m_best_bidders.assign(size, UNASSIGNED);
+		m_bidders.resize(size);
+		std::iota(m_bidders.begin(), m_bidders.end(), 0);
+		
+		while (!m_bidders.empty())
+		{
+			auto const bidder_count(m_bidders.size());
+			m_bid_objects.resize(bidder_count);
+			m_bid_amounts.resize(bidder_count);
+			
+			apply(bidder_count, size, [this, weights, size, scale, epsilon](std::size_t const bidder_idx){
+				calculate_bid(weights, size, scale, epsilon, bidder_idx);
+			});
+			
+			// Find the highest bid for each object.
+			m_bid_columns.clear();
+			for (std::size_t i(0); i < bidder_count; ++i)
+			{
+				auto const object(m_bid_objects[i]);
+				auto &best_bidder(m_best_bidders[object]);
+				if (UNASSIGNED == best_bidder)
+				{
+					best_bidder = i;
+					m_bid_columns.push_back(object);
+				}
+				else if (m_bid_amounts[best_bidder] < m_bid_amounts[i])
+				{
+					best_bidder = i;
+				}
+			}
+			
+			// Assign the objects to the highest bidders and raise the prices. The previous owners and
+			// the bidders that were outbid take part in the next round.
+			m_next_bidders.clear();
+			for (auto const object : m_bid_columns)
+			{
+				auto const bidder_idx(m_best_bidders[object]);
+				auto const row(m_bidders[bidder_idx]);
+				auto const previous_owner(m_object_owners[object]);
+				if (UNASSIGNED != previous_owner)
+				{
+					m_assignment[previous_owner] = UNASSIGNED;
+					m_next_bidders.push_back(previous_owner);
+				}
+				
+				m_object_owners[object] = row;
+				m_assignment[row] = object;
+				m_prices[object] = m_bid_amounts[bidder_idx];
+				m_best_bidders[object] = UNASSIGNED;
+			}
+			
+			for (auto const row : m_bidders)
+			{
+				if (UNASSIGNED == m_assignment[row])
+					m_next_bidders.push_back(row);
+			}
+			
+			using std::swap;
+			swap(m_bidders, m_next_bidders);
+		}
+	}
+	
+	
+	std::int64_t auction_assignment_solver::dual_upper_bound(weight_type const *weights, std::size_t const size, price_type const scale)
+	{
+		// Σ_j p_j + Σ_i max_j (a_ij - p_j) bounds the total scaled weight of any assignment from above.
+		m_row_values.resize(size);
+		apply(size, size, [this, weights, size, scale](std::size_t const i){
+			auto const *row(weights + i * size);
+			auto max_value(std::numeric_limits <price_type>::min());
+			for (std::size_t j(0); j < size; ++j)
+				max_value = std::max(max_value, scale * row[j] - m_prices[j]);
+			m_row_values[i] = max_value;
+		});
+		
+		price_type retval(0);
+		for (std::size_t i(0); i < size; ++i)
+			retval += m_prices[i] + m_row_values[i];
+		
+		// The total weight is an integer.
+		return floor_div(retval, scale);
+	}
+	
+	
+	std::int64_t auction_assignment_solver::solve(weight_type const *weights, std::size_t const size, matching_vector &dst)
+	{
+		dst.resize(size);
+		if (size < 2)
+		{
+			m_upper_bound = 0;
+			if (size)
+			{
+				dst[0] = 0;
+				m_upper_bound = weights[0];
+			}
+			return m_upper_bound;
+		}
+		
+		// With ε = 1 and weights multiplied by size + 1, ε-complementary slackness implies optimality.
+		auto const [min_weight, max_weight] = std::minmax_element(weights, weights + size * size);
+		price_type const scale(size + 1);
+		price_type epsilon(std::max <price_type>(1, scale * (*max_weight - *min_weight) / EPSILON_SCALING_FACTOR));
+		
+		m_prices.assign(size, 0);
+		m_upper_bound = std::numeric_limits <std::int64_t>::max();
+		std::int64_t retval(0);
+		while (true)
+		{
+			run_phase(weights, size, scale, epsilon);
+			
+			retval = 0;
+			for (std::size_t i(0); i < size; ++i)
+				retval += weights[i * size + m_assignment[i]];
+			
+			m_upper_bound = std::min(m_upper_bound, dual_upper_bound(weights, size, scale));
+			assert(retval <= m_upper_bound);
+			
+			if (1 == epsilon)
+				break;
+			
+			if (m_upper_bound - retval <= m_optimality_gap * std::max <std::int64_t>(1, std::abs(m_upper_bound)))
+				break;
+			
+			epsilon = std::max <price_type>(1, epsilon / EPSILON_SCALING_FACTOR);
+		}
+		
+		std::copy(m_assignment.begin(), m_assignment.end(), dst.begin());
+		return retval;
+	}
+}
@@ -3,26 +3,83 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <algorithm>
+#include <cstdlib>
 #include <founder_sequences/bipartite_matcher.hh>
 #include <founder_sequences/create_segment_texts_task.hh>
 #include <founder_sequences/merge_segments_task.hh>
 #include <founder_sequences/segment_text.hh>
+#include <founder_sequences/task_scheduler.hh>
+#include <iostream>
 
 
+namespace fseq	= founder_sequences;
 namespace lb	= libbio;
 
 
+namespace {
+	
+	// Number of consecutive matchings composed in one task when creating the permutations.
+	constexpr std::size_t const PERMUTATION_BLOCK_SIZE{64};
+	
+	
+	template <typename t_fn>
+	void apply(dispatch_queue_t queue, std::size_t const count, t_fn &&fn)
+	{
+		if (!queue || count < 2)
+		{
+			for (std::size_t i(0); i < count; ++i)
+				fn(i);
+			return;
+		}
+		
+		// dispatch_apply is synchronous, so the function may be passed by pointer.
+		auto *fn_ptr(&fn);
+		dispatch_apply(count, queue, ^(std::size_t const idx){
+			(*fn_ptr)(idx);
+		});
+	}
+	
+	
+	char const *backend_name(fseq::matching_backend const backend)
+	{
+		switch (backend)
+		{
+			case fseq::matching_backend::DENSE_ASSIGNMENT:
+				return "dense";
+			case fseq::matching_backend::LEMON:
+				return "lemon";
+			case fseq::matching_backend::SPARSE_FLOW:
+				return "sparse";
+			case fseq::matching_backend::AUCTION:
+				return "auction";
+			case fseq::matching_backend::GREEDY:
+				return "greedy";
+			default:
+				return "unknown";
+		}
+	}
+}
+
+
 namespace founder_sequences
 {
 	void bipartite_matcher::match()
 	{
+		if (m_delegate->is_streaming_pbwt_samples())
+		{
+			create_segment_texts_from_stream();
+			return;
+		}
+		
 		lb::dispatch_ptr <dispatch_group_t> group(dispatch_group_create());
 		
 		auto const seq_count(m_delegate->sequence_count());
 		auto const max_segment_size(m_delegate->max_segment_size());
 		auto const &pbwt_samples(m_delegate->pbwt_samples());
 		
-		// Start tasks for creating segment_texts.
+		// Start tasks for creating segment_texts. The work depends only on the sequence count and the maximum segment size,
+		// which are the same for every segment, so the tasks are not scheduled by their cost.
 		m_segment_texts.resize(pbwt_samples.size());
 		m_tasks.reserve(pbwt_samples.size());
 		for (auto const &tup : ranges::view::zip(pbwt_samples, *m_substrings_to_output, m_segment_texts))
@@ -49,6 +106,71 @@ namespace founder_sequences
 	}
 	
 	
+	void bipartite_matcher::create_segment_texts_from_stream()
+	{
+		// Each sample is valid only until the next one is requested, so create the segment texts synchronously.
+		// The substring copy numbers are added by the delegate when the sample is requested.
+		// Each pair of segments is matched as soon as the texts of both have been created. After a segment
+		// has been matched with both of its neighbours, only a representative of each text is needed for
+		// the permutations unless the segments are output.
+		auto const seq_count(m_delegate->sequence_count());
+		auto const max_segment_size(m_delegate->max_segment_size());
+		m_should_release_segment_texts = !m_delegate->should_keep_segment_texts();
+		
+		m_tasks.clear();
+		m_matchings.clear();
+		m_segment_texts.clear();
+		m_pending_matching_counts.clear();
+		m_matching_weight = 0;
+		m_matching_weight_upper_bound = 0;
+		
+		lb::dispatch_ptr <dispatch_group_t> group(dispatch_group_create());
+		while (auto const *sample = m_delegate->next_pbwt_sample())
+		{
+			auto const idx(m_segment_texts.size());
+			assert(idx < m_substrings_to_output->size());
+			auto &segment_texts(m_segment_texts.emplace_back());
+			create_segment_texts_task task(*sample, (*m_substrings_to_output)[idx], max_segment_size, seq_count, segment_texts);
+			task.execute();
+			
+			// The first segment is only matched with the next one.
+			m_pending_matching_counts.emplace_back(0 == idx ? 1 : 2);
+			if (0 == idx)
+				continue;
+			
+			// The deques do not move their elements when new ones are added, so pointers to them may be passed to the block.
+			m_matchings.emplace_back();
+			auto *merge_task(&add_merge_segments_task(idx - 1));
+			auto *lhs_texts(&m_segment_texts[idx - 1]);
+			auto *rhs_texts(&segment_texts);
+			auto *lhs_count(&m_pending_matching_counts[idx - 1]);
+			auto *rhs_count(&m_pending_matching_counts.back());
+			dispatch_group_async(*group, *m_producer_queue, ^{
+				merge_task->execute();
+				segment_did_finish_matching(*lhs_texts, *lhs_count);
+				segment_did_finish_matching(*rhs_texts, *rhs_count);
+			});
+		}
+		
+		// The last segment has no next one.
+		if (!m_segment_texts.empty())
+			segment_did_finish_matching(m_segment_texts.back(), m_pending_matching_counts.back());
+		
+		// Create the permutations after the matchings have been created.
+		dispatch_group_notify(*group, *m_producer_queue, ^{
+			create_permutations_and_notify();
+		});
+	}
+	
+	
+	void bipartite_matcher::segment_did_finish_matching(segment_text_vector &segment_texts, std::atomic_uint8_t &pending_matching_count) const
+	{
+		// Acquire-release so that the other matching of the segment has finished reading the texts.
+		if (1 == pending_matching_count.fetch_sub(1, std::memory_order_acq_rel) && m_should_release_segment_texts)
+			segment_texts.retain_first_sequence_indices();
+	}
+	
+	
 	void bipartite_matcher::output_segments(std::ostream &stream, sequence_vector const &sequences)
 	{
 		::founder_sequences::output_segments(
@@ -71,20 +193,18 @@ namespace founder_sequences
 		m_matchings.resize(task_count);
 		
 		// Create the merging tasks.
-		auto const set_scoring_method(m_delegate->bipartite_set_scoring_method());
+		m_matching_weight = 0;
+		m_matching_weight_upper_bound = 0;
 		lb::dispatch_ptr <dispatch_group_t> group(dispatch_group_create());
-		std::size_t task_idx(0);
-		for (auto const &pair : m_segment_texts | ranges::view::sliding(2))
-		{
-			auto &matching(m_matchings[task_idx]);
-			auto &task_ptr(m_tasks.emplace_back(new merge_segments_task(task_idx++, *this, pair[0], pair[1], matching, set_scoring_method)));
-			auto *task(task_ptr.get());
-			dispatch_group_async(*group, *m_producer_queue, ^{
-				task->execute();
-			});
-		}
+		task_scheduler scheduler;
+		scheduler.reserve(task_count);
+		for (std::size_t task_idx(0); task_idx < task_count; ++task_idx)
+			scheduler.add_task(add_merge_segments_task(task_idx));
 		assert(task_count == m_tasks.size());
 		
+		// The matchings of large segments may take much longer than the others, so start them first.
+		scheduler.dispatch_tasks(*group, *m_producer_queue);
+		
 		// Create the permutations after the matchings have been created.
 		dispatch_group_notify(*group, *m_producer_queue, ^{
 			create_permutations_and_notify();
@@ -92,36 +212,157 @@ namespace founder_sequences
 	}
 	
 	
+	merge_segments_task &bipartite_matcher::add_merge_segments_task(std::size_t const task_idx)
+	{
+		// In hybrid mode, the task chooses the backend after determining the pairs of substrings with common sequences.
+		auto *auction_queue(m_delegate->should_run_single_threaded() ? nullptr : *m_producer_queue);
+		auto &task_ptr(m_tasks.emplace_back(new merge_segments_task(
+			task_idx,
+			*this,
+			m_segment_texts[task_idx],
+			m_segment_texts[1 + task_idx],
+			m_matchings[task_idx],
+			m_delegate->bipartite_set_scoring_method(),
+			m_delegate->bipartite_matching_backend(),
+			m_delegate->hybrid_approximate_backend(),
+			m_delegate->hybrid_matching_threshold(),
+			m_delegate->auction_optimality_gap(),
+			auction_queue
+		)));
+		return static_cast <merge_segments_task &>(*task_ptr);
+	}
+	
+	
+	void bipartite_matcher::task_did_finish(merge_segments_task &task)
+	{
+		m_matching_weight.fetch_add(task.matching_weight(), std::memory_order_relaxed);
+		m_matching_weight_upper_bound.fetch_add(task.matching_weight_upper_bound(), std::memory_order_relaxed);
+	}
+	
+	
+	void bipartite_matcher::log_matching_tasks() const
+	{
+		for (auto const &task_ptr : m_tasks)
+		{
+			auto const &task(static_cast <merge_segments_task const &>(*task_ptr));
+			lb::log_time(std::cerr);
+			std::cerr
+				<< "Segment pair " << task.task_index()
+				<< " (" << task.distinct_text_count() << " distinct substrings, " << task.shared_pair_count() << " pairs with common sequences)"
+				<< " matched with " << backend_name(task.backend())
+				<< " in " << task.duration().count() << " seconds." << std::endl;
+		}
+	}
+	
+	
+	void bipartite_matcher::log_matching_weight() const
+	{
+		// Report the loss caused by the approximate matchings.
+		auto const weight(m_matching_weight.load(std::memory_order_relaxed));
+		auto const upper_bound(m_matching_weight_upper_bound.load(std::memory_order_relaxed));
+		lb::log_time(std::cerr);
+		std::cerr << "Total matching weight " << weight << ", upper bound " << upper_bound;
+		if (upper_bound)
+			std::cerr << " (gap " << (100.0 * (upper_bound - weight) / std::abs(upper_bound)) << "%)";
+		std::cerr << '.' << std::endl;
+	}
+	
+	
 	void bipartite_matcher::create_permutations_and_notify()
 	{
+		if (UINT32_MAX != m_delegate->hybrid_matching_threshold())
+		{
+			log_matching_tasks();
+			log_matching_weight();
+		}
+		else if (matching_backend::AUCTION == m_delegate->bipartite_matching_backend())
+		{
+			log_matching_weight();
+		}
+		
 		// Create the initial permutation.
 		create_initial_permutation();
+		create_permutations();
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			m_delegate->matcher_did_finish(*this);
+		});
+	}
+	
+	
+	void bipartite_matcher::create_permutations()
+	{
+		// Composing the matchings is associative, so the segments may be handled in blocks. First compose
+		// the matchings of each block, then determine the segment texts at the start of each block from the
+		// composed matchings, and finally fill the permutations of each block starting from those.
+		auto const matching_count(m_matchings.size());
+		if (0 == matching_count)
+			return;
+		
+		auto const block_count((matching_count + PERMUTATION_BLOCK_SIZE - 1) / PERMUTATION_BLOCK_SIZE);
+		auto *queue(m_delegate->should_run_single_threaded() ? nullptr : *m_producer_queue);
+		std::vector <matching_vector> block_start_permutations(block_count);
+		block_start_permutations.front() = m_segment_text_permutation;
 		
-		std::size_t idx(0);
+		apply(queue, block_count - 1, [this, &block_start_permutations](std::size_t const block_idx){
+			auto const begin(block_idx * PERMUTATION_BLOCK_SIZE);
+			compose_matchings(begin, begin + PERMUTATION_BLOCK_SIZE, block_start_permutations[1 + block_idx]);
+		});
+		
+		{
+			matching_vector buffer(m_segment_text_permutation.size());
+			for (std::size_t i(1); i < block_count; ++i)
+			{
+				auto const &previous(block_start_permutations[i - 1]);
+				auto &composed(block_start_permutations[i]);
+				for (std::size_t j(0); j < previous.size(); ++j)
+					buffer[j] = composed[previous[j]];
+				
+				using std::swap;
+				swap(composed, buffer);
+			}
+		}
+		
+		apply(queue, block_count, [this, matching_count, &block_start_permutations](std::size_t const block_idx){
+			auto const begin(block_idx * PERMUTATION_BLOCK_SIZE);
+			auto const end(std::min(matching_count, begin + PERMUTATION_BLOCK_SIZE));
+			fill_permutations(begin, end, block_start_permutations[block_idx]);
+		});
+	}
+	
+	
+	void bipartite_matcher::compose_matchings(std::size_t const begin, std::size_t const end, matching_vector &dst) const
+	{
+		dst.resize(m_segment_text_permutation.size());
+		std::iota(dst.begin(), dst.end(), 0);
+		for (std::size_t idx(begin); idx < end; ++idx)
+		{
+			auto const &matching(m_matchings[idx]);
+			for (auto &seg_idx : dst)
+				seg_idx = matching[seg_idx];
+		}
+	}
+	
+	
+	void bipartite_matcher::fill_permutations(std::size_t const begin, std::size_t const end, matching_vector &segment_text_permutation) const
+	{
+		// segment_text_permutation contains the segment text of each row in segment begin.
 		auto &permutations(m_delegate->permutations());
-		for (auto &permutation : permutations | ranges::view::drop(1))
+		for (std::size_t idx(begin); idx < end; ++idx)
 		{
 			auto const &matching(m_matchings[idx]);
 			auto const &segment_texts(m_segment_texts[1 + idx]);
+			auto &permutation(permutations[1 + idx]);
 			std::size_t i(0);
-			for (auto &seg_idx : m_segment_text_permutation)
+			for (auto &seg_idx : segment_text_permutation)
 			{
 				auto const matched_seg_idx(matching[seg_idx]);
-				auto const &seg_text(segment_texts[matched_seg_idx]);
-				auto const &non_copied_seg_text(segment_texts[seg_text.row_number(matched_seg_idx)]);
-				assert(!non_copied_seg_text.is_copied());
-				permutation[i] = non_copied_seg_text.first_sequence_index();
+				permutation[i] = segment_texts.first_sequence_index(segment_texts.row_number(matched_seg_idx));
 				
 				seg_idx = matched_seg_idx;
 				++i;
 			}
-			
-			++idx;
 		}
-		
-		dispatch_async(dispatch_get_main_queue(), ^{
-			m_delegate->matcher_did_finish(*this);
-		});
 	}
 	
 	
@@ -138,15 +379,8 @@ namespace founder_sequences
 		auto &first_permutation(permutations.front());
 		assert(segment_texts.size() == first_permutation.size());
 		
-		// For each segment_text, store a representative into first_permutation.
-		std::size_t i(0);
-		for (auto const &seg_text : segment_texts)
-		{
-			auto const &non_copied_seg_text(segment_texts[seg_text.row_number(i)]);
-			assert(!non_copied_seg_text.is_copied());
-			first_permutation[i] = non_copied_seg_text.first_sequence_index();
-			
-			++i;
-		}
+		// For each segment text, store a representative into first_permutation.
+		for (std::size_t i(0), count(segment_texts.size()); i < count; ++i)
+			first_permutation[i] = segment_texts.first_sequence_index(segment_texts.row_number(i));
 	}
 }
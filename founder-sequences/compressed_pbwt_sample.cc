@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <founder_sequences/compressed_pbwt_sample.hh>
+#include <libbio/assert.hh>
+#include <libbio/bits.hh>
+#include <zlib.h>
+
+namespace lb = libbio;
+
+
+namespace {
+
+	std::size_t word_count(std::uint64_t const size, std::uint8_t const width)
+	{
+		return (size * width + 63) / 64;
+	}
+}
+
+
+namespace founder_sequences {
+
+	compressed_pbwt_sample::compressed_pbwt_sample(pbwt_sample_type &&sample, bool const should_deflate):
+		m_sample(std::move(sample))
+	{
+		auto const &permutation(m_sample.input_permutation());
+		auto const &divergence(m_sample.input_divergence());
+		auto const sample_idx(m_sample.sequence_idx());
+		m_size = permutation.size();
+		libbio_assert_eq(m_size, divergence.size());
+		
+		// Determine the widths.
+		std::uint64_t max_distance(0);
+		for (auto const val : divergence)
+		{
+			libbio_assert_lte(val, sample_idx);
+			max_distance = std::max <std::uint64_t>(max_distance, sample_idx - val);
+		}
+		m_permutation_width = std::max <std::uint8_t>(1, lb::bits::highest_bit_set(m_size ? m_size - 1 : 0));
+		m_divergence_width = std::max <std::uint8_t>(1, lb::bits::highest_bit_set(max_distance));
+		
+		// Pack.
+		m_permutation = permutation_vector(m_size, 0, m_permutation_width);
+		m_divergence_distances = permutation_vector(m_size, 0, m_divergence_width);
+		for (std::size_t i(0); i < m_size; ++i)
+		{
+			m_permutation[i] = permutation[i];
+			m_divergence_distances[i] = sample_idx - divergence[i];
+		}
+		
+		// Keep only the remaining state in the sample.
+		m_sample.set_fields_in_use(lb::pbwt::context_field::NONE);
+		m_sample.clear_unused_fields();
+		
+		if (should_deflate)
+			deflate();
+	}
+	
+	
+	std::uint64_t compressed_pbwt_sample::size_in_bytes() const
+	{
+		return (
+			sizeof(compressed_pbwt_sample) +
+			sdsl::size_in_bytes(m_permutation) +
+			sdsl::size_in_bytes(m_divergence_distances) +
+			m_deflated_data.capacity()
+		);
+	}
+	
+	
+	std::vector <std::uint64_t> compressed_pbwt_sample::packed_words() const
+	{
+		// Concatenate the packed words of both vectors.
+		auto const permutation_words(word_count(m_size, m_permutation_width));
+		auto const divergence_words(word_count(m_size, m_divergence_width));
+		std::vector <std::uint64_t> words(permutation_words + divergence_words);
+		std::copy_n(m_permutation.data(), permutation_words, words.begin());
+		std::copy_n(m_divergence_distances.data(), divergence_words, words.begin() + permutation_words);
+		return words;
+	}
+	
+	
+	void compressed_pbwt_sample::set_packed_words(std::uint64_t const *words)
+	{
+		auto const permutation_words(word_count(m_size, m_permutation_width));
+		auto const divergence_words(word_count(m_size, m_divergence_width));
+		m_permutation = permutation_vector(m_size, 0, m_permutation_width);
+		m_divergence_distances = permutation_vector(m_size, 0, m_divergence_width);
+		std::copy_n(words, permutation_words, m_permutation.data());
+		std::copy_n(words + permutation_words, divergence_words, m_divergence_distances.data());
+	}
+	
+	
+	void compressed_pbwt_sample::spill(pbwt_sample_scratch_file &scratch_file)
+	{
+		libbio_assert(!m_is_spilled);
+		
+		pbwt_sample_scratch_file::buffer_type buffer;
+		if (m_is_deflated)
+		{
+			using std::swap;
+			swap(buffer, m_deflated_data);
+		}
+		else
+		{
+			auto const words(packed_words());
+			auto const *bytes(reinterpret_cast <std::uint8_t const *>(words.data()));
+			buffer.assign(bytes, bytes + words.size() * sizeof(std::uint64_t));
+			sdsl::util::clear(m_permutation);
+			sdsl::util::clear(m_divergence_distances);
+		}
+		
+		// Pad to whole words s.t. the packed words of every sample may be read from the mapping in place.
+		m_scratch_file = &scratch_file;
+		m_spilled_length = buffer.size();
+		buffer.resize(word_count(buffer.size(), 8) * sizeof(std::uint64_t));
+		m_spilled_offset = scratch_file.append_async(std::move(buffer));
+		m_is_spilled = true;
+	}
+	
+	
+	void compressed_pbwt_sample::unspill()
+	{
+		libbio_assert(m_is_spilled);
+		libbio_assert(m_scratch_file);
+		
+		if (m_is_deflated)
+		{
+			m_deflated_data.resize(m_spilled_length);
+			m_scratch_file->read(m_spilled_offset, m_spilled_length, m_deflated_data.data());
+		}
+		else
+		{
+			libbio_assert_eq(0, m_spilled_length % sizeof(std::uint64_t));
+			std::vector <std::uint64_t> words(m_spilled_length / sizeof(std::uint64_t));
+			m_scratch_file->read(m_spilled_offset, m_spilled_length, reinterpret_cast <std::uint8_t *>(words.data()));
+			set_packed_words(words.data());
+		}
+		
+		m_scratch_file = nullptr;
+		m_is_spilled = false;
+	}
+	
+	
+	void compressed_pbwt_sample::deflate()
+	{
+		libbio_assert(!m_is_deflated);
+		
+		// Compress the packed words of both vectors to one buffer.
+		auto const words(packed_words());
+		auto const src_size(words.size() * sizeof(std::uint64_t));
+		uLongf dst_size(compressBound(src_size));
+		m_deflated_data.resize(dst_size);
+		auto const res(compress2(
+			m_deflated_data.data(),
+			&dst_size,
+			reinterpret_cast <Bytef const *>(words.data()),
+			src_size,
+			Z_BEST_SPEED
+		));
+		
+		// Keep the packed vectors if the data could not be compressed.
+		if (Z_OK != res || src_size <= dst_size)
+		{
+			m_deflated_data.clear();
+			m_deflated_data.shrink_to_fit();
+			return;
+		}
+		
+		m_deflated_data.resize(dst_size);
+		m_deflated_data.shrink_to_fit();
+		sdsl::util::clear(m_permutation);
+		sdsl::util::clear(m_divergence_distances);
+		m_is_deflated = true;
+	}
+	
+	
+	std::vector <std::uint64_t> compressed_pbwt_sample::inflate(std::uint8_t const *data, std::size_t const length) const
+	{
+		libbio_assert(m_is_deflated);
+		
+		auto const permutation_words(word_count(m_size, m_permutation_width));
+		auto const divergence_words(word_count(m_size, m_divergence_width));
+		std::vector <std::uint64_t> words(permutation_words + divergence_words);
+		
+		uLongf dst_size(words.size() * sizeof(std::uint64_t));
+		auto const res(uncompress(
+			reinterpret_cast <Bytef *>(words.data()),
+			&dst_size,
+			data,
+			length
+		));
+		libbio_always_assert_msg(Z_OK == res && words.size() * sizeof(std::uint64_t) == dst_size, "Unable to inflate a PBWT sample");
+		
+		return words;
+	}
+	
+	
+	void compressed_pbwt_sample::unpack(
+		std::uint64_t const *permutation_words,
+		std::uint64_t const *divergence_words,
+		pbwt_sample_type &dst
+	) const
+	{
+		auto const sample_idx(dst.sequence_idx());
+		auto &permutation(dst.input_permutation());
+		auto &divergence(dst.input_divergence());
+		permutation.resize(m_size);
+		divergence.resize(m_size);
+		
+		std::uint64_t permutation_pos(0);
+		std::uint64_t divergence_pos(0);
+		for (std::size_t i(0); i < m_size; ++i)
+		{
+			permutation[i] = sdsl::bits::read_int(permutation_words + (permutation_pos >> 6), permutation_pos & 0x3f, m_permutation_width);
+			divergence[i] = sample_idx - sdsl::bits::read_int(divergence_words + (divergence_pos >> 6), divergence_pos & 0x3f, m_divergence_width);
+			permutation_pos += m_permutation_width;
+			divergence_pos += m_divergence_width;
+		}
+	}
+	
+	
+	void compressed_pbwt_sample::decompress(pbwt_sample_type &dst) const
+	{
+		// Read the spilled data from the mapping if possible instead of copying it to the heap first.
+		std::vector <std::uint64_t> spilled_words;
+		std::uint8_t const *data(m_deflated_data.data());
+		std::size_t length(m_deflated_data.size());
+		if (m_is_spilled)
+		{
+			libbio_assert(m_scratch_file);
+			length = m_spilled_length;
+			if (m_scratch_file->is_mapped())
+				data = m_scratch_file->mapped_data() + m_spilled_offset;
+			else
+			{
+				spilled_words.resize(word_count(length, 8));
+				m_scratch_file->read(m_spilled_offset, length, reinterpret_cast <std::uint8_t *>(spilled_words.data()));
+				data = reinterpret_cast <std::uint8_t const *>(spilled_words.data());
+			}
+		}
+		
+		std::vector <std::uint64_t> inflated_words;
+		std::uint64_t const *permutation_words(m_permutation.data());
+		std::uint64_t const *divergence_words(m_divergence_distances.data());
+		if (m_is_deflated)
+		{
+			inflated_words = inflate(data, length);
+			permutation_words = inflated_words.data();
+			divergence_words = permutation_words + word_count(m_size, m_permutation_width);
+		}
+		else if (m_is_spilled)
+		{
+			libbio_assert_eq(0, length % sizeof(std::uint64_t));
+			permutation_words = reinterpret_cast <std::uint64_t const *>(data);
+			divergence_words = permutation_words + word_count(m_size, m_permutation_width);
+		}
+		
+		dst = m_sample;
+		dst.set_fields_in_use(
+			static_cast <lb::pbwt::context_field>(
+				lb::pbwt::context_field::INPUT_PERMUTATION | lb::pbwt::context_field::INPUT_DIVERGENCE
+			)
+		);
+		unpack(permutation_words, divergence_words, dst);
+	}
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <cassert>
+#include <founder_sequences/contingency_table.hh>
+
+
+namespace founder_sequences {
+
+	void contingency_table::build(segment_text_vector const &lhs, segment_text_vector const &rhs)
+	{
+		// The non-copied texts contain each sequence exactly once.
+		std::size_t const seq_count(lhs.sequence_indices().size());
+		
+		// Map each sequence to its row on the right.
+		m_rhs_rows.resize(seq_count);
+		for (std::size_t j(0), count(rhs.distinct_size()); j < count; ++j)
+		{
+			for (auto const seq_idx : rhs.sequence_indices(j))
+			{
+				assert(seq_idx < seq_count);
+				m_rhs_rows[seq_idx] = j;
+			}
+		}
+		
+		// Count the sequences of each lhs row by their rhs row. The cells of the row are appended when
+		// encountered for the first time, and the counts are moved to them afterwards.
+		m_cells.clear();
+		m_row_offsets.clear();
+		m_row_offsets.reserve(1 + lhs.size());
+		m_counts.clear();
+		m_counts.resize(rhs.size(), 0);
+		for (std::size_t i(0), count(lhs.size()); i < count; ++i)
+		{
+			auto const row_begin(m_cells.size());
+			m_row_offsets.push_back(row_begin);
+			
+			for (auto const seq_idx : lhs.sequence_indices(i))
+			{
+				auto const rhs_idx(m_rhs_rows[seq_idx]);
+				if (0 == m_counts[rhs_idx]++)
+					m_cells.emplace_back(rhs_idx, 0);
+			}
+			
+			for (auto it(m_cells.begin() + row_begin), end(m_cells.end()); it != end; ++it)
+			{
+				it->count = m_counts[it->rhs_idx];
+				m_counts[it->rhs_idx] = 0;
+			}
+		}
+		m_row_offsets.push_back(m_cells.size());
+	}
+}
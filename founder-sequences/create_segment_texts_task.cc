@@ -3,8 +3,10 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <cassert>
 #include <founder_sequences/create_segment_texts_task.hh>
 #include <libbio/algorithm.hh>
+#include <numeric>
 
 
 namespace lb	= libbio;
@@ -14,70 +16,99 @@ namespace founder_sequences {
 	
 	void create_segment_texts_task::execute()
 	{
-		m_segment_texts->resize(m_max_segment_size);
-		auto const permutation(m_pbwt_sample->input_permutation());
-		std::size_t seg_idx(0);
-		std::size_t string_idx(0);
+		auto &segment_texts(*m_segment_texts);
+		auto const &permutation(m_pbwt_sample->input_permutation());
+		auto const &copy_numbers(*m_substring_copy_numbers);
+		auto const distinct_count(copy_numbers.size());
 		
-		// Create a segment_text for each distinct substring.
-		for (auto const &cn : *m_substring_copy_numbers)
+		// The copy numbers contain the end of each distinct substring’s range in the permutation.
+		auto const text_range([&copy_numbers](std::size_t const idx) -> std::pair <std::size_t, std::size_t> {
+			return {(idx ? copy_numbers[idx - 1].copy_number : 0), copy_numbers[idx].copy_number};
+		});
+		
+		// If there are remaining slots, the texts are copied in decreasing order by their sequence counts.
+		// Counting sort the texts by count; the sort is stable, so the ties retain the substring order.
+		std::vector <std::uint32_t> text_order(distinct_count);
+		if (distinct_count < m_max_segment_size)
+		{
+			std::vector <std::uint32_t> count_offsets(2 + m_seq_count, 0);
+			auto const sort_key([this, &text_range](std::size_t const idx) -> std::size_t {
+				auto const [begin, end] = text_range(idx);
+				assert(end - begin <= m_seq_count);
+				return m_seq_count - (end - begin);
+			});
+			
+			for (std::size_t idx(0); idx < distinct_count; ++idx)
+				++count_offsets[1 + sort_key(idx)];
+			std::partial_sum(count_offsets.begin(), count_offsets.end(), count_offsets.begin());
+			for (std::size_t idx(0); idx < distinct_count; ++idx)
+				text_order[count_offsets[sort_key(idx)]++] = idx;
+		}
+		else
+		{
+			std::iota(text_order.begin(), text_order.end(), 0);
+		}
+		
+		// Create a text for each distinct substring and store the position of its first sequence index.
+		std::vector <std::uint32_t> next_positions(distinct_count);
+		segment_texts.clear();
+		segment_texts.reserve(distinct_count, m_seq_count, m_max_segment_size);
+		{
+			std::uint32_t position(0);
+			for (auto const idx : text_order)
+			{
+				auto const [begin, end] = text_range(idx);
+				segment_texts.add_text(end - begin);
+				next_positions[idx] = position;
+				position += end - begin;
+			}
+			assert(m_seq_count == position);
+		}
+		
+		// Determine the substring of each sequence from the runs in the permutation and scatter the sequence
+		// indices to the texts in increasing order. This sorts the index list of each text.
 		{
-			segment_text seg;
-			seg.sequence_indices.resize(cn.copy_number - string_idx, 0);
-			std::size_t i(0);
-			while (string_idx < cn.copy_number)
-				seg.sequence_indices[i++] = permutation[string_idx++];
+			std::vector <std::uint32_t> sequence_texts(m_seq_count);
+			for (std::size_t idx(0); idx < distinct_count; ++idx)
+			{
+				auto const [begin, end] = text_range(idx);
+				for (std::size_t i(begin); i < end; ++i)
+					sequence_texts[permutation[i]] = idx;
+			}
 			
-			// FIXME: use (MSB?) radix sort?
-			std::sort(seg.sequence_indices.begin(), seg.sequence_indices.end());
-			(*m_segment_texts)[seg_idx++] = std::move(seg);
+			auto const sequence_indices(segment_texts.mutable_sequence_indices());
+			for (std::size_t seq_idx(0); seq_idx < m_seq_count; ++seq_idx)
+				sequence_indices[next_positions[sequence_texts[seq_idx]]++] = seq_idx;
 		}
 		
 		// If there are remaining slots, fill them.
-		if (seg_idx < m_max_segment_size)
+		if (distinct_count < m_max_segment_size)
 		{
-			auto const empty_slots(m_max_segment_size - seg_idx);
+			auto const empty_slots(m_max_segment_size - distinct_count);
 			std::size_t remaining_slots(empty_slots);
 			
-			// Sort the items by source text count.
-			std::sort(m_segment_texts->begin(), m_segment_texts->begin() + seg_idx, [](segment_text const &lhs, segment_text const &rhs) -> bool {
-				return lhs.sequence_count() > rhs.sequence_count();
-			});
-			
 			// Copy the segment_texts if needed.
-			auto const limit(seg_idx);
-			auto it(m_segment_texts->begin() + seg_idx);
-			for (std::size_t i(0); i < limit; ++i)
+			for (std::size_t i(0); i < distinct_count; ++i)
 			{
-				auto const &seg((*m_segment_texts)[i]);
-				auto const copy_number(lb::min_ct(remaining_slots, std::ceil(1.0 * seg.sequence_count() / m_seq_count * remaining_slots)));
-				
-				segment_text copied_seg(i);
-				it = std::fill_n(it, copy_number, copied_seg);
+				auto const copy_number(lb::min_ct(remaining_slots, std::ceil(1.0 * segment_texts.sequence_count(i) / m_seq_count * remaining_slots)));
+				segment_texts.add_copies(i, copy_number);
 				
 				remaining_slots -= copy_number;
 				if (0 == remaining_slots)
 					break;
-
-				assert(it != m_segment_texts->end());
 			}
 
 			// If there are remaining slots, fill them.
 			while (remaining_slots)
 			{
-				for (std::size_t i(0); i < limit; ++i)
+				for (std::size_t i(0); i < distinct_count && remaining_slots; ++i)
 				{
-					*it++ = segment_text(i);
+					segment_texts.add_copies(i, 1);
 					--remaining_slots;
-					
-					if (0 == remaining_slots)
-						goto loop_end;
-					
-					assert(m_segment_texts->end() != it);
 				}
 			}
-		loop_end:
-			assert(it == m_segment_texts->end());
 		}
+		
+		assert(segment_texts.size() == m_max_segment_size);
 	}
 }
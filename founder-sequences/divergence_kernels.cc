@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <founder_sequences/divergence_kernels.hh>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define FOUNDER_SEQUENCES_HAVE_X86_KERNELS 1
+#	include <immintrin.h>
+#endif
+
+
+namespace {
+
+	typedef std::size_t (*count_fn)(std::uint32_t const *, std::size_t const, std::uint32_t const);
+	typedef void (*find_fn)(std::uint32_t const *, std::size_t const, std::uint32_t const, std::vector <std::uint32_t> &);
+	
+	
+	std::size_t count_greater_scalar(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb)
+	{
+		std::size_t retval(0);
+		for (std::size_t i(0); i < size; ++i)
+			retval += (lb < values[i]);
+		return retval;
+	}
+	
+	
+	void find_greater_scalar(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb, std::vector <std::uint32_t> &dst)
+	{
+		for (std::size_t i(0); i < size; ++i)
+		{
+			if (lb < values[i])
+				dst.push_back(i);
+		}
+	}
+	
+	
+	// Append base + the index of each set bit in mask.
+	inline void push_set_bits(std::uint32_t mask, std::uint32_t const base, std::vector <std::uint32_t> &dst)
+	{
+		while (mask)
+		{
+			dst.push_back(base + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+
+
+#if FOUNDER_SEQUENCES_HAVE_X86_KERNELS
+	// AVX2 only has signed comparison, so flip the sign bits of both operands.
+	__attribute__((target("avx2")))
+	inline std::uint32_t greater_mask_avx2(std::uint32_t const *values, __m256i const lb_biased, __m256i const bias)
+	{
+		auto const vec(_mm256_loadu_si256(reinterpret_cast <__m256i const *>(values)));
+		auto const cmp(_mm256_cmpgt_epi32(_mm256_xor_si256(vec, bias), lb_biased));
+		return _mm256_movemask_ps(_mm256_castsi256_ps(cmp));
+	}
+	
+	
+	__attribute__((target("avx2,popcnt")))
+	std::size_t count_greater_avx2(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb)
+	{
+		auto const bias(_mm256_set1_epi32(INT32_MIN));
+		auto const lb_biased(_mm256_xor_si256(_mm256_set1_epi32(lb), bias));
+		
+		std::size_t retval(0);
+		std::size_t i(0);
+		for (; i + 8 <= size; i += 8)
+			retval += _mm_popcnt_u32(greater_mask_avx2(values + i, lb_biased, bias));
+		
+		return retval + count_greater_scalar(values + i, size - i, lb);
+	}
+	
+	
+	__attribute__((target("avx2,bmi")))
+	void find_greater_avx2(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb, std::vector <std::uint32_t> &dst)
+	{
+		auto const bias(_mm256_set1_epi32(INT32_MIN));
+		auto const lb_biased(_mm256_xor_si256(_mm256_set1_epi32(lb), bias));
+		
+		std::size_t i(0);
+		for (; i + 8 <= size; i += 8)
+			push_set_bits(greater_mask_avx2(values + i, lb_biased, bias), i, dst);
+		
+		for (; i < size; ++i)
+		{
+			if (lb < values[i])
+				dst.push_back(i);
+		}
+	}
+	
+	
+	__attribute__((target("avx512f,popcnt")))
+	std::size_t count_greater_avx512(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb)
+	{
+		auto const lb_vec(_mm512_set1_epi32(lb));
+		
+		std::size_t retval(0);
+		std::size_t i(0);
+		for (; i + 16 <= size; i += 16)
+		{
+			auto const vec(_mm512_loadu_si512(values + i));
+			retval += _mm_popcnt_u32(_mm512_cmpgt_epu32_mask(vec, lb_vec));
+		}
+		
+		// Handle the remaining values with a masked load.
+		if (i < size)
+		{
+			__mmask16 const load_mask((1U << (size - i)) - 1);
+			auto const vec(_mm512_maskz_loadu_epi32(load_mask, values + i));
+			retval += _mm_popcnt_u32(_mm512_mask_cmpgt_epu32_mask(load_mask, vec, lb_vec));
+		}
+		
+		return retval;
+	}
+	
+	
+	__attribute__((target("avx512f,bmi")))
+	void find_greater_avx512(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb, std::vector <std::uint32_t> &dst)
+	{
+		auto const lb_vec(_mm512_set1_epi32(lb));
+		
+		std::size_t i(0);
+		for (; i + 16 <= size; i += 16)
+		{
+			auto const vec(_mm512_loadu_si512(values + i));
+			push_set_bits(_mm512_cmpgt_epu32_mask(vec, lb_vec), i, dst);
+		}
+		
+		if (i < size)
+		{
+			__mmask16 const load_mask((1U << (size - i)) - 1);
+			auto const vec(_mm512_maskz_loadu_epi32(load_mask, values + i));
+			push_set_bits(_mm512_mask_cmpgt_epu32_mask(load_mask, vec, lb_vec), i, dst);
+		}
+	}
+#endif
+
+
+	struct kernels
+	{
+		count_fn	count{&count_greater_scalar};
+		find_fn		find{&find_greater_scalar};
+		
+		kernels()
+		{
+#if FOUNDER_SEQUENCES_HAVE_X86_KERNELS
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+			{
+				count = &count_greater_avx512;
+				find = &find_greater_avx512;
+			}
+			else if (__builtin_cpu_supports("avx2"))
+			{
+				count = &count_greater_avx2;
+				find = &find_greater_avx2;
+			}
+#endif
+		}
+	};
+	
+	
+	kernels const &selected_kernels()
+	{
+		static kernels const retval;
+		return retval;
+	}
+}
+
+
+namespace founder_sequences {
+
+	std::size_t count_divergence_values_greater_than(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb)
+	{
+		return (*selected_kernels().count)(values, size, lb);
+	}
+	
+	
+	void find_divergence_values_greater_than(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb, std::vector <std::uint32_t> &dst)
+	{
+		(*selected_kernels().find)(values, size, lb, dst);
+	}
+}
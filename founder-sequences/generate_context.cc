@@ -14,6 +14,7 @@
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/serialization/array.hpp>
 #include <boost/serialization/vector.hpp>
+#include <ctime>
 #include <experimental/iterator>
 #include <founder_sequences/founder_sequences.hh>
 #include <founder_sequences/generate_context.hh>
@@ -110,7 +111,14 @@ namespace founder_sequences {
 	{
 		auto const sequence_length(m_sequences.front().size());
 		
-		if (0 == m_pbwt_sample_rate)
+		if (m_is_sample_free)
+		{
+			// Only the samples needed for resuming the PBWT are taken; the ones at the segment boundaries are recalculated.
+			libbio::log_time(std::cerr);
+			std::cerr << "PBWT sampling shall not be done; the PBWT will be recalculated after the traceback." << std::endl;
+			m_pbwt_sample_rate = 1 + sequence_length;
+		}
+		else if (0 == m_pbwt_sample_rate)
 		{
 			libbio::log_time(std::cerr);
 			std::cerr << "PBWT sampling shall not be done." << std::endl;
@@ -123,6 +131,9 @@ namespace founder_sequences {
 			libbio::log_time(std::cerr);
 			std::cerr << "Using " << multiplier << "√n = " << m_pbwt_sample_rate << " as the sample rate." << std::endl;
 		}
+		
+		if (m_memory_limit && !m_is_sample_free)
+			fit_sample_rate_to_memory_limit();
 
 		libbio::log_time(std::cerr);
 		std::cerr << "Generating a compressed alphabet…" << std::endl;
@@ -131,7 +142,17 @@ namespace founder_sequences {
 		m_step_max = m_sequences.size();
 		m_progress_indicator_data_source.reset(new detail::progress_indicator_gc_data_source(*this));
 		
-		dispatch_async(*m_parallel_queue, ^{
+		lb::dispatch_ptr <dispatch_group_t> group(dispatch_group_create());
+		
+		// Hash the input for the segmentation cache while generating the alphabet.
+		if (m_segmentation_cache)
+		{
+			dispatch_group_async(*group, *m_parallel_queue, ^{
+				m_input_hash = hash_sequences(m_sequences);
+			});
+		}
+		
+		dispatch_group_async(*group, *m_parallel_queue, ^{
 			lb::consecutive_alphabet_as_builder <std::uint8_t> builder;
 			
 			builder.init();
@@ -145,19 +166,63 @@ namespace founder_sequences {
 			
 			using std::swap;
 			swap(m_alphabet, builder.alphabet());
-
-			dispatch_async(dispatch_get_main_queue(), ^{
-				m_progress_indicator.end_logging_mt();
-				m_current_step = 0;
-				m_step_max = 0;
+		});
+		
+		dispatch_group_notify(*group, dispatch_get_main_queue(), ^{
+			m_progress_indicator.end_logging_mt();
+			m_current_step = 0;
+			m_step_max = 0;
+			
+			if (running_mode::ESTIMATE_SEGMENT_SIZES == m_running_mode)
+				estimate_segment_sizes();
+			else if (m_max_founder_count)
+			{
+				// The cache is keyed by the founder count limit, so a cached segmentation makes the search unnecessary.
+				segmentation_container container;
+				if (m_segmentation_cache && load_cached_segmentation(container))
+					join_segments_and_output(std::move(container));
+				else
+					search_segment_length_and_continue();
+			}
+			else
 				calculate_segmentation(0, sequence_length);
-			});
 		});
 
 		m_progress_indicator.log_with_progress_bar("\t", *m_progress_indicator_data_source);
 	}
 	
 	
+	void generate_context::fit_sample_rate_to_memory_limit()
+	{
+		// Estimate the memory used by everything but the PBWT samples. The segment length may not be known yet,
+		// so use the sequence length as the size of the DP vector. Reserve space for the PBWT contexts used
+		// for calculating the traceback.
+		auto const sequence_count(m_sequences.size());
+		auto const sequence_length(m_sequences.front().size());
+		std::uint64_t const estimated_sample_size(sizeof(pbwt_sample_type) + 2 * sizeof(std::uint32_t) * sequence_count);
+		std::uint64_t const fixed_size(
+			sequence_count * sequence_length +
+			2 * sequence_length * sizeof(segmentation_dp_arg) +
+			4 * estimated_sample_size
+		);
+		
+		lb::log_time(std::cerr);
+		if (m_memory_limit <= fixed_size)
+		{
+			std::cerr << "WARNING: The memory limit is less than the estimated " << fixed_size << " bytes needed for the input and the DP vector; storing as few PBWT samples as possible." << std::endl;
+			m_pbwt_sample_memory_budget = 1;
+			m_pbwt_sample_rate = 1 + sequence_length;
+			return;
+		}
+		
+		m_pbwt_sample_memory_budget = m_memory_limit - fixed_size;
+		std::uint64_t const max_sample_count(std::max(std::uint64_t(1), m_pbwt_sample_memory_budget / estimated_sample_size));
+		std::uint64_t const sample_rate(std::ceil(double(sequence_length) / max_sample_count));
+		m_pbwt_sample_rate = std::max(m_pbwt_sample_rate, sample_rate);
+		std::cerr << "Using " << m_pbwt_sample_memory_budget << " bytes for the PBWT samples and " << m_pbwt_sample_rate << " as the initial sample rate." << std::endl;
+	}
+	
+	
 	void generate_context::calculate_segmentation_short_path(std::size_t const lb, std::size_t const rb)
 	{
 		segmentation_sp_context ctx(*this, lb, rb);
@@ -182,6 +247,31 @@ namespace founder_sequences {
 		assert(0 == lb); // FIXME: handle ranges that don't start from zero.
 		
 		auto *ctx(new segmentation_lp_context(*this, m_parallel_queue, m_serial_queue)); // Uses callbacks, deleted in the final one.
+		
+		if (!m_precalculated_traceback_dp.empty())
+		{
+			// The segment length bound search already ran the DP with the same bound.
+			m_progress_indicator_data_source.reset(new detail::progress_indicator_lp_generate_traceback_data_source(*ctx));
+			ctx->follow_precalculated_traceback(std::move(m_precalculated_traceback_dp));
+			m_precalculated_traceback_dp.clear();
+			m_progress_indicator.log_with_progress_bar("\t", *m_progress_indicator_data_source);
+			return;
+		}
+		
+		if (!m_checkpoint_directory.empty())
+		{
+			ctx->set_checkpoint_writer(std::make_unique <segmentation_checkpoint_writer>(m_checkpoint_directory, m_checkpoint_interval, m_sequences));
+			if (m_should_resume_from_checkpoint)
+			{
+				lb::log_time(std::cerr);
+				std::cerr << "Loading the checkpoint…" << std::flush;
+				if (ctx->load_checkpoint(lb, rb))
+					std::cerr << " resuming from column " << ctx->resumed_column() << '.' << std::endl;
+				else
+					std::cerr << " no valid checkpoint found; starting from the beginning." << std::endl;
+			}
+		}
+		
 		m_progress_indicator_data_source.reset(new detail::progress_indicator_lp_generate_traceback_data_source(*ctx));
 		
 		ctx->generate_traceback(lb, rb);
@@ -189,6 +279,127 @@ namespace founder_sequences {
 	}
 	
 	
+	void generate_context::search_segment_length_and_continue()
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Calculating the divergence value counts for the segment length bound search…" << std::endl;
+		
+		auto *ctx(new segment_length_search_context(*this, m_parallel_queue, m_max_founder_count)); // Uses callbacks, deleted in the final one.
+		m_progress_indicator_data_source.reset(new detail::progress_indicator_sls_data_source(*ctx));
+		ctx->set_scratch_directory(m_pbwt_sample_scratch_directory);
+		
+		if (m_memory_limit)
+		{
+			// Leave room for the input and the DP vectors of the current and the found bound.
+			auto const sequence_length(m_sequences.front().size());
+			std::uint64_t const fixed_size(sequence_count() * sequence_length + 2 * sequence_length * sizeof(segmentation_dp_arg));
+			ctx->set_divergence_value_count_memory_limit(fixed_size < m_memory_limit ? m_memory_limit - fixed_size : 0);
+		}
+		
+		ctx->search();
+		m_progress_indicator.log_with_progress_bar("\t", *m_progress_indicator_data_source);
+	}
+	
+	
+	void generate_context::context_will_search_segment_length(segment_length_search_context &ctx)
+	{
+		// Not main queue.
+		
+		// Update the progress indicator.
+		m_progress_indicator.end_logging(); // Uses dispatch_sync.
+		
+		auto const uses_stored_counts(ctx.uses_stored_divergence_value_counts());
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (!uses_stored_counts)
+			{
+				lb::log_time(std::cerr);
+				std::cerr << "The divergence value counts do not fit into memory and no scratch directory was given; the PBWT will be recalculated on each step." << std::endl;
+			}
+			
+			lb::log_time(std::cerr);
+			std::cerr << "Searching for the greatest segment length bound that results in at most " << m_max_founder_count << " founders…" << std::endl;
+		});
+	}
+	
+	
+	void generate_context::context_did_evaluate_segment_length(
+		segment_length_search_context &ctx,
+		std::size_t const step,
+		std::size_t const segment_length,
+		std::uint32_t const max_segment_size,
+		std::chrono::duration <double> const &duration
+	)
+	{
+		// Not main queue.
+		auto const seconds(duration.count());
+		dispatch_async(dispatch_get_main_queue(), ^{
+			lb::log_time(std::cerr);
+			std::cerr << "\tStep " << (1 + step) << ": segment length bound " << segment_length << ", maximum segment size " << max_segment_size << " (" << seconds << " s)" << std::endl;
+		});
+	}
+	
+	
+	void generate_context::context_did_finish_search(segment_length_search_context &ctx, std::size_t const segment_length, std::uint32_t const max_segment_size)
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		
+		// Keep the DP vector of the found bound s.t. the DP does not need to be run again.
+		using std::swap;
+		swap(m_precalculated_traceback_dp, ctx.traceback_dp());
+		
+		// Context no longer needed, deallocate.
+		ctx.cleanup();
+		
+		if (0 == segment_length)
+		{
+			finish();
+			std::cerr << "Unable to reduce the number of founders to " << m_max_founder_count << " with any segment length bound." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Using " << segment_length << " as the segment length bound; the maximum segment size is " << max_segment_size << '.' << std::endl;
+		
+		m_segment_length = segment_length;
+		calculate_segmentation(0, m_sequences.front().size());
+	}
+	
+	
+	void generate_context::estimate_segment_sizes()
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Estimating the maximum segment sizes with " << m_estimation_parameters.replicates << " subsamples…" << std::endl;
+		
+		auto *ctx(new segment_size_estimation_context(*this, m_parallel_queue, m_estimation_parameters)); // Uses callbacks, deleted in the final one.
+		m_progress_indicator_data_source.reset(new detail::progress_indicator_sse_data_source(*ctx));
+		
+		ctx->estimate();
+		m_progress_indicator.log_with_progress_bar("\t", *m_progress_indicator_data_source);
+	}
+	
+	
+	void generate_context::context_did_finish_estimation(segment_size_estimation_context &ctx)
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		
+		m_progress_indicator.end_logging_mt();
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Outputting the estimates…" << std::endl;
+		ctx.output_estimates(std::cout);
+		ctx.cleanup();
+		
+		finish();
+		lb::log_time(std::cerr);
+		std::cerr << "Done." << std::endl;
+		exit(EXIT_SUCCESS);
+	}
+	
+	
 	void generate_context::check_traceback_size(segmentation_context &ctx)
 	{
 		if (! (ctx.max_segment_size() < sequence_count()))
@@ -228,6 +439,13 @@ namespace founder_sequences {
 		std::cerr << " there were " << segment_count << " segments the maximum size of which was " << max_segment_size << '.' << std::endl;
 		check_traceback_size(ctx);
 		
+		// No samples are taken if the traceback was calculated while searching for the segment length bound.
+		if (m_is_sample_free || ctx.uses_precalculated_traceback())
+		{
+			start_second_pass(ctx, max_segment_size);
+			return;
+		}
+		
 		lb::log_time(std::cerr);
 		std::cerr << "Updating the PBWT samples to traceback positions…" << std::endl;
 		
@@ -235,6 +453,92 @@ namespace founder_sequences {
 	}
 	
 	
+	bool generate_context::can_stream_reduced_segments() const
+	{
+		// The whole segmentation is needed for saving and caching. Streaming also requires
+		// that the segments are joined while the second pass is still in progress.
+		return (
+			running_mode::GENERATE_FOUNDERS == m_running_mode &&
+			!m_segmentation_ostream.is_open() &&
+			!m_segmentation_cache &&
+			!m_use_single_thread
+		);
+	}
+	
+	
+	void generate_context::start_second_pass(segmentation_lp_context &ctx, std::size_t const max_segment_size)
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Recalculating the PBWT and reducing the number of segments…" << std::endl;
+		
+		if (can_stream_reduced_segments())
+		{
+			lb::log_time(std::cerr);
+			std::cerr << "Joining the remaining segments while they are being determined…" << std::endl;
+			
+			// A few samples are enough to keep both sides busy.
+			m_sample_channel.reset(new pbwt_sample_channel(4));
+			auto *join_ctx(new join_context(*this, m_parallel_queue, m_serial_queue, *m_sample_channel, max_segment_size, m_random_seed)); // Uses callbacks, deleted in the final one.
+			join_ctx->join_segments_and_output(m_segment_joining_method);
+		}
+		else
+		{
+			m_streamed_container = segmentation_container();
+			m_streamed_container.max_segment_size = max_segment_size;
+		}
+		
+		ctx.find_segments_greedy_second_pass();
+	}
+	
+	
+	void generate_context::context_did_find_reduced_segment(segmentation_lp_context &ctx, segmentation_dp_arg const &dp_arg, pbwt_sample_type &&sample)
+	{
+		// Not main queue.
+		
+		if (m_sample_channel)
+			m_sample_channel->push(dp_arg, std::move(sample));
+		else
+		{
+			m_streamed_container.reduced_traceback.emplace_back(dp_arg);
+			m_streamed_container.reduced_pbwt_samples.emplace_back(std::move(sample));
+		}
+	}
+	
+	
+	void generate_context::context_did_finish_second_pass(segmentation_lp_context &ctx)
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		
+		if (m_sample_channel)
+		{
+			// The join context finishes the run after taking the remaining samples.
+			m_progress_indicator.end_logging_mt();
+			m_sample_channel->close();
+			ctx.cleanup();
+			return;
+		}
+		
+		// Handle the reduced segments as if they had been determined from the stored samples.
+		context_did_merge_segments(ctx, std::move(m_streamed_container));
+	}
+	
+	
+	void generate_context::context_will_exceed_pbwt_sample_memory_budget(segmentation_lp_context &ctx, std::uint64_t const required_bytes)
+	{
+		// Not main queue.
+		auto const is_lazy(m_uses_lazy_pbwt_snapshots);
+		dispatch_async(dispatch_get_main_queue(), ^{
+			lb::log_time(std::cerr);
+			std::cerr << "WARNING: Updating the PBWT samples to the segment boundaries needs an estimated " << required_bytes << " bytes, which exceeds the memory limit";
+			if (!is_lazy)
+				std::cerr << "; consider using --lazy-pbwt-snapshots";
+			std::cerr << '.' << std::endl;
+		});
+	}
+	
+	
 	void generate_context::context_will_start_update_samples_tasks(segmentation_lp_context &ctx)
 	{
 		// Not main queue.
@@ -284,6 +588,9 @@ namespace founder_sequences {
 		if (m_segmentation_ostream.is_open())
 			save_segmentation_to_file(container);
 		
+		if (m_segmentation_cache)
+			store_cached_segmentation(container);
+		
 		if (running_mode::GENERATE_FOUNDERS == m_running_mode)
 			join_segments_and_output(std::move(container));
 		else
@@ -291,6 +598,63 @@ namespace founder_sequences {
 	}
 	
 	
+	segmentation_cache_key generate_context::cache_key() const
+	{
+		segmentation_cache_key key;
+		key.input_hash = m_input_hash;
+		key.alphabet_hash = hash_alphabet(m_alphabet);
+		key.sequence_count = m_sequences.size();
+		key.sequence_length = m_sequences.front().size();
+		
+		// With the founder count limit, the segment length bound is not known until the search has been done.
+		if (m_max_founder_count)
+			key.max_founder_count = m_max_founder_count;
+		else
+			key.segment_length = m_segment_length;
+		
+		return key;
+	}
+	
+	
+	bool generate_context::load_cached_segmentation(segmentation_container &container)
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		assert(m_segmentation_cache);
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Looking up the segmentation from the cache…" << std::flush;
+		
+		segmentation_cache_metadata metadata;
+		if (!m_segmentation_cache->load(cache_key(), metadata, container))
+		{
+			std::cerr << " not found." << std::endl;
+			return false;
+		}
+		
+		std::time_t const creation_time(metadata.creation_time);
+		std::cerr << " found.\n";
+		std::cerr << "\tStored input path: '" << metadata.input_path << "'\n";
+		std::cerr << "\tStored at: " << std::ctime(&creation_time) << std::flush; // ctime() adds a newline.
+		return true;
+	}
+	
+	
+	void generate_context::store_cached_segmentation(segmentation_container const &container)
+	{
+		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+		assert(m_segmentation_cache);
+		
+		lb::log_time(std::cerr);
+		std::cerr << "Storing the segmentation to the cache…" << std::endl;
+		
+		segmentation_cache_metadata metadata;
+		metadata.input_path = m_sequence_container->path();
+		metadata.creation_time = std::time(nullptr);
+		if (!m_segmentation_cache->store(cache_key(), metadata, container))
+			std::cerr << "\tUnable to write to the cache directory '" << m_segmentation_cache->directory() << "'." << std::endl;
+	}
+	
+	
 	void generate_context::load_segmentation_from_file(segmentation_container &container)
 	{
 		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
@@ -386,7 +750,32 @@ namespace founder_sequences {
 		if (rb - lb < 2 * m_segment_length)
 			calculate_segmentation_short_path(lb, rb);
 		else
-			calculate_segmentation_long_path(lb, rb);
+		{
+			// Only the long path produces a segmentation container. With the founder count limit,
+			// the cache was checked before the search.
+			segmentation_container container;
+			if (m_segmentation_cache && !m_max_founder_count && load_cached_segmentation(container))
+				join_segments_and_output(std::move(container));
+			else
+				calculate_segmentation_long_path(lb, rb);
+		}
+	}
+	
+	
+	void generate_context::set_checkpoint_parameters(char const *directory, std::chrono::seconds const interval, bool const should_resume)
+	{
+		m_checkpoint_directory = (directory ? directory : "");
+		m_checkpoint_interval = interval;
+		m_should_resume_from_checkpoint = should_resume;
+	}
+	
+	
+	void generate_context::set_cache_directory(char const *directory)
+	{
+		if (directory)
+			m_segmentation_cache.reset(new segmentation_cache(directory));
+		else
+			m_segmentation_cache.reset();
 	}
 	
 	
@@ -4,10 +4,11 @@
  */
 
 #include <algorithm>
+#include <array>
 #include <founder_sequences/greedy_matcher.hh>
 #include <libbio/assert.hh>
 #include <libbio/radix_sort.hh>
-#include <list>
+#include <numeric>
 
 
 namespace lb	= libbio;
@@ -19,7 +20,14 @@ namespace {
 	typedef std::pair <seq_index, seq_index>	seq_index_pair;
 	typedef std::vector <seq_index>				seq_index_vector;
 	typedef std::vector <seq_index_pair>		seq_occurrence_vector;
-	typedef std::vector <std::list <seq_index>> index_list_vector;
+	typedef founder_sequences::detail::substring_index_pair	substring_index_pair;
+	
+	// Number of consecutive segment pairs handled in one task by the parallel variant.
+	constexpr std::size_t const PAIRS_PER_BLOCK{16};
+	
+	// Number of permutation rows composed in one task. Needs to be a multiple of 64 s.t. the blocks
+	// of the bit-packed permutation vectors do not share words.
+	constexpr std::size_t const ROWS_PER_BLOCK{512};
 
 	
 	struct seq_index_pair_access
@@ -105,16 +113,70 @@ namespace {
 	}
 
 
+	// FIFO queues of permutation slots, one for each distinct substring, stored consecutively in one array.
+	// Each substring receives exactly as many slots as it has copies, so the queues may be laid out in
+	// advance from the copy numbers.
+	class slot_queues
+	{
+	protected:
+		seq_index_vector	m_slots;
+		seq_index_vector	m_heads;		// Next slot to be taken.
+		seq_index_vector	m_tails;		// Next slot to be stored.
+		seq_index_vector	m_limits;		// Ends of the queues.
+		
+	public:
+		explicit slot_queues(std::size_t const max_segment_size):
+			m_slots(max_segment_size, 0),
+			m_heads(max_segment_size, 0),
+			m_tails(max_segment_size, 0),
+			m_limits(max_segment_size, 0)
+		{
+		}
+		
+		// Lay out empty queues for the given copy numbers.
+		void reset(seq_index_vector const &copy_numbers, std::size_t const distinct_substring_count)
+		{
+			libbio_assert_lte(distinct_substring_count, copy_numbers.size());
+			seq_index offset(0);
+			for (std::size_t i(0); i < distinct_substring_count; ++i)
+			{
+				m_heads[i] = offset;
+				m_tails[i] = offset;
+				offset += copy_numbers[i];
+				m_limits[i] = offset;
+			}
+			libbio_assert_lte(offset, m_slots.size());
+		}
+		
+		std::size_t size(seq_index const seq_idx) const { return m_tails[seq_idx] - m_heads[seq_idx]; }
+		
+		void push(seq_index const seq_idx, seq_index const slot)
+		{
+			libbio_assert_lt(m_tails[seq_idx], m_limits[seq_idx]);
+			m_slots[m_tails[seq_idx]++] = slot;
+		}
+		
+		seq_index pop(seq_index const seq_idx)
+		{
+			libbio_assert_lt(m_heads[seq_idx], m_tails[seq_idx]);
+			return m_slots[m_heads[seq_idx]++];
+		}
+		
+		template <typename t_permutation>
+		void check(t_permutation const &permutation, std::size_t const distinct_substring_count) const;
+	};
+	
+	
 	template <typename t_permutation>
-	void check_slot_list(t_permutation const &permutation, index_list_vector const &permutation_slots)
+	void slot_queues::check(t_permutation const &permutation, std::size_t const distinct_substring_count) const
 	{
 		std::size_t counted_slots(0);
 		std::vector <bool> stored_slots(permutation.size(), false);
-		for (auto const &slot_list : permutation_slots)
+		for (std::size_t i(0); i < distinct_substring_count; ++i)
 		{
-			for (auto const slot : slot_list)
+			for (auto j(m_heads[i]); j < m_tails[i]; ++j)
 			{
-				stored_slots[slot] = true;
+				stored_slots[m_slots[j]] = true;
 				++counted_slots;
 			}
 		}
@@ -124,28 +186,82 @@ namespace {
 	}
 	
 	
+	// Edges between the distinct substrings of two segments in decreasing order by the number of sequences
+	// that have both. The edges are bucketed by count (bounded by the number of sequences) and stored in
+	// arrays that are reused for each pair of segments.
+	class edge_buckets
+	{
+	protected:
+		std::vector <substring_index_pair>	m_runs;			// In the order of the index pairs.
+		std::vector <substring_index_pair>	m_edges;		// By count.
+		seq_index_vector					m_bucket_offsets;
+		seq_index							m_max_count{};
+		
+	public:
+		explicit edge_buckets(std::size_t const seq_count):
+			m_bucket_offsets(2 + seq_count, 0)
+		{
+			m_runs.reserve(seq_count);
+			m_edges.reserve(seq_count);
+		}
+		
+		std::vector <substring_index_pair> &edges() { return m_edges; }
+		
+		void clear()
+		{
+			m_runs.clear();
+			m_max_count = 0;
+		}
+		
+		void add(seq_index const lhs_idx, seq_index const rhs_idx, seq_index const count)
+		{
+			libbio_assert_lt(count, m_bucket_offsets.size() - 1);
+			m_runs.emplace_back(lhs_idx, rhs_idx, count);
+			++m_bucket_offsets[count];
+			m_max_count = std::max(m_max_count, count);
+		}
+		
+		// Distribute the edges to the buckets in decreasing order by count, retaining the order within each bucket.
+		void sort_by_count()
+		{
+			seq_index offset(0);
+			for (auto count(m_max_count); 0 < count; --count)
+			{
+				auto const bucket_size(m_bucket_offsets[count]);
+				m_bucket_offsets[count] = offset;
+				offset += bucket_size;
+			}
+			
+			m_edges.resize(m_runs.size());
+			for (auto const &run : m_runs)
+				m_edges[m_bucket_offsets[run.count]++] = run;
+			
+			// Clear the buckets for the next pair.
+			std::fill(m_bucket_offsets.begin(), m_bucket_offsets.begin() + 1 + m_max_count, 0);
+		}
+	};
+	
+	
 	template <typename t_permutation>
 	void update_initial_permutation(
 		std::size_t const distinct_substring_count,
 		seq_index_vector const &copy_numbers,
 		seq_index_vector const &seq_mapping,
 		t_permutation &permutation,
-		index_list_vector &permutation_slots
+		slot_queues &permutation_slots
 	)
 	{
-		// Copy the (copied) sequence numbers to the permutation and update the slot list.
+		// Copy the (copied) sequence numbers to the permutation and update the slot queues.
 		libbio_assert_lte(distinct_substring_count, copy_numbers.size());
+		permutation_slots.reset(copy_numbers, distinct_substring_count);
 		std::size_t seq_idx(0);
 		std::size_t i(0);
 		std::size_t const count(permutation.size());
 		for (auto const copy_count : copy_numbers | ranges::view::take_exactly(distinct_substring_count))
 		{
-			// Update the slot list.
-			permutation_slots[seq_idx].clear();
+			// Update the slot queue.
 			for (std::size_t j(0); j < copy_count; ++j)
-				permutation_slots[seq_idx].emplace_back(j + i);
-			libbio_assert_eq(permutation_slots[seq_idx].front(), i);
-			libbio_assert_eq(permutation_slots[seq_idx].back(), i + copy_count - 1);
+				permutation_slots.push(seq_idx, j + i);
 			
 			// Update the permutation.
 			std::fill(permutation.begin() + i, permutation.begin() + i + copy_count, seq_mapping[seq_idx]);
@@ -155,313 +271,442 @@ namespace {
 		}
 
 #ifndef NDEBUG
-		check_slot_list(permutation, permutation_slots);
+		permutation_slots.check(permutation, distinct_substring_count);
 #endif
 	}
 	
 	
-	inline seq_index find_slot(seq_index const seq_idx, index_list_vector &permutation_slots)
-	{
-		// Get an available slot from the list.
-		// permutation_slots maps {0, 1, 2, …} to lists of permutation indices that have the substring in question.
-		libbio_assert_lt(seq_idx, permutation_slots.size());
-		auto &slot_list(permutation_slots[seq_idx]);
-		libbio_assert(!slot_list.empty());
-		auto const slot(slot_list.front());
-		slot_list.pop_front();
-		return slot;
-	}
-	
-	
 	template <typename t_permutation>
 	void draw_edge(
 		seq_index const lhs_idx,
 		seq_index const rhs_idx,
 		seq_index_vector const &rhs_seq_mapping,
-		index_list_vector &lhs_permutation_slots,
-		index_list_vector &rhs_permutation_slots,
+		slot_queues &lhs_permutation_slots,
+		slot_queues &rhs_permutation_slots,
 		t_permutation &permutation
 	)
 	{
-		// Get a slot.
-		auto const slot(find_slot(lhs_idx, lhs_permutation_slots));
+		// Get an available slot from the queue of the left hand side substring.
+		// The queues map {0, 1, 2, …} to the permutation indices that have the substring in question.
+		auto const slot(lhs_permutation_slots.pop(lhs_idx));
 		
 		// Make the slot available on the right hand side.
-		libbio_assert_lt(rhs_idx, rhs_permutation_slots.size());
-		rhs_permutation_slots[rhs_idx].push_back(slot);
-		libbio_assert(!rhs_permutation_slots[rhs_idx].empty());
+		rhs_permutation_slots.push(rhs_idx, slot);
 		
 		// Update the permutation.
 		libbio_assert_lt(slot, permutation.size());
 		libbio_assert_lt(rhs_idx, rhs_seq_mapping.size());
 		permutation[slot] = rhs_seq_mapping[rhs_idx];
 	}
+	
+	
+	// Distinct substrings of one segment and their copy numbers.
+	struct segment_mapping
+	{
+		seq_index			distinct_substrings{};	// Count of distinct substrings in the segment.
+		seq_index_vector	seq_mapping;			// Map {0, 1, 2, …} to the first string (in a_k order) number that begins a run of a unique substring.
+		seq_index_vector	inverse_seq_mapping;	// Inverse of the above but map all string indices in an equivalence class to the same element of N.
+		seq_index_vector	run_lengths;			// Map {0, 1, 2, …} to the length of the run in question.
+		seq_index_vector	copy_numbers;			// Map {0, 1, 2, …} to the number of copies made in the permutation.
+		
+		segment_mapping(std::size_t const max_segment_size, std::size_t const seq_count):
+			seq_mapping(max_segment_size, UINT32_MAX),
+			inverse_seq_mapping(seq_count, UINT32_MAX),
+			run_lengths(1 + max_segment_size, 0),
+			copy_numbers(max_segment_size, 0)
+		{
+		}
+	};
+	
+	
+	// Buffers for determining the segment mappings and drawing the edges between two segments.
+	// Allocated once and reused for each pair of segments.
+	class edge_drawer
+	{
+	protected:
+		seq_occurrence_vector			m_seq_occurrences;			// For sorting {0, 1, 2, …} by the occurrences in the original set.
+		seq_occurrence_vector			m_seq_occurrence_buffer;
+		std::vector <std::uint64_t>		m_index_pairs;				// Pairs of matched string indices encoded in std::uint64_t.
+		std::vector <std::uint64_t>		m_index_pairs_buffer;		// For radix sorting.
+		seq_index_vector				m_remaining_copies;			// Copy of the right hand side copy numbers for bookkeeping.
+		edge_buckets					m_edges_by_count;			// Edges (as pairs of the mapping keys {0, 1, 2, …}) by count.
+		std::size_t						m_seq_count{};
+		std::size_t						m_max_segment_size{};
+		std::uint8_t					m_matching_bits_needed{};
+		std::uint64_t					m_matching_max{};
+		
+	public:
+		edge_drawer(std::size_t const max_segment_size, std::size_t const seq_count):
+			m_seq_occurrences(max_segment_size, {0, 0}),
+			m_seq_occurrence_buffer(max_segment_size, {0, 0}),
+			m_index_pairs(seq_count, 0),
+			m_index_pairs_buffer(seq_count, 0),
+			m_remaining_copies(max_segment_size, 0),
+			m_edges_by_count(seq_count),
+			m_seq_count(seq_count),
+			m_max_segment_size(max_segment_size),
+			m_matching_bits_needed(lb::bits::highest_bit_set(max_segment_size)),	// Space for one additional value.
+			m_matching_max((1 << m_matching_bits_needed) - 1)
+		{
+			libbio_always_assert_lte_msg(2 * m_matching_bits_needed, 64, "Matching needs to fit in 64 bits");
+		}
+		
+		// Determine the distinct substrings of the segment that starts at seg_start_idx and ends at the sample.
+		template <typename t_sample>
+		void update_mapping(std::size_t const seg_start_idx, t_sample const &sample, segment_mapping &dst);
+		
+		// Draw the edges between the copies of the substrings in lhs and in rhs in decreasing order by the number
+		// of sequences that have both, and then between the remaining copies in order. Calls fn(lhs_idx, rhs_idx)
+		// for each copy. lhs.copy_numbers is no longer needed afterwards so it is modified directly.
+		template <typename t_fn>
+		void draw_edges(segment_mapping &lhs, segment_mapping const &rhs, t_fn &&fn);
+		
+	protected:
+		void count_edges(segment_mapping const &lhs, segment_mapping const &rhs);
+	};
+	
+	
+	template <typename t_sample>
+	void edge_drawer::update_mapping(std::size_t const seg_start_idx, t_sample const &sample, segment_mapping &dst)
+	{
+		update_string_mappings(
+			m_seq_count,
+			seg_start_idx,
+			sample.input_permutation(),
+			sample.input_divergence(),
+			dst.distinct_substrings,
+			dst.seq_mapping,
+			dst.inverse_seq_mapping,
+			dst.run_lengths
+		);
+		
+		// Update the distinct subsequence copy numbers.
+		update_seq_occurrences(dst.distinct_substrings, dst.run_lengths, m_seq_occurrences);
+		lb::radix_sort <true>::sort(m_seq_occurrences, m_seq_occurrence_buffer, seq_index_pair_access());
+		update_copies(m_seq_occurrences, m_max_segment_size, m_seq_count, dst.copy_numbers);
+	}
+	
+	
+	void edge_drawer::count_edges(segment_mapping const &lhs, segment_mapping const &rhs)
+	{
+		// Fill the list of edges as encoded index pairs. The order of the sequences does not matter
+		// since the pairs are sorted.
+		for (std::size_t seq_idx(0); seq_idx < m_seq_count; ++seq_idx)
+		{
+			auto const lhs_idx(lhs.inverse_seq_mapping[seq_idx]);
+			auto const rhs_idx(rhs.inverse_seq_mapping[seq_idx]);
+			libbio_assert_lte(lhs_idx, m_matching_max);
+			libbio_assert_lte(rhs_idx, m_matching_max);
+			std::uint64_t const encoded_pair((std::uint64_t(lhs_idx) << m_matching_bits_needed) | rhs_idx);
+			libbio_assert_eq(encoded_pair >> m_matching_bits_needed, lhs_idx);
+			libbio_assert_eq(encoded_pair & m_matching_max, rhs_idx);
+			m_index_pairs[seq_idx] = encoded_pair;
+		}
+		
+		// Radix sort the encoded index pairs for counting.
+		lb::radix_sort <>::sort(m_index_pairs, m_index_pairs_buffer, 2 * m_matching_bits_needed);
+		
+		// Map the counts to unique edges. The counts are bounded by the number of sequences,
+		// so the edges may be bucketed by count.
+		m_edges_by_count.clear();
+		std::uint64_t prev_item(m_index_pairs.front());
+		std::size_t current_count(1);				// Count of the current index pair.
+		for (std::size_t i(1); i < m_seq_count; ++i)
+		{
+			auto const current_item(m_index_pairs[i]);
+			if (prev_item == current_item)
+				++current_count;
+			else
+			{
+				// Store the current run of items.
+				m_edges_by_count.add(prev_item >> m_matching_bits_needed, prev_item & m_matching_max, current_count);
+				prev_item = current_item;
+				current_count = 1;
+			}
+		}
+		
+		// Store the last item.
+		m_edges_by_count.add(prev_item >> m_matching_bits_needed, prev_item & m_matching_max, current_count);
+		m_edges_by_count.sort_by_count();
+	}
+	
+	
+	template <typename t_fn>
+	void edge_drawer::draw_edges(segment_mapping &lhs, segment_mapping const &rhs, t_fn &&fn)
+	{
+		count_edges(lhs, rhs);
+		
+		// Reset the remaining copy numbers.
+		auto &lhs_cn(lhs.copy_numbers);
+		auto &rhs_rc(m_remaining_copies);
+		std::copy(rhs.copy_numbers.begin(), rhs.copy_numbers.end(), rhs_rc.begin());
+		
+		auto &edges(m_edges_by_count.edges());
+		bool did_draw_edge(true);
+		while (did_draw_edge)
+		{
+			// Try to draw an edge for each remaining pair in decreasing order by count.
+			did_draw_edge = false;
+			std::size_t kept_count(0);
+			for (auto const &edge : edges)
+			{
+				// Check if there are available substring copies to draw this edge.
+				auto const lhs_idx(edge.lhs_idx);
+				auto const rhs_idx(edge.rhs_idx);
+				libbio_assert_lt(lhs_idx, lhs.distinct_substrings);
+				libbio_assert_lt(rhs_idx, rhs.distinct_substrings);
+				if (lhs_cn[lhs_idx] && rhs_rc[rhs_idx])
+				{
+					did_draw_edge = true;
+					--lhs_cn[lhs_idx];
+					--rhs_rc[rhs_idx];
+					fn(lhs_idx, rhs_idx);
+					edges[kept_count++] = edge;
+				}
+				
+				// If not, remove the edge entry by not keeping it.
+			}
+			edges.resize(kept_count);
+		}
+		libbio_assert(edges.empty());
+		
+		// Draw the remaining edges.
+		{
+			seq_index i(0), j(0);
+			while (true)
+			{
+				// Find available copies on the left side.
+				while (0 == lhs_cn[i])
+				{
+					++i;
+					if (i == lhs.distinct_substrings)
+						goto end;
+				}
+				
+				// Find available copies on the right side.
+				while (0 == rhs_rc[j])
+				{
+					++j;
+					if (j == rhs.distinct_substrings)
+						goto end;
+				}
+				
+				--lhs_cn[i];
+				--rhs_rc[j];
+				fn(i, j);
+			}
+		end:
+			;
+		}
+		
+#ifndef NDEBUG
+		for (std::size_t i(0); i < lhs.distinct_substrings; ++i)
+			libbio_assert_eq(0, lhs_cn[i]);
+		for (std::size_t i(0); i < rhs.distinct_substrings; ++i)
+			libbio_assert_eq(0, rhs_rc[i]);
+#endif
+	}
+	
+	
+	// Store the exclusive prefix sum of the copy numbers, i.e. the position of the first copy of each substring
+	// when the copies are listed in the order of the substrings.
+	void copy_offsets(segment_mapping const &mapping, seq_index_vector &dst)
+	{
+		seq_index offset(0);
+		for (std::size_t i(0); i < mapping.distinct_substrings; ++i)
+		{
+			dst[i] = offset;
+			offset += mapping.copy_numbers[i];
+		}
+	}
+	
+	
+	template <typename t_fn>
+	void parallel_for(std::size_t const count, dispatch_queue_t queue, t_fn &&fn)
+	{
+		// dispatch_apply is synchronous, so the function may be passed by pointer.
+		auto *fn_ptr(&fn);
+		dispatch_apply(count, queue, ^(std::size_t const idx){
+			(*fn_ptr)(idx);
+		});
+	}
 }
 
 
 namespace founder_sequences
 {
 	void greedy_matcher::match()
+	{
+		// Each pair of segments may be handled separately if the samples are available at once.
+		if (m_delegate->is_streaming_pbwt_samples() || m_delegate->should_run_single_threaded() || m_delegate->pbwt_samples().size() < 2)
+			match_sequential();
+		else
+			match_parallel();
+		
+		m_delegate->matcher_did_finish(*this);
+	}
+	
+	
+	void greedy_matcher::match_sequential()
 	{
 		// Use the greedy algorithm to generate the permutations.
 		auto &permutations(m_delegate->permutations()); // Target permutations.
-		auto const &pbwt_samples(m_delegate->pbwt_samples());
 		
 		auto const max_segment_size(m_delegate->max_segment_size());
 		assert(max_segment_size);
-		auto const matching_bits_needed(lb::bits::highest_bit_set(max_segment_size)); // Space for one additional value.
-		auto const matching_max((1 << matching_bits_needed) - 1);
 		auto const seq_count(m_delegate->sequence_count());
-		libbio_always_assert_lte_msg(2 * matching_bits_needed, 64, "Matching needs to fit in 64 bits");
-		
-		seq_index lhs_distinct_substrings{};									// Count of distinct substrings in a segment. (Swapped in the main loop below.)
-		seq_index rhs_distinct_substrings{};									// Same as above.
-		seq_index_vector lhs_seq_mapping(max_segment_size, UINT32_MAX);			// Map {0, 1, 2, …} to the first string (in a_k order) number that begins a run of a unique substring. (Swapped.)
-		seq_index_vector rhs_seq_mapping(max_segment_size, UINT32_MAX);			// Same as above.
-		seq_index_vector lhs_inverse_seq_mapping(seq_count, UINT32_MAX);		// Inverse of the above but map all string indices in an equivalence class to the same element of N. (Swapped.)
-		seq_index_vector rhs_inverse_seq_mapping(seq_count, UINT32_MAX);		// Same as above.
-		seq_index_vector lhs_rl(1 + max_segment_size, 0);						// Map {0, 1, 2, …} to the length of the run in question. (Swapped.)
-		seq_index_vector rhs_rl(1 + max_segment_size, 0);						// Same as above.
-		seq_index_vector lhs_cn(max_segment_size, 0);							// Map {0, 1, 2, …} to the number of copies made in the permutation. (Swapped.)
-		seq_index_vector rhs_cn(max_segment_size, 0);							// Same as above.
-		seq_index_vector rhs_rc(max_segment_size, 0);							// Copy of the above for bookkeeping (“remaining copies”).
-		seq_occurrence_vector seq_occurrences(max_segment_size, {0, 0});		// For sorting {0, 1, 2, …} by the occurrences in the original set.
-		seq_occurrence_vector seq_occurrence_buffer(max_segment_size, {0, 0});	// For sorting {0, 1, 2, …} by the occurrences in the original set.
-		std::vector <std::uint64_t> index_pairs(seq_count, 0);					// Pairs of matched string indices encoded in std::uint64_t.
-		std::vector <std::uint64_t> index_pairs_buffer(seq_count, 0);			// For radix sorting.
+		
+		segment_mapping lhs_mapping(max_segment_size, seq_count);				// Swapped in the main loop below.
+		segment_mapping rhs_mapping(max_segment_size, seq_count);
+		edge_drawer drawer(max_segment_size, seq_count);
+		slot_queues lhs_permutation_slots(max_segment_size);					// Map {0, 1, 2, …} to permutation slots that have the string in question. (Swapped.)
+		slot_queues rhs_permutation_slots(max_segment_size);					// Same as above.
 		std::size_t seg_start_idx(0);											// Segment start index.
 		
-		typedef std::list <seq_index_pair> index_pair_list;
-		typedef std::map <std::size_t, index_pair_list, std::greater <seq_index>> index_pair_map;
-		index_list_vector lhs_permutation_slots(max_segment_size);				// Map {0, 1, 2, …} to permutation slots that have the string in question. (Swapped.)
-		index_list_vector rhs_permutation_slots(max_segment_size);				// Same as above.
-		index_pair_map index_pairs_by_count;									// Map counts to lists of edges (as pairs of the mapping keys {0, 1, 2, …} above).
-
 		// Fill the string mappings
 		{
-			auto const &pbwt_sample(pbwt_samples.front());
-			auto const &permutation(pbwt_sample.input_permutation());
-			auto const &divergence(pbwt_sample.input_divergence());
-			
-			update_string_mappings(
-				seq_count,
-				seg_start_idx,
-				permutation,
-				divergence,
-				lhs_distinct_substrings,
-				lhs_seq_mapping,
-				lhs_inverse_seq_mapping,
-				lhs_rl
-			);
-			
+			// The samples are taken one at a time s.t. they may be streamed.
+			auto const *pbwt_sample_ptr(m_delegate->next_pbwt_sample());
+			assert(pbwt_sample_ptr);
+			auto const &pbwt_sample(*pbwt_sample_ptr);
+			drawer.update_mapping(seg_start_idx, pbwt_sample, lhs_mapping);
 			seg_start_idx = pbwt_sample.sequence_idx();
-			update_seq_occurrences(lhs_distinct_substrings, lhs_rl, seq_occurrences);
-			lb::radix_sort <true>::sort(seq_occurrences, seq_occurrence_buffer, seq_index_pair_access());
-			update_copies(seq_occurrences, max_segment_size, seq_count, lhs_cn);
-			update_initial_permutation(lhs_distinct_substrings, lhs_cn, lhs_seq_mapping, permutations.front(), lhs_permutation_slots);
+			update_initial_permutation(lhs_mapping.distinct_substrings, lhs_mapping.copy_numbers, lhs_mapping.seq_mapping, permutations.front(), lhs_permutation_slots);
 		}
-
+		
 		// Iterate over the PBWT samples. Use a window function in order to get the segment start position of the pair.
 		std::size_t target_permutation_idx(1);
-		for (auto const &sample : pbwt_samples | ranges::view::drop(1))
+		while (auto const *sample_ptr = m_delegate->next_pbwt_sample())
 		{
-			auto const &permutation(sample.input_permutation());
-			index_pairs_by_count.clear();
+			auto const &sample(*sample_ptr);
 			
 #ifndef NDEBUG
-			for (std::size_t i(0); i < lhs_distinct_substrings; ++i)
-				libbio_assert_eq(lhs_cn[i], lhs_permutation_slots[i].size());
+			for (std::size_t i(0); i < lhs_mapping.distinct_substrings; ++i)
+				libbio_assert_eq(lhs_mapping.copy_numbers[i], lhs_permutation_slots.size(i));
 #endif
 			
 			// Fill the string mappings for the right side.
-			update_string_mappings(
-				seq_count,
-				seg_start_idx,
-				permutation,
-				sample.input_divergence(),
-				rhs_distinct_substrings,
-				rhs_seq_mapping,
-				rhs_inverse_seq_mapping,
-				rhs_rl
-			);
+			drawer.update_mapping(seg_start_idx, sample, rhs_mapping);
 			
-			// Update the distinct subsequence copy numbers.
-			update_seq_occurrences(rhs_distinct_substrings, rhs_rl, seq_occurrences);
-			lb::radix_sort <true>::sort(seq_occurrences, seq_occurrence_buffer, seq_index_pair_access());
-			update_copies(seq_occurrences, max_segment_size, seq_count, rhs_cn);
+			// Draw the edges.
+			auto &permutation(permutations[target_permutation_idx]);
+			rhs_permutation_slots.reset(rhs_mapping.copy_numbers, rhs_mapping.distinct_substrings);
+			drawer.draw_edges(lhs_mapping, rhs_mapping, [&](seq_index const lhs_idx, seq_index const rhs_idx){
+				draw_edge(lhs_idx, rhs_idx, rhs_mapping.seq_mapping, lhs_permutation_slots, rhs_permutation_slots, permutation);
+				libbio_assert_eq(lhs_mapping.copy_numbers[lhs_idx], lhs_permutation_slots.size(lhs_idx));
+			});
 			
-			// Fill the list of edges as encoded index pairs.
-			std::size_t current_run_length(0);
-			for (std::size_t i(0); i < seq_count; ++i)
-			{
-				auto const seq_idx(permutation[i]);
-				libbio_assert_lt(seq_idx, lhs_inverse_seq_mapping.size());
-				libbio_assert_lt(seq_idx, rhs_inverse_seq_mapping.size());
-				auto const lhs_idx(lhs_inverse_seq_mapping[seq_idx]);
-				auto const rhs_idx(rhs_inverse_seq_mapping[seq_idx]);
-				libbio_assert_lte(lhs_idx, matching_max);
-				libbio_assert_lte(rhs_idx, matching_max);
-				auto const encoded_pair((lhs_idx << matching_bits_needed) | rhs_idx);
-				libbio_assert_eq(encoded_pair >> matching_bits_needed, lhs_idx);
-				libbio_assert_eq(encoded_pair & matching_max, rhs_idx);
-				index_pairs[i] = encoded_pair;
-			}
+#ifndef NDEBUG
+			for (std::size_t i(0); i < lhs_mapping.distinct_substrings; ++i)
+				libbio_assert_eq(0, lhs_permutation_slots.size(i));
+			for (std::size_t i(0); i < rhs_mapping.distinct_substrings; ++i)
+				libbio_assert_eq(rhs_mapping.copy_numbers[i], rhs_permutation_slots.size(i));
+			rhs_permutation_slots.check(permutation, rhs_mapping.distinct_substrings);
+#endif
+			
+			using std::swap;
+			swap(lhs_mapping, rhs_mapping);
+			swap(lhs_permutation_slots, rhs_permutation_slots);
+			seg_start_idx = sample.sequence_idx();
+
+			++target_permutation_idx;
+		}
+	}
+	
+	
+	void greedy_matcher::match_parallel()
+	{
+		// Instead of permutation slots, number the copies of the substrings of each segment in the order of the
+		// substrings. For each pair of segments, determine the copy on the right that follows each copy on the left.
+		// Since the slot queues are FIFO, the k-th copy of a substring is the k-th one drawn in the sequential
+		// version, and composing the matchings yields the same permutations.
+		auto &permutations(m_delegate->permutations()); // Target permutations.
+		auto const &pbwt_samples(m_delegate->pbwt_samples());
+		auto const producer_queue(m_delegate->producer_queue());
+		
+		auto const max_segment_size(m_delegate->max_segment_size());
+		assert(max_segment_size);
+		auto const seq_count(m_delegate->sequence_count());
+		auto const segment_count(pbwt_samples.size());
+		assert(permutations.size() == segment_count);
+		
+		std::vector <seq_index_vector> copy_values(segment_count);		// Sequence number by copy.
+		std::vector <seq_index_vector> matchings(segment_count - 1);	// Copy on the right by copy on the left.
+		
+		// Handle the pairs in blocks s.t. the buffers and the mapping of the right hand side may be reused.
+		auto const pair_count(segment_count - 1);
+		auto const block_count((pair_count + PAIRS_PER_BLOCK - 1) / PAIRS_PER_BLOCK);
+		parallel_for(block_count, *producer_queue, [&](std::size_t const block_idx){
+			auto const pair_begin(block_idx * PAIRS_PER_BLOCK);
+			auto const pair_end(std::min(pair_count, pair_begin + PAIRS_PER_BLOCK));
 			
-			// Radix sort the encoded index pairs for counting.
-			lb::radix_sort <>::sort(index_pairs, index_pairs_buffer, 2 * matching_bits_needed);
+			segment_mapping lhs_mapping(max_segment_size, seq_count);
+			segment_mapping rhs_mapping(max_segment_size, seq_count);
+			seq_index_vector lhs_next_copies(max_segment_size, 0);
+			seq_index_vector rhs_next_copies(max_segment_size, 0);
+			edge_drawer drawer(max_segment_size, seq_count);
 			
-			// Map the counts to unique edges. In the worst case, the number of unique counts
-			// (index_pair_map keys) is the inverse of 1 + 2 + 3 + … + k + l = k(k + 1) / 2 + l, l ∈ {1, …, k}.
-			// Call this w; then w log w = o(m). Hence a balanced binary tree (std::map) may be used.
+			auto const fill_copy_values([&](segment_mapping const &mapping, seq_index_vector &dst){
+				dst.resize(max_segment_size);
+				auto it(dst.begin());
+				for (std::size_t i(0); i < mapping.distinct_substrings; ++i)
+					it = std::fill_n(it, mapping.copy_numbers[i], mapping.seq_mapping[i]);
+				libbio_assert(dst.end() == it);
+			});
+			
+			drawer.update_mapping((pair_begin ? pbwt_samples[pair_begin - 1].sequence_idx() : 0), pbwt_samples[pair_begin], lhs_mapping);
+			copy_offsets(lhs_mapping, lhs_next_copies);
+			if (0 == pair_begin)
+				fill_copy_values(lhs_mapping, copy_values.front());
+			
+			for (auto pair_idx(pair_begin); pair_idx < pair_end; ++pair_idx)
 			{
-				std::uint64_t prev_item(index_pairs.front());
-				std::size_t current_count(1);				// Count of the current index pair.
-				for (std::size_t i(1); i < seq_count; ++i)
-				{
-					auto const current_item(index_pairs[i]);
-					if (prev_item == current_item)
-						++current_count;
-					else
-					{
-						// Store the current run of items.
-						auto const lhs_idx(prev_item >> matching_bits_needed);
-						auto const rhs_idx(prev_item & matching_max);
-						libbio_assert_eq(0, (~matching_max) & lhs_idx);
-						index_pairs_by_count[current_count].emplace_back(lhs_idx, rhs_idx);
-						
-						prev_item = current_item;
-						current_count = 1;
-					}
-				}
-				{
-					// Store the last item.
-					auto const lhs_idx(prev_item >> matching_bits_needed);
-					auto const rhs_idx(prev_item & matching_max);
-					libbio_assert_eq(0, (~matching_max) & lhs_idx);
-					index_pairs_by_count[current_count].emplace_back(lhs_idx, rhs_idx);
-				}
+				drawer.update_mapping(pbwt_samples[pair_idx].sequence_idx(), pbwt_samples[1 + pair_idx], rhs_mapping);
+				copy_offsets(rhs_mapping, rhs_next_copies);
+				fill_copy_values(rhs_mapping, copy_values[1 + pair_idx]);
+				
+				// Each copy on the right is drawn exactly once, so the offsets may be advanced directly.
+				auto &matching(matchings[pair_idx]);
+				matching.resize(max_segment_size);
+				drawer.draw_edges(lhs_mapping, rhs_mapping, [&](seq_index const lhs_idx, seq_index const rhs_idx){
+					matching[lhs_next_copies[lhs_idx]++] = rhs_next_copies[rhs_idx]++;
+				});
+				
+				// The offsets of the right hand side were advanced past the copies, so recalculate them.
+				using std::swap;
+				swap(lhs_mapping, rhs_mapping);
+				copy_offsets(lhs_mapping, lhs_next_copies);
 			}
+		});
+		
+		// Compose the matchings. The rows are handled in blocks of whole words of the permutation vectors.
+		auto const row_block_count((max_segment_size + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK);
+		parallel_for(row_block_count, *producer_queue, [&](std::size_t const block_idx){
+			auto const row_begin(block_idx * ROWS_PER_BLOCK);
+			auto const row_end(std::min <std::size_t>(max_segment_size, row_begin + ROWS_PER_BLOCK));
 			
-			// Draw the edges.
+			// Copy of the current segment in each row.
+			std::array <seq_index, ROWS_PER_BLOCK> copies{};
+			std::iota(copies.begin(), copies.begin() + (row_end - row_begin), row_begin);
+			
+			for (std::size_t seg_idx(0); seg_idx < segment_count; ++seg_idx)
 			{
-				// Reset the remaining copy numbers.
-				rhs_rc = rhs_cn;
+				auto &permutation(permutations[seg_idx]);
+				auto const &values(copy_values[seg_idx]);
+				for (auto row(row_begin); row < row_end; ++row)
+					permutation[row] = values[copies[row - row_begin]];
 				
-				auto &permutation(permutations[target_permutation_idx]);
-				bool did_draw_edge(true);
-				//std::cerr << "** Will draw edges" << std::endl;
-				while (did_draw_edge)
+				if (1 + seg_idx < segment_count)
 				{
-					//std::cerr << "*** Edge drawing loop" << std::endl;
-					did_draw_edge = false;
-					auto ip_it(index_pairs_by_count.begin());
-					auto const ip_end(index_pairs_by_count.end());
-
-#ifndef NDEBUG
-					for (std::size_t i(0); i < lhs_distinct_substrings; ++i)
-						libbio_assert_eq(lhs_cn[i], lhs_permutation_slots[i].size());
-#endif
-
-					while (ip_it != ip_end)
+					auto const &matching(matchings[seg_idx]);
+					for (auto row(row_begin); row < row_end; ++row)
 					{
-						// The list below contains the edges that have the current count of occurrences.
-						// Try to draw an edge for each.
-						//std::cerr << "**** Handling count " << ip_it->first << std::endl;
-						auto &list(ip_it->second);
-						auto it(list.begin());
-						auto const end(list.end());
-						while (it != end)
-						{
-							// Check if there are available substring copies to draw this edge.
-							auto const [lhs_idx, rhs_idx] = *it;
-							//std::cerr << "lhs_idx: " << lhs_idx << " rhs_idx: " << rhs_idx << " lhs_cn: " << lhs_cn[lhs_idx] << " ps: " << lhs_permutation_slots[lhs_idx].size() << std::endl;
-							libbio_assert_lt(lhs_idx, lhs_distinct_substrings);
-							libbio_assert_lt(rhs_idx, rhs_distinct_substrings);
-							if (lhs_cn[lhs_idx] && rhs_rc[rhs_idx])
-							{
-								did_draw_edge = true;
-								libbio_assert_eq(lhs_cn[lhs_idx], lhs_permutation_slots[lhs_idx].size());
-								
-								// lhs_cn is no longer needed so it may be modified directly.
-								--lhs_cn[lhs_idx];
-								--rhs_rc[rhs_idx];
-								
-								draw_edge(lhs_idx, rhs_idx, rhs_seq_mapping, lhs_permutation_slots, rhs_permutation_slots, permutation);
-								libbio_assert_eq(lhs_cn[lhs_idx], lhs_permutation_slots[lhs_idx].size());
-								++it;
-							}
-							else
-							{
-								// If not, remove the edge entry.
-								it = list.erase(it);
-							}
-						}
-						
-						if (!list.empty())
-							++ip_it;
-						else
-						{
-							// Remove the list if it was emptied.
-							ip_it = index_pairs_by_count.erase(ip_it);
-						}
+						auto &copy(copies[row - row_begin]);
+						copy = matching[copy];
 					}
 				}
-				libbio_assert(index_pairs_by_count.empty());
-				
-				// Draw the remaining edges.
-				{
-					std::size_t i(0), j(0);
-					while (true)
-					{
-						// Find available copies on the left side.
-						while (0 == lhs_cn[i])
-						{
-							++i;
-							if (i == lhs_distinct_substrings)
-								goto end;
-						}
-						
-						// Find available copies on the right side.
-						while (0 == rhs_rc[j])
-						{
-							++j;
-							if (j == rhs_distinct_substrings)
-								goto end;
-						}
-						
-						draw_edge(i, j, rhs_seq_mapping, lhs_permutation_slots, rhs_permutation_slots, permutation);
-						
-						--lhs_cn[i];
-						--rhs_rc[j];
-					}
-				end:
-					;
-				}
-#ifndef NDEBUG
-				for (std::size_t i(0); i < lhs_distinct_substrings; ++i)
-					libbio_assert_eq(0, lhs_cn[i]);
-				for (std::size_t i(0); i < rhs_distinct_substrings; ++i)
-					libbio_assert_eq(0, rhs_rc[i]);
-				for (std::size_t i(0); i < lhs_distinct_substrings; ++i)
-					libbio_assert_eq(0, lhs_permutation_slots[i].size());
-				for (std::size_t i(0); i < rhs_distinct_substrings; ++i)
-					libbio_assert_eq(rhs_cn[i], rhs_permutation_slots[i].size());
-				check_slot_list(permutation, rhs_permutation_slots);
-#endif
 			}
-			
-			using std::swap;
-			swap(lhs_distinct_substrings, rhs_distinct_substrings);
-			swap(lhs_seq_mapping, rhs_seq_mapping);
-			swap(lhs_inverse_seq_mapping, rhs_inverse_seq_mapping);
-			swap(lhs_rl, rhs_rl);
-			swap(lhs_cn, rhs_cn);
-			swap(lhs_permutation_slots, rhs_permutation_slots);
-			seg_start_idx = sample.sequence_idx();
-
-			++target_permutation_idx;
-		}
-		m_delegate->matcher_did_finish(*this);
+		});
 	}
 	
 	
@@ -3,6 +3,7 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <founder_sequences/divergence_kernels.hh>
 #include <founder_sequences/join_context.hh>
 #include <libbio/algorithm.hh>
 #include <libbio/bits.hh>
@@ -48,13 +49,131 @@ namespace founder_sequences {
 	}
 	
 	
+	void join_context::calculate_substring_copy_numbers(
+		segmentation_dp_arg const &dp_arg,
+		pbwt_sample_type const &sample,
+		substring_copy_number_vector &substring_cn
+	) const
+	{
+		// Count the instances w.r.t. dp_arg’s left bound and sort in decreasing order.
+		// Then, in case of non-greedy matching, fill the segment up to the maximum
+		// segment size by copying substrings in proportion to their occurrence.
+		auto const substring_count(find_distinct_substrings(sample, dp_arg.lb, substring_cn));
+		assert(substring_count);
+		assert(substring_cn.size());
+		
+		// Numbering needed for PBWT order matching.
+		{
+			std::uint32_t i(0);
+			for (auto &cn : substring_cn)
+				cn.string_idx = i++;
+		}
+		
+		if (segment_joining::BIPARTITE_MATCHING != m_segment_joining && segment_joining::HYBRID != m_segment_joining)
+		{
+			// Sort by count.
+			std::sort(substring_cn.begin(), substring_cn.end());
+			
+			// Assign new copy numbers in proportion.
+			auto const empty_slots(m_segmentation_container.max_segment_size - substring_count);
+			std::size_t remaining_slots(empty_slots);
+			for (auto &cn : substring_cn | ranges::view::reverse)
+			{
+				auto const addition(lb::min_ct(remaining_slots, std::ceil(1.0 * cn.copy_number / substring_count * empty_slots)));
+				cn.copy_number = 1 + addition;
+				remaining_slots -= addition;
+			}
+			
+			// If there are still slots left, add to copy numbers.
+			while (remaining_slots)
+			{
+				for (auto &cn : substring_cn | ranges::view::reverse)
+				{
+					++cn.copy_number;
+					--remaining_slots;
+					if (0 == remaining_slots)
+						goto loop_end;
+				}
+			}
+			
+		loop_end:
+			// Check that the sum of copy numbers matches m_max_segment_size.
+			assert(m_segmentation_container.max_segment_size == ranges::accumulate(substring_cn | ranges::view::transform([](auto const &cn) -> std::size_t { return cn.copy_number; }), 0));
+
+			// For PBWT order output sort in the original order.
+			if (segment_joining::PBWT_ORDER == m_segment_joining)
+			{
+				std::sort(substring_cn.begin(), substring_cn.end(), [](substring_copy_number const &lhs, substring_copy_number const &rhs){
+					return lhs.string_idx < rhs.string_idx;
+				});
+			}
+		}
+		
+		make_cumulative_sum(substring_cn);
+	}
+	
+	
+	std::uint32_t join_context::hybrid_matching_threshold() const
+	{
+		// Match every segment pair exactly unless hybrid joining was requested.
+		if (segment_joining::HYBRID == m_segment_joining)
+			return m_delegate->hybrid_matching_threshold();
+		
+		return UINT32_MAX;
+	}
+	
+	
+	pbwt_sample_type const *join_context::next_pbwt_sample()
+	{
+		if (!m_sample_channel)
+		{
+			auto &samples(m_segmentation_container.reduced_pbwt_samples);
+			if (samples.size() == m_next_sample_idx)
+				return nullptr;
+			
+			return &samples[m_next_sample_idx++];
+		}
+		
+		// Replacing m_current_sample releases the previous one, which the matcher has already handled.
+		segmentation_dp_arg dp_arg;
+		if (!m_sample_channel->pop(dp_arg, m_current_sample))
+		{
+			m_current_sample = pbwt_sample_type();
+			return nullptr;
+		}
+		
+		m_segmentation_container.reduced_traceback.emplace_back(dp_arg);
+		
+		if (segment_joining::GREEDY != m_segment_joining)
+		{
+			auto &substring_cn(m_substring_copy_numbers.emplace_back());
+			calculate_substring_copy_numbers(dp_arg, m_current_sample, substring_cn);
+		}
+		
+		// The permutations are filled by the matcher.
+		if (m_matcher)
+			m_permutations.emplace_back(make_permutation());
+		
+		return &m_current_sample;
+	}
+	
+	
 	void join_context::join_segments_and_output(segment_joining const seg_joining)
 	{
 		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
 		
+		m_segment_joining = seg_joining;
+		m_substring_copy_numbers.clear();
+		
+		if (m_sample_channel)
+		{
+			// Consume the samples on a queue of our own, since the channel blocks when empty.
+			dispatch_async(*m_stream_queue, ^{ join_streamed_segments(); });
+			return;
+		}
+		
 		// Count the instances of each substring.
 		assert(m_segmentation_container.reduced_traceback.size() == m_segmentation_container.reduced_pbwt_samples.size());
-		m_substring_copy_numbers.clear();
 		
 		if (segment_joining::GREEDY != seg_joining)
 		{
@@ -62,66 +181,8 @@ namespace founder_sequences {
 			
 			lb::parallel_for_each(
 				ranges::view::zip(m_segmentation_container.reduced_traceback, m_segmentation_container.reduced_pbwt_samples, m_substring_copy_numbers),
-				[this, seg_joining](auto const &tup, std::size_t const){
-					auto const &dp_arg(std::get <0>(tup));
-					auto const &sample(std::get <1>(tup));
-					auto &substring_cn(std::get <2>(tup));
-					
-					// Count the instances w.r.t. dp_arg’s left bound and sort in decreasing order.
-					// Then, in case of non-greedy matching, fill the segment up to the maximum
-					// segment size by copying substrings in proportion to their occurrence.
-					auto const substring_count(sample.unique_substring_count_idxs_lhs(dp_arg.lb, substring_cn));
-					assert(substring_count);
-					assert(substring_cn.size());
-					
-					// Numbering needed for PBWT order matching.
-					{
-						std::uint32_t i(0);
-						for (auto &cn : substring_cn)
-							cn.string_idx = i++;
-					}
-					
-					if (segment_joining::BIPARTITE_MATCHING != seg_joining)
-					{
-						// Sort by count.
-						std::sort(substring_cn.begin(), substring_cn.end());
-						
-						// Assign new copy numbers in proportion.
-						auto const empty_slots(m_segmentation_container.max_segment_size - substring_count);
-						std::size_t remaining_slots(empty_slots);
-						for (auto &cn : substring_cn | ranges::view::reverse)
-						{
-							auto const addition(lb::min_ct(remaining_slots, std::ceil(1.0 * cn.copy_number / substring_count * empty_slots)));
-							cn.copy_number = 1 + addition;
-							remaining_slots -= addition;
-						}
-						
-						// If there are still slots left, add to copy numbers.
-						while (remaining_slots)
-						{
-							for (auto &cn : substring_cn | ranges::view::reverse)
-							{
-								++cn.copy_number;
-								--remaining_slots;
-								if (0 == remaining_slots)
-									goto loop_end;
-							}
-						}
-						
-					loop_end:
-						// Check that the sum of copy numbers matches m_max_segment_size.
-						assert(m_segmentation_container.max_segment_size == ranges::accumulate(substring_cn | ranges::view::transform([](auto const &cn) -> std::size_t { return cn.copy_number; }), 0));
-
-						// For PBWT order output sort in the original order.
-						if (segment_joining::PBWT_ORDER == seg_joining)
-						{
-							std::sort(substring_cn.begin(), substring_cn.end(), [](substring_copy_number const &lhs, substring_copy_number const &rhs){
-								return lhs.string_idx < rhs.string_idx;
-							});
-						}
-					}
-					
-					make_cumulative_sum(substring_cn);
+				[this](auto const &tup, std::size_t const){
+					calculate_substring_copy_numbers(std::get <0>(tup), std::get <1>(tup), std::get <2>(tup));
 				}
 			);
 			
@@ -132,14 +193,50 @@ namespace founder_sequences {
 			));
 		}
 		
+		start_joining();
+	}
+	
+	
+	void join_context::join_streamed_segments()
+	{
+		switch (m_segment_joining)
+		{
+			case segment_joining::GREEDY:
+			case segment_joining::BIPARTITE_MATCHING:
+			case segment_joining::HYBRID:
+				// The matchers take the samples one at a time.
+				start_joining();
+				break;
+				
+			case segment_joining::RANDOM:
+			case segment_joining::PBWT_ORDER:
+			{
+				// Only the copy numbers are needed.
+				while (next_pbwt_sample())
+					;
+				
+				dispatch_async(dispatch_get_main_queue(), ^{ start_joining(); });
+				break;
+			}
+				
+			default:
+				libbio_fail("Unexpected segment joining method.");
+				break;
+		}
+	}
+	
+	
+	void join_context::start_joining()
+	{
 		// *this may be invalid after calling context_did_output_founders().
-		switch (seg_joining)
+		switch (m_segment_joining)
 		{
 			case segment_joining::GREEDY:
 				join_greedy();
 				break;
 				
 			case segment_joining::BIPARTITE_MATCHING:
+			case segment_joining::HYBRID:
 				join_with_bipartite_matching();
 				break;
 				
@@ -168,6 +265,7 @@ namespace founder_sequences {
 		{
 			case segment_joining::GREEDY:
 			case segment_joining::BIPARTITE_MATCHING:
+			case segment_joining::HYBRID:
 				m_matcher->output_segments(stream, sequences);
 				break;
 				
@@ -201,10 +299,14 @@ namespace founder_sequences {
 		m_permutations.clear();
 		m_permutations.resize(m_segmentation_container.reduced_traceback.size());
 		for (auto &permutation : m_permutations)
-		{
-			sdsl::int_vector <0> temp_permutation(m_segmentation_container.max_segment_size, 0, m_permutation_bits_needed);
-			permutation = std::move(temp_permutation);
-		}
+			permutation = make_permutation();
+	}
+	
+	
+	permutation_vector join_context::make_permutation() const
+	{
+		permutation_vector permutation(m_segmentation_container.max_segment_size, 0, m_permutation_bits_needed);
+		return permutation;
 	}
 	
 	
@@ -247,6 +349,19 @@ namespace founder_sequences {
 	
 	
 	void join_context::matcher_did_finish(greedy_matcher &matcher)
+	{
+		// The greedy matcher is run on the stream queue if the samples are streamed.
+		if (m_sample_channel)
+		{
+			dispatch_async(dispatch_get_main_queue(), ^{ output_founders_in_permutation_order(); });
+			return;
+		}
+		
+		output_founders_in_permutation_order();
+	}
+	
+	
+	void join_context::output_founders_in_permutation_order()
 	{
 		assert(dispatch_get_current_queue() == dispatch_get_main_queue());
 		
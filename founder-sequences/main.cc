@@ -3,6 +3,8 @@
  This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <dispatch/dispatch.h>
 #include <founder_sequences/founder_sequences.hh>
@@ -38,6 +40,9 @@ namespace {
 			case segment_joining_arg_random:
 				return fseq::segment_joining::RANDOM;
 
+			case segment_joining_arg_hybrid:
+				return fseq::segment_joining::HYBRID;
+
 			case segment_joining__NULL:
 			default:
 				libbio_fail("Unexpected value for structural variant handling.");
@@ -46,6 +51,48 @@ namespace {
 	}
 	
 	
+	fseq::matching_backend bipartite_matching_backend(enum_matching_backend const mb)
+	{
+		switch (mb)
+		{
+			case matching_backend_arg_dense:
+				return fseq::matching_backend::DENSE_ASSIGNMENT;
+				
+			case matching_backend_arg_lemon:
+				return fseq::matching_backend::LEMON;
+				
+			case matching_backend_arg_sparse:
+				return fseq::matching_backend::SPARSE_FLOW;
+				
+			case matching_backend_arg_auction:
+				return fseq::matching_backend::AUCTION;
+				
+			case matching_backend__NULL:
+			default:
+				libbio_fail("Unexpected value for matching backend.");
+				return fseq::matching_backend::DENSE_ASSIGNMENT; // Not reached.
+		}
+	}
+	
+	
+	fseq::matching_backend hybrid_approximate_backend(enum_hybrid_approximation const ha)
+	{
+		switch (ha)
+		{
+			case hybrid_approximation_arg_greedy:
+				return fseq::matching_backend::GREEDY;
+				
+			case hybrid_approximation_arg_auction:
+				return fseq::matching_backend::AUCTION;
+				
+			case hybrid_approximation__NULL:
+			default:
+				libbio_fail("Unexpected value for hybrid approximation.");
+				return fseq::matching_backend::GREEDY; // Not reached.
+		}
+	}
+	
+	
 	lsr::input_format input_file_format(enum_input_format const fmt)
 	{
 		switch (fmt)
@@ -62,6 +109,47 @@ namespace {
 				return lsr::input_format::LIST_FILE; // Not reached.
 		}
 	}
+	
+	
+	bool parse_memory_limit(char const *str, std::uint64_t &limit)
+	{
+		char *end(nullptr);
+		errno = 0;
+		auto const value(std::strtoull(str, &end, 10));
+		if (errno || end == str)
+			return false;
+		
+		std::uint64_t multiplier(1);
+		switch (*end)
+		{
+			case 'T':
+			case 't':
+				multiplier *= 1024;
+				[[fallthrough]];
+			case 'G':
+			case 'g':
+				multiplier *= 1024;
+				[[fallthrough]];
+			case 'M':
+			case 'm':
+				multiplier *= 1024;
+				[[fallthrough]];
+			case 'K':
+			case 'k':
+				multiplier *= 1024;
+				++end;
+				break;
+				
+			default:
+				break;
+		}
+		
+		if ('\0' != *end || 0 == value || std::numeric_limits <std::uint64_t>::max() / multiplier < value)
+			return false;
+		
+		limit = value * multiplier;
+		return true;
+	}
 }
 
 
@@ -86,19 +174,71 @@ int main(int argc, char **argv)
 		std::cerr << std::endl;
 	}
 	
-	auto const mode(fseq::running_mode::GENERATE_FOUNDERS);
+	auto const mode(args_info.estimate_segment_sizes_given ? fseq::running_mode::ESTIMATE_SEGMENT_SIZES : fseq::running_mode::GENERATE_FOUNDERS);
+	fseq::segment_size_estimation_parameters estimation_parameters;
 	
-	if (args_info.segment_length_bound_given)
+	if (args_info.estimate_segment_sizes_given)
 	{
+		if (3 != std::sscanf(
+			args_info.estimate_segment_sizes_arg,
+			"%zu:%zu:%zu",
+			&estimation_parameters.first_segment_length,
+			&estimation_parameters.last_segment_length,
+			&estimation_parameters.segment_length_step
+		))
+		{
+			std::cerr << "Unable to parse the segment length bounds for estimation." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		
+		if (! (0 < estimation_parameters.first_segment_length && estimation_parameters.first_segment_length <= estimation_parameters.last_segment_length && 0 < estimation_parameters.segment_length_step))
+		{
+			std::cerr << "The segment length bounds for estimation must be positive and FIRST may not be greater than LAST." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		
+		if (args_info.estimate_row_count_arg < 0 || args_info.estimate_window_length_arg < 0)
+		{
+			std::cerr << "Row count and window length for estimation must be non-negative." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		
+		if (args_info.estimate_replicates_arg <= 0)
+		{
+			std::cerr << "Replicate count for estimation must be positive." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		
+		estimation_parameters.row_count = args_info.estimate_row_count_arg;
+		estimation_parameters.window_length = args_info.estimate_window_length_arg;
+		estimation_parameters.replicates = args_info.estimate_replicates_arg;
+		estimation_parameters.random_seed = args_info.random_seed_arg;
+	}
+	else if (args_info.segment_length_bound_given)
+	{
+		if (args_info.max_founder_count_given)
+		{
+			std::cerr << "Segment length bound and maximum founder count may not be specified at the same time." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		
 		if (args_info.segment_length_bound_arg <= 0)
 		{
 			std::cerr << "Segment length bound must be positive." << std::endl;
 			exit(EXIT_FAILURE);
 		}
 	}
+	else if (args_info.max_founder_count_given)
+	{
+		if (! (0 < args_info.max_founder_count_arg && args_info.max_founder_count_arg <= std::numeric_limits <std::uint32_t>::max()))
+		{
+			std::cerr << "Maximum founder count must be positive." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
 	else
 	{
-		std::cerr << "Segment length bound needs to be specified when generating a segmentation." << std::endl;
+		std::cerr << "Either segment length bound or maximum founder count needs to be specified when generating a segmentation." << std::endl;
 		exit(EXIT_FAILURE);
 	}
 	
@@ -114,6 +254,37 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 	
+	if (args_info.resume_flag && !args_info.checkpoint_dir_given)
+	{
+		std::cerr << "--resume requires --checkpoint-dir." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	
+	if (args_info.checkpoint_interval_arg <= 0)
+	{
+		std::cerr << "Checkpoint interval must be positive." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	
+	if (args_info.auction_gap_arg < 0)
+	{
+		std::cerr << "Auction optimality gap must be non-negative." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	
+	if (! (0 <= args_info.hybrid_threshold_arg && args_info.hybrid_threshold_arg <= std::numeric_limits <std::uint32_t>::max()))
+	{
+		std::cerr << "Hybrid threshold out of bounds." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	
+	std::uint64_t memory_limit(0);
+	if (args_info.memory_limit_given && !parse_memory_limit(args_info.memory_limit_arg, memory_limit))
+	{
+		std::cerr << "Unable to parse the memory limit; expected a positive integer optionally followed by K, M, G or T." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	
 	auto const segment_joining(segment_joining_method(args_info.segment_joining_arg));
 	
 	// Instantiate the controller class and run.
@@ -121,7 +292,8 @@ int main(int argc, char **argv)
 		// Deallocates itself with a callback.
 		auto *ctx(new fseq::generate_context(
 			mode,
-			args_info.segment_length_bound_arg,
+			(args_info.segment_length_bound_given ? args_info.segment_length_bound_arg : 0),
+			(args_info.max_founder_count_given ? args_info.max_founder_count_arg : 0),
 			segment_joining,
 			fseq::bipartite_set_scoring::INTERSECTION,
 			args_info.pbwt_sample_rate_arg,
@@ -129,6 +301,22 @@ int main(int argc, char **argv)
 			args_info.single_threaded_flag
 		));
 		
+		ctx->set_estimation_parameters(estimation_parameters);
+		ctx->set_cache_directory(args_info.cache_dir_arg);
+		ctx->set_memory_limit(memory_limit);
+		ctx->set_deflates_pbwt_samples(args_info.deflate_pbwt_samples_flag);
+		ctx->set_scratch_directory(args_info.scratch_dir_arg);
+		ctx->set_sample_free(args_info.sample_free_flag);
+		ctx->set_uses_lazy_pbwt_snapshots(args_info.lazy_pbwt_snapshots_flag);
+		ctx->set_bipartite_matching_backend(bipartite_matching_backend(args_info.matching_backend_arg));
+		ctx->set_auction_optimality_gap(args_info.auction_gap_arg);
+		ctx->set_hybrid_matching_threshold(args_info.hybrid_threshold_arg);
+		ctx->set_hybrid_approximate_backend(hybrid_approximate_backend(args_info.hybrid_approximation_arg));
+		ctx->set_checkpoint_parameters(
+			args_info.checkpoint_dir_arg,
+			std::chrono::seconds(args_info.checkpoint_interval_arg),
+			args_info.resume_flag
+		);
 		ctx->prepare(
 			nullptr,
 			nullptr,
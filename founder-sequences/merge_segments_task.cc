@@ -3,109 +3,169 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <algorithm>
+#include <chrono>
 #include <dispatch/dispatch.h>
+#include <founder_sequences/assignment_solver.hh>
+#include <founder_sequences/auction_assignment_solver.hh>
+#include <founder_sequences/contingency_table.hh>
 #include <founder_sequences/merge_segments_task.hh>
-#include <libbio/algorithm.hh>
+#include <founder_sequences/min_cost_flow.hh>
 #include <libbio/assert.hh>
+#include <tuple>
 
 
+namespace fseq	= founder_sequences;
 namespace lb	= libbio;
 
 
-namespace founder_sequences {
+namespace {
 	
-	std::size_t merge_segments_task::edge_id(
-		graph_type const &graph,
-		std::size_t const li,
-		std::size_t const ri
-	)
+	// The rows of each non-copied segment text including those of its copies.
+	void rows_by_source(fseq::segment_text_vector const &texts, std::vector <std::vector <std::uint32_t>> &dst)
 	{
-		auto const lhs(graph.redNode(li));
-		auto const rhs(graph.blueNode(ri));
-		auto const edge(graph.edge(lhs, rhs));
-		auto const edge_id(graph_type::id(edge));
-		return edge_id;
+		auto const count(texts.size());
+		dst.clear();
+		dst.resize(count);
+		for (std::size_t i(0); i < count; ++i)
+			dst[texts.row_number(i)].push_back(i);
 	}
 	
 	
-	void merge_segments_task::calculate_edge_weight(
-		graph_type const &graph,
-		edge_cost_vector_type &edge_costs,
-		std::size_t const li,
-		std::size_t const ri
+	// Pair the rows not used so far in any order.
+	void match_remaining_rows(
+		std::vector <std::vector <std::uint32_t>> const &lhs_copies,
+		std::vector <std::size_t> const &lhs_used,
+		std::vector <std::vector <std::uint32_t>> const &rhs_copies,
+		std::vector <std::size_t> const &rhs_used,
+		fseq::matching_vector &matching
 	)
 	{
-		auto const &lhs((*m_lhs)[li]);
-		auto const &rhs((*m_rhs)[ri]);
-		
-		weight_type weight{};
+		std::vector <std::uint32_t> remaining_rhs_rows;
+		for (std::size_t j(0), count(rhs_copies.size()); j < count; ++j)
+			remaining_rhs_rows.insert(remaining_rhs_rows.end(), rhs_copies[j].begin() + rhs_used[j], rhs_copies[j].end());
 		
-		switch (m_bipartite_set_scoring_method)
+		auto rhs_it(remaining_rhs_rows.begin());
+		for (std::size_t i(0), count(lhs_copies.size()); i < count; ++i)
 		{
-			case bipartite_set_scoring::SYMMETRIC_DIFFERENCE:
+			for (auto it(lhs_copies[i].begin() + lhs_used[i]), end(lhs_copies[i].end()); it != end; ++it)
 			{
-				auto const opposite_weight(lb::set_symmetric_difference_size(
-					lhs.sequence_indices.cbegin(),
-					lhs.sequence_indices.cend(),
-					rhs.sequence_indices.cbegin(),
-					rhs.sequence_indices.cend()
-				));
-
-				// Try to make sure that the weight is within data type limits.
-				weight = -opposite_weight;
-				libbio_always_assert(-weight == opposite_weight);
-				break;
+				libbio_always_assert(rhs_it != remaining_rhs_rows.end());
+				matching[*it] = *rhs_it++;
 			}
+		}
+	}
+}
+
+
+namespace founder_sequences {
+	
+	auto merge_segments_task::intersection_weight_multiplier() const -> weight_type
+	{
+		switch (m_bipartite_set_scoring_method)
+		{
+			case bipartite_set_scoring::SYMMETRIC_DIFFERENCE:
+				return 2;	// |A Δ B| = |A| + |B| - 2 |A ∩ B|.
 			
 			case bipartite_set_scoring::INTERSECTION:
-			{
-				weight = lb::set_intersection_size(
-					lhs.sequence_indices.cbegin(),
-					lhs.sequence_indices.cend(),
-					rhs.sequence_indices.cbegin(),
-					rhs.sequence_indices.cend()
-				);
-				break;
-			}
+				return 1;
 			
 			default:
 				libbio_fail("Unexpected set scoring method.");
+				return 0; // Not reached.
+		}
+	}
+	
+	
+	std::int64_t merge_segments_task::text_size_weight() const
+	{
+		// With the symmetric difference, the sizes of the texts contribute the same amount to every perfect matching.
+		std::int64_t retval(0);
+		if (bipartite_set_scoring::SYMMETRIC_DIFFERENCE == m_bipartite_set_scoring_method)
+		{
+			for (std::size_t i(0), count(m_lhs->size()); i < count; ++i)
+			{
+				retval -= m_lhs->sequence_count(m_lhs->row_number(i));
+				retval -= m_rhs->sequence_count(m_rhs->row_number(i));
+			}
 		}
+		return retval;
+	}
+	
+	
+	std::size_t merge_segments_task::distinct_text_count(segment_text_vector const &lhs, segment_text_vector const &rhs)
+	{
+		return std::max(lhs.distinct_size(), rhs.distinct_size());
+	}
+	
+	
+	// With sign -1, store the negated weights, i.e. the costs of a minimum cost assignment.
+	void merge_segments_task::calculate_edge_weights(contingency_table const &table, weight_type const sign, weight_matrix_type &weights) const
+	{
+		auto const path_count(m_lhs->size());
+		
+		// The copied texts have the same weights as their sources.
+		std::vector <std::vector <std::uint32_t>> lhs_copies;
+		std::vector <std::vector <std::uint32_t>> rhs_copies;
+		rows_by_source(*m_lhs, lhs_copies);
+		rows_by_source(*m_rhs, rhs_copies);
 		
-		// Store the weight.
-		auto const lhs_node(graph.redNode(li));
-		auto const rhs_node(graph.blueNode(ri));
-		auto const edge(graph.edge(lhs_node, rhs_node));
-		auto const edge_id(graph_type::id(edge));
-		libbio_always_assert(edge_id < edge_costs.size());
-		edge_costs[edge_id] = weight;
+		// Fill the weights of the pairs with no common sequences.
+		weights.clear();
+		weights.resize(path_count * path_count, 0);
+		if (bipartite_set_scoring::SYMMETRIC_DIFFERENCE == m_bipartite_set_scoring_method)
+		{
+			for (std::size_t i(0); i < path_count; ++i)
+			{
+				weight_type const lhs_size(m_lhs->sequence_count(m_lhs->row_number(i)));
+				for (std::size_t j(0); j < path_count; ++j)
+				{
+					weight_type const rhs_size(m_rhs->sequence_count(m_rhs->row_number(j)));
+					weights[i * path_count + j] = -sign * (lhs_size + rhs_size);
+				}
+			}
+		}
+		
+		auto const multiplier(sign * intersection_weight_multiplier());
+		
+		// Add the intersection sizes.
+		for (std::size_t i(0); i < path_count; ++i)
+		{
+			for (auto const &cell : table.row(i))
+			{
+				weight_type const weight(multiplier * cell.count);
+				for (auto const li : lhs_copies[i])
+				{
+					for (auto const ri : rhs_copies[cell.rhs_idx])
+						weights[li * path_count + ri] += weight;
+				}
+			}
+		}
 	}
 	
 	
-	void merge_segments_task::copy_edge_weight(
-		graph_type const &graph,
-		edge_cost_vector_type &edge_costs,
-		std::size_t const li,
-		std::size_t const ri,
-		std::size_t const source_li,
-		std::size_t const source_ri
-	)
+	std::int64_t merge_segments_task::find_maximum_weight_matching_dense(weight_matrix_type const &costs)
 	{
-		// Fetch and store the weight.
-		auto const source_eid(edge_id(graph, source_li, source_ri));
-		auto const eid(edge_id(graph, li, ri));
-		libbio_always_assert(eid < edge_costs.size());
-		libbio_always_assert(source_eid < edge_costs.size());
-		edge_costs[eid] = edge_costs[source_eid];
+		// The costs are the negated weights.
+		auto const path_count(m_lhs->size());
+		dense_assignment_solver solver;
+		return -solver.solve(costs.data(), path_count, *m_matching);
 	}
 	
 	
-	auto merge_segments_task::find_minimum_cost_matching(
-		graph_type const &graph,
-		edge_cost_map_type const &edge_costs
-	) -> weight_type
+	std::int64_t merge_segments_task::find_maximum_weight_matching_lemon(weight_matrix_type const &weights)
 	{
-		matching_type matching(graph, edge_costs);
+		auto const path_count(m_lhs->size());
+		graph_type graph(path_count, path_count);
+		edge_cost_map_type edge_cost_map(graph);
+		for (std::size_t i(0); i < path_count; ++i)
+		{
+			auto const lhs_node(graph.redNode(i));
+			for (std::size_t j(0); j < path_count; ++j)
+				edge_cost_map.set(graph.edge(lhs_node, graph.blueNode(j)), weights[i * path_count + j]);
+		}
+		
+		matching_type matching(graph, edge_cost_map);
 		matching.run();
 
 		// Iterate red nodes in the graph, find their mates and store the pairs in target_paths.
@@ -130,66 +190,231 @@ namespace founder_sequences {
 	}
 	
 	
-	void merge_segments_task::execute()
+	std::int64_t merge_segments_task::find_maximum_weight_matching_sparse(contingency_table const &table)
 	{
+		// Solve the matching as a minimum cost flow between the non-copied segment texts with capacities equal
+		// to their copy numbers. Only the pairs with common sequences have edges of their own; the remaining pairs
+		// are represented by a hub node with zero weight edges. Every unit of flow passes one edge between the segments
+		// either directly or via the hub, so adding the maximum weight to the costs of those makes all the costs
+		// non-negative without changing the solution. The sizes of the texts are the same for every perfect matching,
+		// so the intersection sizes suffice also when scoring with the symmetric difference.
 		auto const path_count(m_lhs->size());
-		auto const rhs_path_count(m_rhs->size());
-		libbio_always_assert(rhs_path_count == path_count);
-		//dispatch_ptr <dispatch_group_t> group(dispatch_group_create());
+		auto const multiplier(intersection_weight_multiplier());
 		
-		// Use a std::vector since contents of its contained objects in different elements
-		// may be modified concurrently without data races.
-		graph_type graph(path_count, path_count);
-		edge_cost_map_type edge_cost_map(graph);
+		std::vector <std::vector <std::uint32_t>> lhs_copies;
+		std::vector <std::vector <std::uint32_t>> rhs_copies;
+		rows_by_source(*m_lhs, lhs_copies);
+		rows_by_source(*m_rhs, rhs_copies);
 		
+		min_cost_flow::cost_type max_weight(0);
+		for (std::size_t i(0); i < path_count; ++i)
 		{
-			std::size_t const edge_costs_size(1 + graph.maxEdgeId());
-			edge_cost_vector_type edge_costs(edge_costs_size, 0);
-			for (std::size_t i(0); i < path_count; ++i)
+			for (auto const &cell : table.row(i))
+				max_weight = std::max <min_cost_flow::cost_type>(max_weight, multiplier * cell.count);
+		}
+		
+		// Nodes: source, sink, hub, lhs texts, rhs texts.
+		std::uint32_t const source(0);
+		std::uint32_t const sink(1);
+		std::uint32_t const hub(2);
+		std::uint32_t const lhs_base(3);
+		std::uint32_t const rhs_base(lhs_base + path_count);
+		min_cost_flow flow(rhs_base + path_count);
+		
+		for (std::size_t i(0); i < path_count; ++i)
+		{
+			if (auto const copy_number = lhs_copies[i].size())
 			{
-				for (std::size_t j(0); j < path_count; ++j)
-				{
-					auto const &lhs((*m_lhs)[i]);
-					auto const &rhs((*m_rhs)[j]);
-					if (! (lhs.is_copied() || rhs.is_copied()))
-					{
-						//dispatch_group_async(*group, queue, ^{
-							calculate_edge_weight(graph, edge_costs, i, j);
-						//});
-					}
-				}
+				flow.add_edge(source, lhs_base + i, copy_number, 0);
+				flow.add_edge(lhs_base + i, hub, copy_number, max_weight);
 			}
 			
-			//dispatch_group_wait(*group, DISPATCH_TIME_FOREVER);
-			
-			// Copy the remaining edge weights.
-			for (std::size_t i(0); i < path_count; ++i)
+			if (auto const copy_number = rhs_copies[i].size())
 			{
-				for (std::size_t j(0); j < path_count; ++j)
-				{
-					auto const &lhs((*m_lhs)[i]);
-					auto const &rhs((*m_rhs)[j]);
-					if (lhs.is_copied() || rhs.is_copied())
-						copy_edge_weight(graph, edge_costs, i, j, lhs.row_number(i), rhs.row_number(j));
-				}
+				flow.add_edge(hub, rhs_base + i, copy_number, 0);
+				flow.add_edge(rhs_base + i, sink, copy_number, 0);
 			}
-			
-			// Copy the values to edge_cost_map.
-			std::size_t i(0);
-			for (auto const weight : edge_costs)
+		}
+		
+		std::vector <std::tuple <std::uint32_t, std::uint32_t, std::size_t>> pair_edges;	// lhs, rhs, edge index.
+		pair_edges.reserve(table.nonzero_count());
+		for (std::size_t i(0); i < path_count; ++i)
+		{
+			for (auto const &cell : table.row(i))
+			{
+				auto const capacity(std::min(lhs_copies[i].size(), rhs_copies[cell.rhs_idx].size()));
+				auto const edge_idx(flow.add_edge(lhs_base + i, rhs_base + cell.rhs_idx, capacity, max_weight - multiplier * cell.count));
+				pair_edges.emplace_back(i, cell.rhs_idx, edge_idx);
+			}
+		}
+		
+		auto const [total_flow, total_cost] = flow.solve(source, sink, path_count);
+		libbio_always_assert(total_flow == path_count);
+		
+		// Assign the rows of the texts along the pair edges, then pair the remaining rows in any order.
+		std::vector <std::size_t> lhs_used(path_count, 0);
+		std::vector <std::size_t> rhs_used(path_count, 0);
+		for (auto const &[li, ri, edge_idx] : pair_edges)
+		{
+			for (std::size_t k(0), count(flow.flow(edge_idx)); k < count; ++k)
+				(*m_matching)[lhs_copies[li][lhs_used[li]++]] = rhs_copies[ri][rhs_used[ri]++];
+		}
+		
+		match_remaining_rows(lhs_copies, lhs_used, rhs_copies, rhs_used, *m_matching);
+		
+		return max_weight * path_count - total_cost + text_size_weight();
+	}
+	
+	
+	std::int64_t merge_segments_task::find_maximum_weight_matching_greedy(contingency_table const &table)
+	{
+		// Match the pairs of texts with the most common sequences first, like greedy_matcher does.
+		// Each row can at best be matched to its heaviest pair, which gives an upper bound for the weight.
+		auto const path_count(m_lhs->size());
+		auto const multiplier(intersection_weight_multiplier());
+		
+		std::vector <std::vector <std::uint32_t>> lhs_copies;
+		std::vector <std::vector <std::uint32_t>> rhs_copies;
+		rows_by_source(*m_lhs, lhs_copies);
+		rows_by_source(*m_rhs, rhs_copies);
+		
+		std::vector <std::tuple <std::uint32_t, std::uint32_t, std::uint32_t>> cells;	// count, lhs, rhs.
+		std::vector <std::uint32_t> lhs_max_counts(path_count, 0);
+		std::vector <std::uint32_t> rhs_max_counts(path_count, 0);
+		cells.reserve(table.nonzero_count());
+		for (std::size_t i(0); i < path_count; ++i)
+		{
+			for (auto const &cell : table.row(i))
 			{
-				auto const edge(graph_type::edgeFromId(i));
-				edge_cost_map.set(edge, weight);
-				++i;
+				cells.emplace_back(cell.count, i, cell.rhs_idx);
+				lhs_max_counts[i] = std::max(lhs_max_counts[i], cell.count);
+				rhs_max_counts[cell.rhs_idx] = std::max(rhs_max_counts[cell.rhs_idx], cell.count);
 			}
 		}
+		std::sort(cells.begin(), cells.end(), std::greater <>());
+		
+		std::int64_t retval(0);
+		std::vector <std::size_t> lhs_used(path_count, 0);
+		std::vector <std::size_t> rhs_used(path_count, 0);
+		for (auto const &[count, li, ri] : cells)
+		{
+			auto const pair_count(std::min(lhs_copies[li].size() - lhs_used[li], rhs_copies[ri].size() - rhs_used[ri]));
+			for (std::size_t k(0); k < pair_count; ++k)
+				(*m_matching)[lhs_copies[li][lhs_used[li]++]] = rhs_copies[ri][rhs_used[ri]++];
+			retval += pair_count * count;
+		}
+		
+		match_remaining_rows(lhs_copies, lhs_used, rhs_copies, rhs_used, *m_matching);
+		
+		std::int64_t lhs_bound(0);
+		std::int64_t rhs_bound(0);
+		for (std::size_t i(0); i < path_count; ++i)
+		{
+			lhs_bound += lhs_copies[i].size() * lhs_max_counts[i];
+			rhs_bound += rhs_copies[i].size() * rhs_max_counts[i];
+		}
+		
+		auto const size_weight(text_size_weight());
+		m_matching_weight_upper_bound = multiplier * std::min(lhs_bound, rhs_bound) + size_weight;
+		return multiplier * retval + size_weight;
+	}
+	
+	
+	std::int64_t merge_segments_task::find_maximum_weight_matching_auction(weight_matrix_type const &weights)
+	{
+		auto const path_count(m_lhs->size());
+		auction_assignment_solver solver;
+		solver.set_queue(m_auction_queue);
+		solver.set_optimality_gap(m_auction_optimality_gap);
+		auto const retval(solver.solve(weights.data(), path_count, *m_matching));
+		m_matching_weight_upper_bound = solver.upper_bound();
+		return retval;
+	}
+	
+	
+	std::uint64_t merge_segments_task::estimated_cost() const
+	{
+		// Finding the matching takes O(k³) time. The edge weights are calculated in time proportional to
+		// the number of sequences and the number of pairs. The sparse backend does not fill the weight matrix,
+		// and its flow network has only O(k + nnz) edges. The greedy backend only sorts the non-zero pairs.
+		// The contingency table has not been built yet, but every sequence adds to one pair, so nnz is
+		// at most min(k², sequence count).
+		std::uint64_t const k(m_lhs->size());
+		std::uint64_t const sequence_count(m_lhs->sequence_indices().size());
+		
+		if (matching_backend::SPARSE_FLOW == m_matching_backend || matching_backend::GREEDY == m_matching_backend)
+			return k + std::min(k * k, sequence_count) + sequence_count;
+		
+		return k * k * k + k * k + sequence_count;
+	}
+	
+	
+	void merge_segments_task::execute()
+	{
+		auto const path_count(m_lhs->size());
+		auto const rhs_path_count(m_rhs->size());
+		libbio_always_assert(rhs_path_count == path_count);
+		
+		auto const start_time(std::chrono::steady_clock::now());
+		
+		contingency_table table;
+		table.build(*m_lhs, *m_rhs);
+		
+		// In hybrid mode, match the pair approximately if many of its distinct substrings have common sequences.
+		// The matrix given to the dense backends is as large for every pair, but the number of such pairs
+		// determines how much work the exact solvers need to do beyond the initial assignment.
+		m_shared_pair_count = table.nonzero_count();
+		if (UINT32_MAX != m_hybrid_threshold && m_hybrid_threshold < m_shared_pair_count)
+			m_matching_backend = m_approximate_backend;
 		
 		m_matching->clear();
 		m_matching->resize(
 			path_count,
 			std::numeric_limits <matching_vector::value_type>::max()
 		);
-		auto const matching_weight(find_minimum_cost_matching(graph, edge_cost_map));
+		
+		switch (m_matching_backend)
+		{
+			case matching_backend::DENSE_ASSIGNMENT:
+			{
+				weight_matrix_type costs;
+				calculate_edge_weights(table, -1, costs);
+				m_matching_weight = find_maximum_weight_matching_dense(costs);
+				m_matching_weight_upper_bound = m_matching_weight;
+				break;
+			}
+			
+			case matching_backend::LEMON:
+			{
+				weight_matrix_type weights;
+				calculate_edge_weights(table, 1, weights);
+				m_matching_weight = find_maximum_weight_matching_lemon(weights);
+				m_matching_weight_upper_bound = m_matching_weight;
+				break;
+			}
+			
+			case matching_backend::SPARSE_FLOW:
+				m_matching_weight = find_maximum_weight_matching_sparse(table);
+				m_matching_weight_upper_bound = m_matching_weight;
+				break;
+			
+			case matching_backend::AUCTION:
+			{
+				weight_matrix_type weights;
+				calculate_edge_weights(table, 1, weights);
+				m_matching_weight = find_maximum_weight_matching_auction(weights);
+				break;
+			}
+			
+			case matching_backend::GREEDY:
+				m_matching_weight = find_maximum_weight_matching_greedy(table);
+				break;
+			
+			default:
+				libbio_fail("Unexpected matching backend.");
+		}
+		
+		m_duration = std::chrono::steady_clock::now() - start_time;
 		
 		m_delegate->task_did_finish(*this);
 	}
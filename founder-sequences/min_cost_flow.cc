@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <founder_sequences/min_cost_flow.hh>
+#include <functional>
+#include <limits>
+#include <queue>
+
+
+namespace founder_sequences {
+
+	std::size_t min_cost_flow::add_edge(std::uint32_t const source, std::uint32_t const target, capacity_type const capacity, cost_type const cost)
+	{
+		assert(0 <= cost);
+		auto const retval(m_edges.size());
+		m_edges.emplace_back(target, capacity, cost);
+		m_edges.emplace_back(source, 0, -cost);
+		m_adjacency[source].push_back(retval);
+		m_adjacency[target].push_back(1 + retval);
+		return retval;
+	}
+	
+	
+	bool min_cost_flow::find_shortest_path(std::uint32_t const source, std::uint32_t const sink)
+	{
+		typedef std::pair <cost_type, std::uint32_t> queue_item;
+		std::priority_queue <queue_item, std::vector <queue_item>, std::greater <queue_item>> queue;
+		
+		auto const node_count(m_adjacency.size());
+		m_distances.assign(node_count, std::numeric_limits <cost_type>::max());
+		m_previous_edges.assign(node_count, UINT32_MAX);
+		m_distances[source] = 0;
+		queue.emplace(0, source);
+		while (!queue.empty())
+		{
+			auto const [distance, node] = queue.top();
+			queue.pop();
+			if (m_distances[node] < distance)
+				continue;
+			
+			for (auto const edge_idx : m_adjacency[node])
+			{
+				auto const &edge(m_edges[edge_idx]);
+				if (0 == edge.capacity)
+					continue;
+				
+				// The reduced costs are non-negative.
+				auto const next_distance(distance + edge.cost + m_potentials[node] - m_potentials[edge.target]);
+				assert(distance <= next_distance);
+				if (next_distance < m_distances[edge.target])
+				{
+					m_distances[edge.target] = next_distance;
+					m_previous_edges[edge.target] = edge_idx;
+					queue.emplace(next_distance, edge.target);
+				}
+			}
+		}
+		
+		if (std::numeric_limits <cost_type>::max() == m_distances[sink])
+			return false;
+		
+		// Update the potentials s.t. the reduced costs of the residual edges remain non-negative
+		// also for the nodes not reached or reached further than the sink.
+		auto const sink_distance(m_distances[sink]);
+		for (std::size_t i(0); i < node_count; ++i)
+			m_potentials[i] += std::min(m_distances[i], sink_distance);
+		
+		return true;
+	}
+	
+	
+	auto min_cost_flow::solve(std::uint32_t const source, std::uint32_t const sink, capacity_type const amount) -> std::pair <capacity_type, cost_type>
+	{
+		m_potentials.assign(m_adjacency.size(), 0);
+		
+		capacity_type total_flow(0);
+		cost_type total_cost(0);
+		while (total_flow < amount && find_shortest_path(source, sink))
+		{
+			// Find the bottleneck.
+			capacity_type flow(amount - total_flow);
+			for (auto node(sink); node != source;)
+			{
+				auto const edge_idx(m_previous_edges[node]);
+				flow = std::min(flow, m_edges[edge_idx].capacity);
+				node = m_edges[edge_idx ^ 1].target;
+			}
+			
+			// Augment.
+			for (auto node(sink); node != source;)
+			{
+				auto const edge_idx(m_previous_edges[node]);
+				m_edges[edge_idx].capacity -= flow;
+				m_edges[edge_idx ^ 1].capacity += flow;
+				total_cost += flow * m_edges[edge_idx].cost;
+				node = m_edges[edge_idx ^ 1].target;
+			}
+			
+			total_flow += flow;
+		}
+		
+		return {total_flow, total_cost};
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <founder_sequences/pbwt_sample_channel.hh>
+
+
+namespace founder_sequences {
+
+	void pbwt_sample_channel::push(segmentation_dp_arg const &dp_arg, pbwt_sample_type &&sample)
+	{
+		{
+			std::unique_lock <std::mutex> lock(m_mutex);
+			assert(!m_is_closed);
+			m_cv.wait(lock, [this](){ return m_items.size() < m_capacity; });
+			m_items.emplace_back(dp_arg, std::move(sample));
+		}
+		m_cv.notify_all();
+	}
+	
+	
+	void pbwt_sample_channel::close()
+	{
+		{
+			std::lock_guard <std::mutex> lock(m_mutex);
+			m_is_closed = true;
+		}
+		m_cv.notify_all();
+	}
+	
+	
+	bool pbwt_sample_channel::pop(segmentation_dp_arg &dp_arg, pbwt_sample_type &sample)
+	{
+		{
+			std::unique_lock <std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this](){ return m_is_closed || !m_items.empty(); });
+			if (m_items.empty())
+				return false;
+			
+			auto &item(m_items.front());
+			dp_arg = item.first;
+			sample = std::move(item.second);
+			m_items.pop_front();
+		}
+		m_cv.notify_all();
+		return true;
+	}
+}
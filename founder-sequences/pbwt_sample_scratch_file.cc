@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <founder_sequences/pbwt_sample_scratch_file.hh>
+#include <iostream>
+#include <memory>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace {
+
+	// The samples cannot be recovered if the scratch file cannot be used, so stop.
+	[[noreturn]] void fail(char const *message)
+	{
+		std::cerr << "\n" << message << ": " << std::strerror(errno) << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+}
+
+
+namespace founder_sequences {
+
+	pbwt_sample_scratch_file::pbwt_sample_scratch_file(std::string const &directory):
+		m_queue(dispatch_queue_create("fi.iki.tsnorri.sample-scratch-file-queue", DISPATCH_QUEUE_SERIAL), false),
+		m_group(dispatch_group_create(), false)
+	{
+		std::string path(directory + "/founder-sequences-samples-XXXXXX");
+		m_fd = mkstemp(path.data());
+		if (-1 == m_fd)
+			fail("Unable to create a scratch file for the PBWT samples");
+		
+		// Remove the file s.t. it is deleted when closed.
+		unlink(path.c_str());
+	}
+	
+	
+	pbwt_sample_scratch_file::~pbwt_sample_scratch_file()
+	{
+		wait();
+		
+		if (m_mapped_data)
+			munmap(const_cast <std::uint8_t *>(m_mapped_data), m_mapped_size);
+		
+		if (-1 != m_fd)
+			close(m_fd);
+	}
+	
+	
+	std::uint64_t pbwt_sample_scratch_file::append_async(buffer_type &&buffer)
+	{
+		assert(!is_mapped());
+		
+		auto const offset(m_size);
+		auto const length(buffer.size());
+		m_size += length;
+		m_pending_bytes.fetch_add(length, std::memory_order_relaxed);
+		
+		// Use a pointer since blocks copy the captured variables.
+		auto *buffer_ptr(new buffer_type(std::move(buffer)));
+		dispatch_group_async(*m_group, *m_queue, ^{
+			std::unique_ptr <buffer_type> buffer(buffer_ptr);
+			std::size_t written(0);
+			while (written < length)
+			{
+				auto const res(pwrite(m_fd, buffer->data() + written, length - written, offset + written));
+				if (res < 0)
+				{
+					if (EINTR == errno)
+						continue;
+					fail("Unable to write to the PBWT sample scratch file");
+				}
+				written += res;
+			}
+			m_pending_bytes.fetch_sub(length, std::memory_order_relaxed);
+		});
+		
+		return offset;
+	}
+	
+	
+	void pbwt_sample_scratch_file::read(std::uint64_t const offset, std::size_t const length, std::uint8_t *dst) const
+	{
+		if (m_mapped_data)
+		{
+			std::copy_n(m_mapped_data + offset, length, dst);
+			return;
+		}
+		
+		std::size_t bytes_read(0);
+		while (bytes_read < length)
+		{
+			auto const res(pread(m_fd, dst + bytes_read, length - bytes_read, offset + bytes_read));
+			if (res <= 0)
+			{
+				if (res < 0 && EINTR == errno)
+					continue;
+				fail("Unable to read from the PBWT sample scratch file");
+			}
+			bytes_read += res;
+		}
+	}
+	
+	
+	void pbwt_sample_scratch_file::wait()
+	{
+		dispatch_group_wait(*m_group, DISPATCH_TIME_FOREVER);
+	}
+	
+	
+	void pbwt_sample_scratch_file::map()
+	{
+		assert(!is_mapped());
+		wait();
+		
+		if (0 == m_size)
+			return;
+		
+		auto *data(mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0));
+		if (MAP_FAILED == data)
+			fail("Unable to map the PBWT sample scratch file");
+		
+		m_mapped_data = static_cast <std::uint8_t const *>(data);
+		m_mapped_size = m_size;
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <founder_sequences/segment_length_search_context.hh>
+
+namespace lb = libbio;
+
+
+namespace founder_sequences {
+
+	std::uint32_t segment_length_search_context::evaluate_segment_length(std::size_t const step, std::size_t const segment_length)
+	{
+		auto const start_time(std::chrono::steady_clock::now());
+		auto const max_segment_size(m_calculator.calculate_max_segment_size(segment_length, m_probe_traceback_dp));
+		auto const end_time(std::chrono::steady_clock::now());
+		std::chrono::duration <double> const duration(end_time - start_time);
+		
+		m_delegate->context_did_evaluate_segment_length(*this, step, segment_length, max_segment_size, duration);
+		return max_segment_size;
+	}
+	
+	
+	void segment_length_search_context::search()
+	{
+		dispatch_async(*m_queue, ^{
+			// Calculate the PBWT once and store the divergence value counts of each column.
+			m_step_max = m_delegate->sequences().front().size();
+			m_current_step = 0;
+			m_calculator.fill_divergence_value_counts([this](std::size_t const idx){
+				m_current_step.store(1 + idx, std::memory_order_relaxed);
+			});
+			
+			m_delegate->context_will_search_segment_length(*this);
+			
+			// Binary search for the greatest segment length bound that satisfies the condition.
+			auto const seq_length(m_calculator.sequence_length());
+			std::size_t step(0);
+			std::size_t found_segment_length(0);
+			std::uint32_t found_max_segment_size(0);
+			using std::swap;
+			
+			{
+				auto const max_segment_size(evaluate_segment_length(step++, 1));
+				if (max_segment_size <= m_max_founder_count)
+				{
+					found_segment_length = 1;
+					found_max_segment_size = max_segment_size;
+					swap(m_found_traceback_dp, m_probe_traceback_dp);
+				}
+			}
+			
+			if (found_segment_length)
+			{
+				// Invariant: found_segment_length satisfies the condition, limit does not.
+				std::size_t limit(1 + seq_length);
+				while (1 + found_segment_length < limit)
+				{
+					auto const segment_length(found_segment_length + (limit - found_segment_length) / 2);
+					auto const max_segment_size(evaluate_segment_length(step++, segment_length));
+					if (max_segment_size <= m_max_founder_count)
+					{
+						found_segment_length = segment_length;
+						found_max_segment_size = max_segment_size;
+						swap(m_found_traceback_dp, m_probe_traceback_dp);
+					}
+					else
+					{
+						limit = segment_length;
+					}
+				}
+			}
+			
+			// The stored counts and the DP vector of the last unsuccessful step are no longer needed.
+			m_calculator.clear();
+			m_probe_traceback_dp.clear();
+			m_probe_traceback_dp.shrink_to_fit();
+			
+			dispatch_async(dispatch_get_main_queue(), ^{
+				m_delegate->context_did_finish_search(*this, found_segment_length, found_max_segment_size);
+			});
+		});
+	}
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <founder_sequences/segment_size_calculator.hh>
+#include <founder_sequences/segmentation_lp_dp.hh>
+
+
+namespace fseq	= founder_sequences;
+namespace lb	= libbio;
+
+
+namespace {
+	
+	// Run the DP in the same manner as segmentation_lp_context one column at a time,
+	// s.t. the counts may be either the stored ones or those of a recalculated PBWT.
+	class segment_size_dp
+	{
+	protected:
+		fseq::segmentation_traceback_vector		*m_traceback_dp{};
+		fseq::segmentation_traceback_vector_rmq	m_traceback_dp_rmq;
+		std::size_t								m_segment_length{};
+		std::size_t								m_rb{};
+		std::size_t								m_limit{};
+		std::uint32_t							m_sequence_count{};
+		std::uint32_t							m_max_segment_size{};
+		
+	public:
+		// traceback_dp needs to have been resized to rb - segment_length + 1 unless rb < 2 * segment_length.
+		segment_size_dp(
+			fseq::segmentation_traceback_vector &traceback_dp,
+			std::size_t const segment_length,
+			std::size_t const rb,
+			std::uint32_t const sequence_count
+		):
+			m_traceback_dp(&traceback_dp),
+			m_traceback_dp_rmq(traceback_dp),
+			m_segment_length(segment_length),
+			m_rb(rb),
+			m_limit(2 * segment_length <= rb ? std::min(2 * segment_length, rb - segment_length) - 1 : 0),
+			m_sequence_count(sequence_count)
+		{
+		}
+		
+		template <typename t_counts>
+		void handle_column(std::size_t const idx, t_counts const &counts);
+		
+		std::uint32_t max_segment_size() const { return m_max_segment_size; }
+	};
+	
+	
+	template <typename t_counts>
+	void segment_size_dp::handle_column(std::size_t const idx, t_counts const &counts)
+	{
+		std::size_t const lb(0);
+		
+		// Short path, only one segment.
+		if (m_rb - lb < 2 * m_segment_length)
+		{
+			if (1 + idx == m_rb)
+				m_max_segment_size = fseq::calculate_segmentation_lp_initial_segment_size(counts, m_sequence_count, lb);
+			return;
+		}
+		
+		if (idx + 1 < m_segment_length)
+			return;
+		
+		auto &traceback_dp(*m_traceback_dp);
+		auto const tb_idx(idx + 1 - m_segment_length);
+		if (idx < m_limit)
+		{
+			// Columns L to 2L - 1 (1-based).
+			auto const segment_size(fseq::calculate_segmentation_lp_initial_segment_size(counts, m_sequence_count, lb));
+			traceback_dp[tb_idx] = fseq::segmentation_dp_arg(lb, 1 + idx, segment_size, segment_size);
+			m_traceback_dp_rmq.update(tb_idx);
+		}
+		else if (idx < m_rb - m_segment_length)
+		{
+			// Columns (L or) 2L to n - L (1-based).
+			fseq::segmentation_dp_arg min_arg(lb, 1 + idx, m_sequence_count, m_sequence_count);
+			fseq::calculate_segmentation_lp_dp_arg(
+				counts,
+				traceback_dp,
+				m_traceback_dp_rmq,
+				m_sequence_count,
+				m_segment_length,
+				lb,
+				idx,
+				min_arg
+			);
+			
+			traceback_dp[tb_idx] = min_arg;
+			m_traceback_dp_rmq.update(tb_idx);
+		}
+		else if (1 + idx == m_rb)
+		{
+			// The final segment, stored in the last position as in segmentation_lp_context.
+			fseq::segmentation_dp_arg min_arg(lb, m_rb, m_sequence_count, m_sequence_count);
+			fseq::calculate_segmentation_lp_dp_arg(
+				counts,
+				traceback_dp,
+				m_traceback_dp_rmq,
+				m_sequence_count,
+				m_segment_length,
+				lb,
+				idx,
+				min_arg
+			);
+			
+			assert(tb_idx == traceback_dp.size() - 1);
+			traceback_dp[tb_idx] = min_arg;
+			m_max_segment_size = min_arg.segment_max_size;
+		}
+	}
+}
+
+
+namespace founder_sequences {
+
+	std::uint32_t segment_size_calculator::calculate_max_segment_size(std::size_t const segment_length) const
+	{
+		segmentation_traceback_vector traceback_dp;
+		return calculate_max_segment_size(segment_length, traceback_dp);
+	}
+	
+	
+	std::uint32_t segment_size_calculator::calculate_max_segment_size(std::size_t const segment_length, segmentation_traceback_vector &traceback_dp) const
+	{
+		assert(segment_length);
+		
+		std::size_t const rb(m_sequence_length);
+		traceback_dp.clear();
+		if (2 * segment_length <= rb)
+			traceback_dp.resize(rb - segment_length + 1);
+		
+		segment_size_dp dp(traceback_dp, segment_length, rb, m_sequence_count);
+		if (m_uses_cache)
+		{
+			assert(m_divergence_value_counts.size() == rb);
+			for (std::size_t idx(0); idx < rb; ++idx)
+				dp.handle_column(idx, m_divergence_value_counts[idx]);
+		}
+		else
+		{
+			// The counts did not fit into memory and no scratch directory was given; recalculate the PBWT without sampling.
+			pbwt_context pbwt_ctx(*m_sequences, *m_alphabet, lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS);
+			pbwt_ctx.set_sample_rate(std::numeric_limits <std::uint64_t>::max());
+			pbwt_ctx.prepare();
+			pbwt_ctx.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(
+				rb,
+				[&pbwt_ctx, &dp](){
+					dp.handle_column(pbwt_ctx.sequence_idx(), pbwt_ctx.output_divergence_value_counts());
+				}
+			);
+		}
+		
+		return dp.max_segment_size();
+	}
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <founder_sequences/segment_size_estimation_context.hh>
+#include <numeric>
+#include <random>
+
+namespace lb = libbio;
+
+
+namespace founder_sequences {
+
+	void segment_size_estimation_context::prepare_replicates()
+	{
+		auto const &sequences(m_delegate->sequences());
+		auto const seq_count(sequences.size());
+		auto const seq_length(sequences.front().size());
+		
+		auto const row_count((0 == m_parameters.row_count || seq_count < m_parameters.row_count) ? seq_count : m_parameters.row_count);
+		auto const window_length((0 == m_parameters.window_length || seq_length < m_parameters.window_length) ? seq_length : m_parameters.window_length);
+		auto const replicate_count(m_parameters.replicates);
+		assert(replicate_count);
+		
+		// Segment length bounds to be tested. Bounds greater than the window length are not meaningful.
+		m_segment_lengths.clear();
+		for (std::size_t segment_length(m_parameters.first_segment_length); segment_length <= m_parameters.last_segment_length; segment_length += m_parameters.segment_length_step)
+		{
+			if (window_length < segment_length)
+				break;
+			m_segment_lengths.push_back(segment_length);
+		}
+		
+		// Place the windows at regular intervals.
+		auto const stride(1 < replicate_count ? (seq_length - window_length) / (replicate_count - 1) : 0);
+		
+		std::vector <std::size_t> row_indices(seq_count);
+		std::vector <std::size_t> selected_rows(row_count);
+		std::iota(row_indices.begin(), row_indices.end(), 0);
+		
+		m_replicates.clear();
+		m_replicates.resize(replicate_count);
+		std::size_t i(0);
+		for (auto &rep : m_replicates)
+		{
+			// Use a separate random number generator for each replicate s.t. the subsamples do not depend on the replicate count.
+			std::mt19937 urbg(m_parameters.random_seed + i);
+			std::sample(row_indices.cbegin(), row_indices.cend(), selected_rows.begin(), row_count, urbg); // Preserves the order.
+			
+			auto const window_lb(i * stride);
+			rep.sequences.clear();
+			rep.sequences.reserve(row_count);
+			for (auto const row_idx : selected_rows)
+				rep.sequences.emplace_back(sequences[row_idx].subspan(window_lb, window_length));
+			
+			++i;
+		}
+		
+		m_current_step = 0;
+		m_step_max = replicate_count * window_length;
+	}
+	
+	
+	void segment_size_estimation_context::process_replicate(replicate &rep)
+	{
+		segment_size_calculator calculator(rep.sequences, m_delegate->alphabet());
+		calculator.fill_divergence_value_counts([this](std::size_t const idx){
+			m_current_step.fetch_add(1, std::memory_order_relaxed);
+		});
+		
+		rep.max_segment_sizes.clear();
+		rep.max_segment_sizes.reserve(m_segment_lengths.size());
+		for (auto const segment_length : m_segment_lengths)
+			rep.max_segment_sizes.push_back(calculator.calculate_max_segment_size(segment_length));
+		
+		// The subsample is no longer needed.
+		rep.sequences.clear();
+		rep.sequences.shrink_to_fit();
+	}
+	
+	
+	void segment_size_estimation_context::calculate_estimates()
+	{
+		auto const replicate_count(m_replicates.size());
+		
+		m_estimates.clear();
+		m_estimates.resize(m_segment_lengths.size());
+		for (std::size_t i(0); i < m_segment_lengths.size(); ++i)
+		{
+			auto &estimate(m_estimates[i]);
+			estimate.segment_length = m_segment_lengths[i];
+			estimate.min = UINT32_MAX;
+			estimate.max = 0;
+			
+			double sum(0);
+			for (auto const &rep : m_replicates)
+			{
+				auto const size(rep.max_segment_sizes[i]);
+				sum += size;
+				estimate.min = std::min(estimate.min, size);
+				estimate.max = std::max(estimate.max, size);
+			}
+			estimate.mean = sum / replicate_count;
+			
+			if (1 < replicate_count)
+			{
+				double sum_of_squares(0);
+				for (auto const &rep : m_replicates)
+				{
+					double const diff(rep.max_segment_sizes[i] - estimate.mean);
+					sum_of_squares += diff * diff;
+				}
+				estimate.standard_deviation = std::sqrt(sum_of_squares / (replicate_count - 1));
+				estimate.standard_error = estimate.standard_deviation / std::sqrt(replicate_count);
+			}
+		}
+	}
+	
+	
+	void segment_size_estimation_context::estimate()
+	{
+		dispatch_async(*m_queue, ^{
+			prepare_replicates();
+			
+			lb::dispatch_ptr <dispatch_group_t> group(dispatch_group_create());
+			for (auto &rep : m_replicates)
+			{
+				auto *rep_ptr(&rep);
+				dispatch_group_async(*group, *m_queue, ^{
+					process_replicate(*rep_ptr);
+				});
+			}
+			
+			dispatch_group_notify(*group, *m_queue, ^{
+				calculate_estimates();
+				dispatch_async(dispatch_get_main_queue(), ^{
+					m_delegate->context_did_finish_estimation(*this);
+				});
+			});
+		});
+	}
+	
+	
+	void segment_size_estimation_context::output_estimates(std::ostream &os) const
+	{
+		os << "SEGMENT_LENGTH_BOUND" "\t" "MEAN" "\t" "SD" "\t" "SE" "\t" "MIN" "\t" "MAX" "\n";
+		for (auto const &estimate : m_estimates)
+		{
+			os
+			<< estimate.segment_length << '\t'
+			<< estimate.mean << '\t'
+			<< estimate.standard_deviation << '\t'
+			<< estimate.standard_error << '\t'
+			<< estimate.min << '\t'
+			<< estimate.max << '\n';
+		}
+		os << std::flush;
+	}
+}
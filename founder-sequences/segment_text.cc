@@ -3,55 +3,72 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
-#include <experimental/iterator>
 #include <founder_sequences/segment_text.hh>
 #include <libbio/cxxcompat.hh>
+#include <numeric>
 
 
 namespace founder_sequences {
+
+	void segment_text_vector::clear()
+	{
+		m_sequence_indices.clear();
+		m_offsets.clear();
+		m_offsets.push_back(0);
+		m_copied_from.clear();
+	}
 	
-	void segment_text::write_text(
-		std::ostream &os,
-		segment_text_vector const &slice,
-		std::size_t const pos,
-		std::size_t const length,
-		sequence_vector const &sequences
-	) const
+	
+	void segment_text_vector::reserve(std::size_t const distinct_count, std::size_t const seq_count, std::size_t const size)
+	{
+		m_sequence_indices.reserve(seq_count);
+		m_offsets.reserve(1 + distinct_count);
+		if (distinct_count < size)
+			m_copied_from.reserve(size - distinct_count);
+	}
+	
+	
+	auto segment_text_vector::add_text(std::size_t const seq_count) -> std::span <sequence_index>
+	{
+		assert(m_copied_from.empty());
+		auto const start(m_sequence_indices.size());
+		m_sequence_indices.resize(start + seq_count);
+		m_offsets.push_back(m_sequence_indices.size());
+		return std::span <sequence_index>(m_sequence_indices.data() + start, seq_count);
+	}
+	
+	
+	void segment_text_vector::add_copies(std::size_t const row, std::size_t const count)
+	{
+		assert(row < distinct_size());
+		m_copied_from.insert(m_copied_from.end(), count, row);
+	}
+	
+	
+	void segment_text_vector::retain_first_sequence_indices()
 	{
-		if (is_copied())
-			slice[copied_from].write_text(os, slice, pos, length, sequences);
-		else
-		{
-			auto const seq_idx(first_sequence_index());
-			auto const &seq(sequences[seq_idx]);
-			auto const subspan(seq.subspan(pos, length));
-			os.write(reinterpret_cast <char const *>(subspan.data()), subspan.size());
-		}
+		auto const count(distinct_size());
+		std::vector <sequence_index> first_indices(count);
+		for (std::size_t i(0); i < count; ++i)
+			first_indices[i] = first_sequence_index(i);
+		
+		// Replace instead of resizing to release the memory.
+		m_sequence_indices = std::move(first_indices);
+		std::iota(m_offsets.begin(), m_offsets.end(), 0);
 	}
 	
 	
-	// For statistics.
-	void segment_text::write(
+	void segment_text_vector::write_text(
 		std::ostream &os,
-		segment_text_vector const &slice,
+		std::size_t const row,
 		std::size_t const pos,
 		std::size_t const length,
 		sequence_vector const &sequences
 	) const
 	{
-		write_text(os, slice, pos, length, sequences);
-		os << '\t';
-		
-		std::copy(
-			sequence_indices.cbegin(),
-			sequence_indices.cend(),
-			std::experimental::make_ostream_joiner(os, ", ")
-		);
-		os << '\t';
-		
-		if (is_copied())
-			os << copied_from;
-		else
-			os << '-';
+		auto const seq_idx(first_sequence_index(row_number(row)));
+		auto const &seq(sequences[seq_idx]);
+		auto const subspan(seq.subspan(pos, length));
+		os.write(reinterpret_cast <char const *>(subspan.data()), subspan.size());
 	}
 }
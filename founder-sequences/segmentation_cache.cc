@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+#include <cstdio>
+#include <cstring>
+#include <founder_sequences/segmentation_cache.hh>
+#include <fstream>
+#include <iomanip>
+#include <libbio/sdsl_boost_serialization.hh>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lb = libbio;
+
+
+namespace {
+
+	char const *s_cache_magic("founder-sequences-cache-3");
+	
+	std::uint64_t const s_k1(0x9e3779b97f4a7c15ULL);
+	std::uint64_t const s_k2(0xc2b2ae3d27d4eb4fULL);
+	
+	
+	inline std::uint64_t rotl(std::uint64_t const val, unsigned int const shift)
+	{
+		return (val << shift) | (val >> (64 - shift));
+	}
+	
+	
+	// Finalizer from MurmurHash3.
+	inline std::uint64_t mix(std::uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+	
+	
+	inline std::uint64_t combine(std::uint64_t const h, std::uint64_t const val)
+	{
+		return rotl(h ^ (val * s_k2), 31) * s_k1;
+	}
+}
+
+
+namespace founder_sequences {
+
+	std::uint64_t hash_bytes(std::uint8_t const *data, std::size_t const length, std::uint64_t const seed)
+	{
+		std::uint64_t h(seed ^ (length * s_k1));
+		
+		// Process the input eight bytes at a time.
+		std::size_t i(0);
+		for (; i + 8 <= length; i += 8)
+		{
+			std::uint64_t word{};
+			std::memcpy(&word, data + i, 8);
+			h = combine(h, word);
+		}
+		
+		// Handle the tail.
+		if (i < length)
+		{
+			std::uint64_t word{};
+			std::memcpy(&word, data + i, length - i);
+			h = combine(h, word);
+		}
+		
+		return mix(h);
+	}
+	
+	
+	std::uint64_t hash_sequences(sequence_vector const &sequences)
+	{
+		return hash_sequence_prefixes(sequences, SIZE_MAX);
+	}
+	
+	
+	std::uint64_t hash_sequence_prefixes(sequence_vector const &sequences, std::size_t const length)
+	{
+		std::vector <std::uint64_t> hashes(sequences.size());
+		lb::parallel_for_each(
+			ranges::view::zip(sequences, hashes),
+			[length](auto const &tup, std::size_t const){
+				auto const &seq(std::get <0>(tup));
+				auto &hash(std::get <1>(tup));
+				hash = hash_bytes(seq.data(), std::min(length, seq.size()), 0);
+			}
+		);
+		
+		std::uint64_t retval(sequences.size());
+		for (auto const hash : hashes)
+			retval = combine(retval, hash);
+		return mix(retval);
+	}
+	
+	
+	std::uint64_t hash_alphabet(alphabet_type const &alphabet)
+	{
+		std::ostringstream os;
+		{
+			boost::archive::binary_oarchive archive(os, boost::archive::no_header);
+			archive << alphabet;
+		}
+		
+		auto const str(os.str());
+		return hash_bytes(reinterpret_cast <std::uint8_t const *>(str.data()), str.size(), 0);
+	}
+	
+	
+	bool segmentation_cache_key::operator==(segmentation_cache_key const &other) const
+	{
+		return (
+			input_hash == other.input_hash &&
+			alphabet_hash == other.alphabet_hash &&
+			sequence_count == other.sequence_count &&
+			sequence_length == other.sequence_length &&
+			segment_length == other.segment_length &&
+			max_founder_count == other.max_founder_count
+		);
+	}
+	
+	
+	std::string segmentation_cache_key::file_name() const
+	{
+		std::uint64_t h(input_hash);
+		for (auto const val : {alphabet_hash, sequence_count, sequence_length, segment_length, max_founder_count})
+			h = combine(h, val);
+		
+		std::ostringstream os;
+		os << std::hex << std::setw(16) << std::setfill('0') << mix(h) << ".segmentation";
+		return os.str();
+	}
+	
+	
+	bool segmentation_cache::load(
+		segmentation_cache_key const &key,
+		segmentation_cache_metadata &metadata,
+		segmentation_container &container
+	) const
+	{
+		std::ifstream is(path(key), std::ios_base::in | std::ios_base::binary);
+		if (!is.is_open())
+			return false;
+		
+		try
+		{
+			boost::archive::binary_iarchive archive(is);
+			std::string magic;
+			segmentation_cache_key stored_key;
+			archive >> magic;
+			if (magic != s_cache_magic)
+				return false;
+			
+			// Check for collisions.
+			archive >> stored_key;
+			if (stored_key != key)
+				return false;
+			
+			archive >> metadata;
+			archive >> container;
+			return true;
+		}
+		catch (boost::archive::archive_exception const &exc)
+		{
+			return false;
+		}
+	}
+	
+	
+	bool segmentation_cache::store(
+		segmentation_cache_key const &key,
+		segmentation_cache_metadata const &metadata,
+		segmentation_container const &container
+	) const
+	{
+		mkdir(m_directory.c_str(), 0777); // May exist already.
+		
+		// Write to a temporary file first s.t. concurrent runs do not see partial entries.
+		auto const dst_path(path(key));
+		auto const tmp_path(dst_path + ".tmp." + std::to_string(getpid()));
+		{
+			std::ofstream os(tmp_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+			if (!os.is_open())
+				return false;
+			
+			std::string const magic(s_cache_magic);
+			boost::archive::binary_oarchive archive(os);
+			archive << magic;
+			archive << key;
+			archive << metadata;
+			archive << container;
+			
+			os.flush();
+			if (!os.good())
+			{
+				std::remove(tmp_path.c_str());
+				return false;
+			}
+		}
+		
+		if (0 != std::rename(tmp_path.c_str(), dst_path.c_str()))
+		{
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+		
+		return true;
+	}
+}
@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/array.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+#include <cstdio>
+#include <founder_sequences/segmentation_cache.hh>
+#include <founder_sequences/segmentation_checkpoint.hh>
+#include <fstream>
+#include <libbio/sdsl_boost_serialization.hh>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lb = libbio;
+
+
+namespace {
+
+	char const *s_checkpoint_magic("founder-sequences-checkpoint-6");
+	
+	
+	std::string samples_path(std::string const &directory, std::uint8_t const file_index) { return directory + "/samples." + std::to_string(file_index); }
+	std::string state_path(std::string const &directory) { return directory + "/state"; }
+	std::string previous_state_path(std::string const &directory) { return directory + "/state.prev"; }
+	std::string temporary_state_path(std::string const &directory) { return directory + "/state.tmp"; }
+	
+	
+	bool load_state(
+		std::string const &path,
+		founder_sequences::segmentation_checkpoint_header const &expected_header,
+		founder_sequences::sequence_vector const &sequences,
+		founder_sequences::segmentation_checkpoint &checkpoint,
+		std::size_t &sample_count,
+		std::uint8_t &samples_file_index,
+		std::uint64_t &samples_file_size
+	)
+	{
+		std::ifstream is(path, std::ios_base::in | std::ios_base::binary);
+		if (!is.is_open())
+			return false;
+		
+		try
+		{
+			boost::archive::binary_iarchive archive(is);
+			std::string magic;
+			archive >> magic;
+			if (magic != s_checkpoint_magic)
+				return false;
+			
+			// Check that the checkpoint was made with the same input and parameters or that
+			// the current input has been extended with new columns.
+			archive >> checkpoint.header;
+			archive >> checkpoint.next_column;
+			if (! (checkpoint.header == expected_header || (checkpoint.is_final() && checkpoint.header.can_be_extended_to(expected_header))))
+				return false;
+			
+			// Check that the columns processed so far have not changed.
+			archive >> checkpoint.prefix_hash;
+			if (checkpoint.prefix_hash != founder_sequences::hash_sequence_prefixes(sequences, checkpoint.next_column))
+				return false;
+			
+			std::uint64_t dp_size{};
+			archive >> checkpoint.sample_rate;
+			archive >> sample_count;
+			archive >> samples_file_index;
+			archive >> samples_file_size;
+			archive >> checkpoint.pbwt_state;
+			archive >> dp_size;
+			checkpoint.traceback_dp.resize(dp_size);
+			archive >> boost::serialization::make_array(checkpoint.traceback_dp.data(), dp_size);
+			
+			// Check that the whole file was written.
+			archive >> magic;
+			return (magic == s_checkpoint_magic);
+		}
+		catch (boost::archive::archive_exception const &exc)
+		{
+			return false;
+		}
+	}
+	
+	
+	bool load_samples(
+		std::string const &path,
+		std::size_t const sample_count,
+		std::uint64_t const samples_file_size,
+		std::vector <founder_sequences::compressed_pbwt_sample> &samples
+	)
+	{
+		samples.clear();
+		if (0 == sample_count)
+			return true;
+		
+		std::ifstream is(path, std::ios_base::in | std::ios_base::binary);
+		if (!is.is_open())
+			return false;
+		
+		try
+		{
+			// Read the chunks written by segmentation_checkpoint_writer::write() up to the recorded size.
+			while (static_cast <std::uint64_t>(is.tellg()) < samples_file_size)
+			{
+				std::vector <founder_sequences::compressed_pbwt_sample> chunk;
+				boost::archive::binary_iarchive archive(is, boost::archive::no_header);
+				archive >> chunk;
+				std::move(chunk.begin(), chunk.end(), std::back_inserter(samples));
+			}
+		}
+		catch (boost::archive::archive_exception const &exc)
+		{
+			return false;
+		}
+		
+		return (samples.size() == sample_count);
+	}
+}
+
+
+namespace founder_sequences {
+
+	bool segmentation_checkpoint_header::operator==(segmentation_checkpoint_header const &other) const
+	{
+		return (
+			sequence_count == other.sequence_count &&
+			sequence_length == other.sequence_length &&
+			segment_length == other.segment_length &&
+			pbwt_sample_rate == other.pbwt_sample_rate &&
+			lb == other.lb &&
+			rb == other.rb
+		);
+	}
+	
+	
+	bool segmentation_checkpoint_header::can_be_extended_to(segmentation_checkpoint_header const &other) const
+	{
+		return (
+			sequence_count == other.sequence_count &&
+			sequence_length <= other.sequence_length &&
+			segment_length == other.segment_length &&
+			lb == other.lb &&
+			rb <= other.rb
+		);
+	}
+	
+	
+	segmentation_checkpoint_writer::segmentation_checkpoint_writer(
+		std::string const &directory,
+		std::chrono::seconds const interval,
+		sequence_vector const &sequences
+	):
+		m_directory(directory),
+		m_sequences(&sequences),
+		m_queue(dispatch_queue_create("fi.iki.tsnorri.checkpoint-queue", DISPATCH_QUEUE_SERIAL), false),
+		m_group(dispatch_group_create(), false),
+		m_interval(interval),
+		m_previous_write_time(clock_type::now())
+	{
+	}
+	
+	
+	void segmentation_checkpoint_writer::reset()
+	{
+		mkdir(m_directory.c_str(), 0777); // May exist already.
+		std::remove(state_path(m_directory).c_str());
+		std::remove(previous_state_path(m_directory).c_str());
+		std::remove(temporary_state_path(m_directory).c_str());
+		std::remove(samples_path(m_directory, 0).c_str());
+		std::remove(samples_path(m_directory, 1).c_str());
+		m_written_sample_count = 0;
+		m_written_column = 0;
+		m_samples_file_size = 0;
+		m_samples_file_index = 0;
+		m_should_rewrite_samples = false;
+	}
+	
+	
+	void segmentation_checkpoint_writer::set_resumed_state(
+		std::size_t const written_sample_count,
+		std::size_t const written_column,
+		std::uint8_t const samples_file_index,
+		std::uint64_t const samples_file_size
+	)
+	{
+		m_written_sample_count = written_sample_count;
+		m_written_column = written_column;
+		m_samples_file_index = samples_file_index;
+		m_samples_file_size = samples_file_size;
+		
+		// Remove the samples written after the loaded state.
+		auto const path(samples_path(m_directory, samples_file_index));
+		if (0 != truncate(path.c_str(), samples_file_size))
+			std::remove(path.c_str());
+	}
+	
+	
+	void segmentation_checkpoint_writer::samples_did_change()
+	{
+		m_written_sample_count = 0;
+		m_should_rewrite_samples = true;
+	}
+	
+	
+	bool segmentation_checkpoint_writer::should_write() const
+	{
+		if (m_is_writing.load(std::memory_order_acquire))
+			return false;
+		
+		return (m_interval <= clock_type::now() - m_previous_write_time);
+	}
+	
+	
+	void segmentation_checkpoint_writer::write_async(
+		std::unique_ptr <segmentation_checkpoint> &&checkpoint,
+		segmentation_traceback_vector const &traceback_dp,
+		pbwt_sample_scratch_file *scratch_file
+	)
+	{
+		m_is_writing.store(true, std::memory_order_release);
+		m_previous_write_time = clock_type::now();
+		m_written_sample_count += checkpoint->pbwt_samples.size();
+		m_written_column = checkpoint->next_column;
+		
+		auto *checkpoint_ptr(checkpoint.release());
+		auto const *traceback_dp_ptr(&traceback_dp);
+		auto const sample_count(m_written_sample_count);
+		auto const should_rewrite_samples(m_should_rewrite_samples);
+		m_should_rewrite_samples = false;
+		dispatch_group_async(*m_group, *m_queue, ^{
+			std::unique_ptr <segmentation_checkpoint> checkpoint(checkpoint_ptr);
+			write(*checkpoint, *traceback_dp_ptr, scratch_file, sample_count, should_rewrite_samples);
+			m_is_writing.store(false, std::memory_order_release);
+		});
+	}
+	
+	
+	void segmentation_checkpoint_writer::wait()
+	{
+		dispatch_group_wait(*m_group, DISPATCH_TIME_FOREVER);
+	}
+	
+	
+	void segmentation_checkpoint_writer::write(
+		segmentation_checkpoint &checkpoint,
+		segmentation_traceback_vector const &traceback_dp,
+		pbwt_sample_scratch_file *scratch_file,
+		std::size_t const sample_count,
+		bool const should_rewrite_samples
+	)
+	{
+		if (did_fail())
+			return;
+		
+		try
+		{
+			// Read the spilled samples back after they have been written to the scratch file.
+			if (scratch_file)
+			{
+				scratch_file->wait();
+				for (auto &sample : checkpoint.pbwt_samples)
+				{
+					if (sample.is_spilled())
+						sample.unspill();
+				}
+			}
+			
+			// Append the new samples or, if the samples were thinned, write all of them to the other samples file.
+			// In the latter case, the current state file still refers to the previous samples file until it has been replaced.
+			std::uint8_t const samples_file_index(should_rewrite_samples ? 1 - m_samples_file_index : m_samples_file_index);
+			auto samples_file_size(m_samples_file_size);
+			if (checkpoint.pbwt_samples.size() || should_rewrite_samples)
+			{
+				auto const mode(should_rewrite_samples ? std::ios_base::trunc : std::ios_base::app);
+				std::ofstream os(samples_path(m_directory, samples_file_index), std::ios_base::out | std::ios_base::binary | mode);
+				if (!os.is_open())
+					throw std::runtime_error("Unable to open the samples file for writing");
+				
+				{
+					boost::archive::binary_oarchive archive(os, boost::archive::no_header);
+					archive << checkpoint.pbwt_samples;
+				}
+				
+				os.flush();
+				if (!os.good())
+					throw std::runtime_error("Unable to write to the samples file");
+				samples_file_size = os.tellp();
+			}
+			
+			// Write the state to a temporary file and replace the current one.
+			auto const tmp_path(temporary_state_path(m_directory));
+			{
+				std::ofstream os(tmp_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+				if (!os.is_open())
+					throw std::runtime_error("Unable to open the state file for writing");
+				
+				// The DP values before the next column are not modified any more, so they may be read here.
+				// Hash the processed columns here instead of the producer queue.
+				std::uint64_t const dp_size(checkpoint.next_column + 1 - checkpoint.header.segment_length);
+				std::uint64_t const prefix_hash(hash_sequence_prefixes(*m_sequences, checkpoint.next_column));
+				std::string const magic(s_checkpoint_magic);
+				
+				boost::archive::binary_oarchive archive(os);
+				archive << magic;
+				archive << checkpoint.header;
+				archive << checkpoint.next_column;
+				archive << prefix_hash;
+				archive << checkpoint.sample_rate;
+				archive << sample_count;
+				archive << samples_file_index;
+				archive << samples_file_size;
+				archive << checkpoint.pbwt_state;
+				archive << dp_size;
+				archive << boost::serialization::make_array(traceback_dp.data(), dp_size);
+				archive << magic;
+				
+				os.flush();
+				if (!os.good())
+					throw std::runtime_error("Unable to write to the state file");
+			}
+			
+			auto const path(state_path(m_directory));
+			std::rename(path.c_str(), previous_state_path(m_directory).c_str());
+			if (0 != std::rename(tmp_path.c_str(), path.c_str()))
+				throw std::runtime_error("Unable to rename the state file");
+			
+			// Only the previous state file refers to the previous samples file, so the latter may be removed now.
+			if (samples_file_index != m_samples_file_index)
+				std::remove(samples_path(m_directory, m_samples_file_index).c_str());
+			
+			m_samples_file_index = samples_file_index;
+			m_samples_file_size = samples_file_size;
+		}
+		catch (std::exception const &exc)
+		{
+			// Do not stop the calculation because of the checkpoint.
+			m_did_fail.store(true, std::memory_order_relaxed);
+			std::cerr << "\nUnable to write the checkpoint to '" << m_directory << "': " << exc.what() << "; checkpointing disabled." << std::endl;
+		}
+	}
+	
+	
+	bool load_segmentation_checkpoint(
+		std::string const &directory,
+		segmentation_checkpoint_header const &expected_header,
+		sequence_vector const &sequences,
+		segmentation_checkpoint &checkpoint,
+		std::uint8_t &samples_file_index,
+		std::uint64_t &samples_file_size
+	)
+	{
+		for (auto const &path : {state_path(directory), previous_state_path(directory)})
+		{
+			std::size_t sample_count{};
+			if (!load_state(path, expected_header, sequences, checkpoint, sample_count, samples_file_index, samples_file_size))
+				continue;
+			
+			if (!load_samples(samples_path(directory, samples_file_index), sample_count, samples_file_size, checkpoint.pbwt_samples))
+				continue;
+			
+			return true;
+		}
+		
+		return false;
+	}
+}
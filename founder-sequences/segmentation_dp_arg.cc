@@ -81,28 +81,29 @@ namespace founder_sequences {
 			auto const lb(traceback_arg.lb);
 			auto const rb(traceback_arg.rb);
 			
-			for (auto const &seg_text : segment_texts)
+			for (std::size_t row(0), count(segment_texts.size()); row < count; ++row)
 			{
 				stream << segment_idx << '\t' << lb << '\t' << rb << '\t' << traceback_arg.segment_size << '\t';
 				
-				seg_text.write_text(
+				segment_texts.write_text(
 					stream,
-					segment_texts,
+					row,
 					lb,
 					rb - lb,
 					sequences
 				);
 				stream << '\t';
 				
+				auto const sequence_indices(segment_texts.sequence_indices(row));
 				std::copy(
-					seg_text.sequence_indices.cbegin(),
-					seg_text.sequence_indices.cend(),
+					sequence_indices.begin(),
+					sequence_indices.end(),
 					std::experimental::make_ostream_joiner(stream, ",")
 				);
 			
 				stream
 				<< '\t'
-				<< (seg_text.is_copied() ? std::to_string(seg_text.copied_from) : "-")
+				<< (segment_texts.is_copied(row) ? std::to_string(segment_texts.copied_from(row)) : "-")
 				<< '\n';
 			}
 			++segment_idx;
@@ -3,25 +3,28 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <algorithm>
+#include <array>
+#include <founder_sequences/divergence_kernels.hh>
 #include <founder_sequences/segmentation_lp_context.hh>
+#include <founder_sequences/segmentation_lp_dp.hh>
 #include <libbio/algorithm.hh>
+#include <thread>
 
 namespace lb = libbio;
 
 
-namespace founder_sequences {
+namespace {
 	
-	void calculate_segmentation_lp_dp_arg(
-		typename pbwt_context::divergence_count_list const &divergence_value_counts,
-		segmentation_traceback_vector const &segmentation_traceback_dp,
-		segmentation_traceback_vector_rmq const &segmentation_traceback_dp_rmq,
-		std::size_t const seq_count,
-		std::size_t const segment_length,
-		std::size_t const lb,	// Inclusive.
-		std::size_t const text_pos,
-		segmentation_dp_arg &min_arg
-	);
+	// Maximum number of bytes waiting to be written to the scratch file before the PBWT calculation is paused.
+	constexpr std::uint64_t s_max_pending_scratch_bytes(64 * 1024 * 1024);
 	
+	// Maximum number of segment sizes calculated in parallel when reducing the number of segments.
+	constexpr std::size_t s_speculation_width(16);
+}
+
+
+namespace founder_sequences {
 	
 	void segmentation_lp_context::generate_traceback(std::size_t const lb, std::size_t const rb)
 	{
@@ -30,14 +33,20 @@ namespace founder_sequences {
 		m_step_max = m_delegate->sequences().front().size();
 		
 		dispatch_async(*m_producer_queue, ^{
-			m_pbwt_ctx.set_sample_rate(m_delegate->pbwt_sample_rate());
+			m_sample_rate = m_delegate->pbwt_sample_rate();
+			m_sample_memory_budget = m_delegate->pbwt_sample_memory_budget();
+			m_pbwt_ctx.set_sample_rate(m_sample_rate);
 			m_pbwt_ctx.prepare();
 			
+			auto const &scratch_directory(m_delegate->pbwt_sample_scratch_directory());
+			if (!scratch_directory.empty())
+				m_sample_scratch_file.reset(new pbwt_sample_scratch_file(scratch_directory));
+			
 			auto const seq_length(m_pbwt_ctx.sequence_length());
 			auto const seq_count(m_pbwt_ctx.size());
 			auto const segment_length(m_delegate->segment_length());
 			auto const dp_size(seq_length - segment_length + 1);
-		
+			
 			{
 				// Values shifted to the left by m_segment_length (L) since the first L columns have the same value anyway.
 				segmentation_traceback_vector temp(dp_size);
@@ -49,11 +58,22 @@ namespace founder_sequences {
 				m_segmentation_traceback_dp_rmq.set_values(m_segmentation_traceback_dp);
 			}
 			
+			if (m_resumed_checkpoint)
+			{
+				resume_from_checkpoint();
+				generate_traceback_part_3(lb, rb);
+				return;
+			}
+			
+			// Remove the files of a previous run if the checkpoint was not loaded.
+			if (m_checkpoint_writer)
+				m_checkpoint_writer->reset();
+			
 			m_pbwt_ctx.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(
 				segment_length - 1,
 				[this](){
 					m_current_step.store(m_pbwt_ctx.sequence_idx() + 1, std::memory_order_relaxed);
-					m_current_pbwt_sample_count.store(m_pbwt_ctx.samples().size(), std::memory_order_relaxed);
+					m_current_pbwt_sample_count.store(sample_count(), std::memory_order_relaxed);
 				}
 			);
 			
@@ -62,6 +82,22 @@ namespace founder_sequences {
 	}
 	
 	
+	void segmentation_lp_context::follow_precalculated_traceback(segmentation_traceback_vector &&traceback_dp)
+	{
+		assert(!traceback_dp.empty());
+		m_step_max = m_delegate->sequences().front().size();
+		m_current_step = m_step_max.load();
+		m_uses_precalculated_traceback = true;
+		
+		using std::swap;
+		swap(m_segmentation_traceback_dp, traceback_dp);
+		
+		dispatch_async(*m_producer_queue, ^{
+			follow_traceback();
+		});
+	}
+	
+	
 	void segmentation_lp_context::generate_traceback_part_2(std::size_t const lb, std::size_t const rb)
 	{
 		// Calculate the columns L to 2L - 1 (1-based), which gives the size of one segment for each column since the minimum
@@ -76,28 +112,19 @@ namespace founder_sequences {
 				[this, lb, seq_count, segment_length](){
 					auto const idx(m_pbwt_ctx.sequence_idx());
 					auto const &counts(m_pbwt_ctx.output_divergence_value_counts());
-					auto const sample_count(m_pbwt_ctx.samples().size());
-					
-					// Calculate the segment size by finding the range of the relevant key
-					// (which is “0” in this case b.c. the column count is less than 2L,
-					// so the range is at most [counts.begin(), counts.begin() + 1))
-					// and subtracting the count from the sequence count.
-					std::size_t segment_size_diff(0);
-					auto const begin(counts.cbegin_pairs());
-					if (counts.cend_pairs() != begin && 0 == begin->first)
-						segment_size_diff = begin->second;
 					
 					auto const tb_idx(idx + 1 - segment_length);
-					auto const segment_size(seq_count - segment_size_diff);
+					auto const segment_size(calculate_segmentation_lp_initial_segment_size(counts, seq_count, lb));
 					segmentation_dp_arg const current_arg(lb, 1 + idx, segment_size, segment_size);
 					m_segmentation_traceback_dp[tb_idx] = current_arg;
 					m_segmentation_traceback_dp_rmq.update(tb_idx);
 					
 					m_current_step.store(1 + idx, std::memory_order_relaxed);
-					m_current_pbwt_sample_count.store(sample_count, std::memory_order_relaxed);
+					m_current_pbwt_sample_count.store(sample_count(), std::memory_order_relaxed);
 				}
 			);
 			
+			store_new_samples();
 			generate_traceback_part_3(lb, rb);
 		});
 	}
@@ -112,40 +139,254 @@ namespace founder_sequences {
 			auto const segment_length(m_delegate->segment_length());
 			auto const limit(rb - segment_length);
 			
-			m_pbwt_ctx.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(
-				limit,
-				[this, lb, seq_count, segment_length](){
-					auto const idx(m_pbwt_ctx.sequence_idx());
-					auto const &counts(m_pbwt_ctx.output_divergence_value_counts());
-					auto const sample_count(m_pbwt_ctx.samples().size());
-					
-					// Use the texts up to this point as the initial value.
-					segmentation_dp_arg min_arg(lb, 1 + idx, seq_count, seq_count);
-					calculate_segmentation_lp_dp_arg(
-						counts,
-						m_segmentation_traceback_dp,
-						m_segmentation_traceback_dp_rmq,
-						seq_count,
-						segment_length,
-						lb,
-						idx,
-						min_arg
-					);
-					
-					auto const tb_idx(idx + 1 - segment_length);
-					m_segmentation_traceback_dp[tb_idx] = min_arg;
-					m_segmentation_traceback_dp_rmq.update(tb_idx);
+			auto const callback([this, lb, seq_count, segment_length](){
+				auto const idx(m_pbwt_ctx.sequence_idx());
+				auto const &counts(m_pbwt_ctx.output_divergence_value_counts());
+				
+				// Use the texts up to this point as the initial value.
+				segmentation_dp_arg min_arg(lb, 1 + idx, seq_count, seq_count);
+				calculate_segmentation_lp_dp_arg(
+					counts,
+					m_segmentation_traceback_dp,
+					m_segmentation_traceback_dp_rmq,
+					seq_count,
+					segment_length,
+					lb,
+					idx,
+					min_arg
+				);
+				
+				auto const tb_idx(idx + 1 - segment_length);
+				m_segmentation_traceback_dp[tb_idx] = min_arg;
+				m_segmentation_traceback_dp_rmq.update(tb_idx);
+				
+				m_current_step.store(1 + idx, std::memory_order_relaxed);
+				m_current_pbwt_sample_count.store(sample_count(), std::memory_order_relaxed);
+			});
+			
+			// Process the columns in chunks and compress the new samples between them. Also check if the samples
+			// need to be thinned or a checkpoint should be written.
+			std::size_t const chunk_size(4096);
+			while (m_pbwt_ctx.sequence_idx() < limit)
+			{
+				auto const chunk_limit(std::min(limit, m_pbwt_ctx.sequence_idx() + chunk_size));
+				m_pbwt_ctx.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(chunk_limit, callback);
+				store_new_samples();
+				
+				if (m_sample_memory_budget)
+					limit_sample_memory();
+				
+				if (m_checkpoint_writer && m_checkpoint_writer->should_write())
+					write_checkpoint(lb, rb);
+			}
+			
+			if (m_checkpoint_writer)
+			{
+				// Write the final state s.t. the calculation may be continued if columns are appended to the input.
+				m_checkpoint_writer->wait();
+				if (m_checkpoint_writer->written_column() != m_pbwt_ctx.sequence_idx())
+				{
+					write_checkpoint(lb, rb);
 					
-					m_current_step.store(1 + idx, std::memory_order_relaxed);
-					m_current_pbwt_sample_count.store(sample_count, std::memory_order_relaxed);
+					// The writer refers to the DP vector.
+					m_checkpoint_writer->wait();
 				}
-			);
+			}
 			
 			generate_traceback_part_4(lb, rb);
 		});
 	}
 	
 	
+	void segmentation_lp_context::store_new_samples()
+	{
+		// Compress the samples taken by the PBWT context since the previous call.
+		auto &pbwt_samples(m_pbwt_ctx.samples());
+		auto const should_deflate(m_delegate->should_deflate_pbwt_samples());
+		for (auto &sample : pbwt_samples)
+		{
+			auto &compressed_sample(m_samples.emplace_back(std::move(sample), should_deflate));
+			if (m_sample_scratch_file)
+				compressed_sample.spill(*m_sample_scratch_file);
+		}
+		pbwt_samples.clear();
+		
+		// Let the scratch file catch up if the samples are produced faster than they can be written.
+		if (m_sample_scratch_file && s_max_pending_scratch_bytes < m_sample_scratch_file->pending_bytes())
+			m_sample_scratch_file->wait();
+	}
+	
+	
+	void segmentation_lp_context::measure_sample_memory()
+	{
+		// Add the sizes of the samples stored after the previous call.
+		for (auto const &sample : m_samples | ranges::view::drop(m_measured_sample_count))
+			m_sample_memory += sample.size_in_bytes();
+		m_measured_sample_count = m_samples.size();
+	}
+	
+	
+	void segmentation_lp_context::thin_samples()
+	{
+		// Keep every other sample (including the first one) and double the spacing of the samples taken from now on.
+		std::size_t const count((1 + m_samples.size()) / 2);
+		for (std::size_t i(1); i < count; ++i)
+			m_samples[i] = std::move(m_samples[2 * i]);
+		m_samples.resize(count);
+		
+		m_sample_rate *= 2;
+		m_pbwt_ctx.set_sample_rate(m_sample_rate);
+		
+		m_sample_memory = 0;
+		m_measured_sample_count = 0;
+		measure_sample_memory();
+		
+		// The samples already in the checkpoint are no longer valid.
+		if (m_checkpoint_writer)
+			m_checkpoint_writer->samples_did_change();
+	}
+	
+	
+	void segmentation_lp_context::limit_sample_memory()
+	{
+		// Thin the samples until they fit to the budget.
+		measure_sample_memory();
+		while (1 < m_samples.size() && m_sample_memory_budget < m_sample_memory)
+			thin_samples();
+		
+		m_current_pbwt_sample_count.store(sample_count(), std::memory_order_relaxed);
+	}
+	
+	
+	void segmentation_lp_context::limit_sample_memory_for_update_tasks()
+	{
+		// Each running task has a decompressed working sample with buffers for both the input and the output
+		// of the PBWT calculation. In the eager mode, the tasks also store one sample for each traceback argument,
+		// and these are alive at the same time regardless of the number of tasks. In the lazy mode, only the
+		// divergence value counts are stored.
+		if (m_samples.empty())
+			return;
+		
+		std::uint64_t const sample_size(sizeof(pbwt_sample_type) + 2 * sizeof(std::uint32_t) * m_pbwt_ctx.size());
+		std::uint64_t const working_sample_size(2 * sample_size);
+		std::uint64_t const stored_size(m_delegate->should_use_lazy_pbwt_snapshots() ? 0 : m_segmentation_traceback_res.size() * sample_size);
+		std::uint64_t const thread_count(m_delegate->should_run_single_threaded() ? 1 : std::max(1U, std::thread::hardware_concurrency()));
+		
+		// Thinning does not help if the limit cannot be met even with one sample, so keep the tasks parallel in that case.
+		auto const min_size(m_samples.front().size_in_bytes() + stored_size + working_sample_size);
+		if (m_sample_memory_budget < min_size)
+		{
+			m_delegate->context_will_exceed_pbwt_sample_memory_budget(*this, min_size);
+			return;
+		}
+		
+		// Thin the samples until they fit to the budget with the samples of the tasks that run at the same time.
+		measure_sample_memory();
+		while (
+			1 < m_samples.size() &&
+			m_sample_memory_budget < m_sample_memory + stored_size + std::min <std::uint64_t>(m_samples.size(), thread_count) * working_sample_size
+		)
+			thin_samples();
+		
+		m_current_pbwt_sample_count.store(sample_count(), std::memory_order_relaxed);
+	}
+	
+	
+	segmentation_checkpoint_header segmentation_lp_context::checkpoint_header(std::size_t const lb, std::size_t const rb) const
+	{
+		auto const &sequences(m_delegate->sequences());
+		segmentation_checkpoint_header header;
+		header.sequence_count = sequences.size();
+		header.sequence_length = sequences.front().size();
+		header.segment_length = m_delegate->segment_length();
+		header.pbwt_sample_rate = m_delegate->pbwt_sample_rate();
+		header.lb = lb;
+		header.rb = rb;
+		return header;
+	}
+	
+	
+	bool segmentation_lp_context::load_checkpoint(std::size_t const lb, std::size_t const rb)
+	{
+		assert(m_checkpoint_writer);
+		
+		std::unique_ptr <segmentation_checkpoint> checkpoint(new segmentation_checkpoint());
+		std::uint8_t samples_file_index{};
+		std::uint64_t samples_file_size{};
+		if (!load_segmentation_checkpoint(m_checkpoint_writer->directory(), checkpoint_header(lb, rb), m_delegate->sequences(), *checkpoint, samples_file_index, samples_file_size))
+			return false;
+		
+		// If columns were appended to the input, check that generate_traceback_part_2 would not have handled
+		// any of the processed columns with the new right bound.
+		auto const segment_length(m_delegate->segment_length());
+		auto const part_2_limit(std::min(2 * segment_length, rb - segment_length) - 1);
+		if (checkpoint->next_column < part_2_limit)
+			return false;
+		
+		m_checkpoint_writer->set_resumed_state(checkpoint->pbwt_samples.size(), checkpoint->next_column, samples_file_index, samples_file_size);
+		m_resumed_checkpoint = std::move(checkpoint);
+		return true;
+	}
+	
+	
+	void segmentation_lp_context::resume_from_checkpoint()
+	{
+		// Called on the producer queue after preparing the PBWT context and allocating the DP vector.
+		auto &checkpoint(*m_resumed_checkpoint);
+		
+		// Fields in use were set in prepare().
+		m_pbwt_ctx.copy_fields_in_use(checkpoint.pbwt_state);
+		m_samples = std::move(checkpoint.pbwt_samples);
+		if (m_sample_scratch_file)
+		{
+			for (auto &sample : m_samples)
+				sample.spill(*m_sample_scratch_file);
+		}
+		assert(m_pbwt_ctx.sequence_idx() == checkpoint.next_column);
+		
+		// The samples may have been thinned before writing the checkpoint.
+		m_sample_rate = checkpoint.sample_rate;
+		m_pbwt_ctx.set_sample_rate(m_sample_rate);
+		if (m_sample_memory_budget)
+			limit_sample_memory();
+		
+		assert(checkpoint.traceback_dp.size() <= m_segmentation_traceback_dp.size());
+		std::copy(checkpoint.traceback_dp.cbegin(), checkpoint.traceback_dp.cend(), m_segmentation_traceback_dp.begin());
+		
+		// Rebuild the RMQ data structure in the same order as in generate_traceback_part_2 and part_3.
+		for (std::size_t i(0), count(checkpoint.traceback_dp.size()); i < count; ++i)
+			m_segmentation_traceback_dp_rmq.update(i);
+		
+		m_current_step.store(checkpoint.next_column, std::memory_order_relaxed);
+		m_current_pbwt_sample_count.store(sample_count(), std::memory_order_relaxed);
+		m_resumed_checkpoint.reset();
+	}
+	
+	
+	void segmentation_lp_context::write_checkpoint(std::size_t const lb, std::size_t const rb)
+	{
+		// Copy the state that will still be modified; the writer handles the rest asynchronously.
+		// The RMQ data structure is not copied since it can be rebuilt from the DP vector when resuming.
+		std::unique_ptr <segmentation_checkpoint> checkpoint(new segmentation_checkpoint());
+		checkpoint->header = checkpoint_header(lb, rb);
+		checkpoint->next_column = m_pbwt_ctx.sequence_idx();
+		checkpoint->sample_rate = m_sample_rate;
+		checkpoint->pbwt_state.set_fields_in_use(
+			static_cast <lb::pbwt::context_field>(
+				lb::pbwt::context_field::INPUT_PERMUTATION | lb::pbwt::context_field::INPUT_DIVERGENCE | lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS
+			)
+		);
+		checkpoint->pbwt_state.copy_fields_in_use(m_pbwt_ctx);
+		
+		// The copies of the spilled samples only have the offsets to the scratch file, from which the writer reads the data.
+		auto const written_sample_count(m_checkpoint_writer->written_sample_count());
+		assert(written_sample_count <= m_samples.size());
+		std::copy(m_samples.cbegin() + written_sample_count, m_samples.cend(), std::back_inserter(checkpoint->pbwt_samples));
+		
+		m_checkpoint_writer->write_async(std::move(checkpoint), m_segmentation_traceback_dp, m_sample_scratch_file.get());
+	}
+	
+	
 	void segmentation_lp_context::generate_traceback_part_4(std::size_t const lb, std::size_t const rb)
 	{
 		// Calculate the size of the final segment.
@@ -158,10 +399,12 @@ namespace founder_sequences {
 				[this](){
 					auto const idx(m_pbwt_ctx.sequence_idx());
 					m_current_step.store(1 + idx, std::memory_order_relaxed);
-					m_current_pbwt_sample_count.store(m_pbwt_ctx.samples().size(), std::memory_order_relaxed);
+					m_current_pbwt_sample_count.store(sample_count(), std::memory_order_relaxed);
 				}
 			);
 			
+			store_new_samples();
+			
 			auto counts(m_pbwt_ctx.last_divergence_value_counts());
 			auto const idx(m_pbwt_ctx.sequence_idx());
 			segmentation_dp_arg min_arg(lb, idx, seq_count, seq_count);
@@ -202,15 +445,15 @@ namespace founder_sequences {
 			auto const &current_arg(m_segmentation_traceback_dp[arg_idx]);
 			// Fill in reverse order.
 			m_segmentation_traceback_res.push_back(current_arg);
-		
+			
 			auto const next_pos(current_arg.lb);
 			if (0 == next_pos) // FIXME: generalize by substituting 0 with lb.
 				break;
-		
+			
 			assert(segment_length <= next_pos);
 			arg_idx = next_pos - segment_length;
 		}
-	
+		
 		// Reverse the filled traceback.
 		std::reverse(m_segmentation_traceback_res.begin(), m_segmentation_traceback_res.end());
 		
@@ -231,7 +474,14 @@ namespace founder_sequences {
 		dispatch_async(*m_producer_queue, ^{
 			m_update_samples_group.reset(dispatch_group_create());
 			
-			auto &pbwt_samples(m_pbwt_ctx.samples());
+			if (m_sample_memory_budget)
+				limit_sample_memory_for_update_tasks();
+			
+			// The tasks decompress the spilled samples directly from the mapping.
+			if (m_sample_scratch_file)
+				m_sample_scratch_file->map();
+			
+			auto &pbwt_samples(m_samples);
 			auto const sample_count(pbwt_samples.size());
 			auto traceback_it(m_segmentation_traceback_res.cbegin());
 			auto const traceback_end(m_segmentation_traceback_res.cend());
@@ -241,6 +491,7 @@ namespace founder_sequences {
 			
 			m_delegate->context_will_start_update_samples_tasks(*this);
 			
+			task_scheduler scheduler;
 			std::size_t lb(0);
 			std::size_t i(1);
 			std::size_t last_moved_sample(SIZE_MAX);
@@ -272,12 +523,12 @@ namespace founder_sequences {
 					using std::swap;
 					swap(right_bounds, current_right_bounds);
 					
-					// Start the task.
-					start_update_sample_task(lb, std::move(prev_sample), std::move(current_right_bounds));
+					// Create the task.
+					create_update_sample_task(scheduler, lb, std::move(prev_sample), std::move(current_right_bounds));
 				}
 				else
 				{
-					// Did not start a task.
+					// Did not create a task.
 					m_current_step.fetch_add(1, std::memory_order_relaxed);
 				}
 				
@@ -296,7 +547,7 @@ namespace founder_sequences {
 					assert(i - 1 != last_moved_sample);
 					auto &last_sample(pbwt_samples[i - 1]);
 					assert(last_sample.sequence_idx() <= right_bounds.front());
-					start_update_sample_task(lb, std::move(last_sample), std::move(right_bounds));
+					create_update_sample_task(scheduler, lb, std::move(last_sample), std::move(right_bounds));
 				}
 				else
 				{
@@ -304,179 +555,281 @@ namespace founder_sequences {
 				}
 			}
 			
+			// The number of right bounds between the samples varies, so start the tasks with the most columns first.
+			scheduler.dispatch_tasks(*m_update_samples_group, *m_producer_queue);
 			m_delegate->context_did_start_update_samples_tasks(*this);
 			
 			// Remove the remaining samples.
 			pbwt_samples.clear();
 			
 			dispatch_group_notify(*m_update_samples_group, dispatch_get_main_queue(), ^{
+				// In the lazy mode, the tasks read their samples again in find_segments_greedy().
+				if (!m_delegate->should_use_lazy_pbwt_snapshots())
+					m_sample_scratch_file.reset();
 				m_delegate->context_did_update_pbwt_samples_to_traceback_positions(*this);
 			});
 		});
 	}
 	
 	
-	void segmentation_lp_context::start_update_sample_task(
+	void segmentation_lp_context::create_update_sample_task(
+		task_scheduler &scheduler,
 		std::size_t const lb,
-		pbwt_sample_type &&sample,
+		compressed_pbwt_sample &&sample,
 		text_position_vector &&right_bounds
 	)
 	{
-		// Start the task.
-		// Use pointers to avoid problems if m_update_pbwt_tasks needs to reallocate.
-		auto &task_ptr(m_update_pbwt_tasks.emplace_back(new update_pbwt_task(*this, lb, std::move(sample), std::move(right_bounds))));
-		auto *task(task_ptr.get());
-		dispatch_group_async(*m_update_samples_group, *m_producer_queue, ^{
-			task->execute();
-		});
+		// Create the task. The sample is decompressed when the task is executed.
+		// The tasks are started in update_samples_to_traceback_positions() in the order of their cost.
+		auto const is_lazy(m_delegate->should_use_lazy_pbwt_snapshots());
+		auto &task_ptr(m_update_pbwt_tasks.emplace_back(new update_pbwt_task(*this, lb, std::move(sample), std::move(right_bounds), is_lazy)));
+		scheduler.add_task(*task_ptr);
 	}
 	
 	
-	void segmentation_lp_context::find_segments_greedy()
+	void segmentation_lp_context::find_segments_greedy_second_pass()
 	{
 		dispatch_async(*m_producer_queue, ^{
 			
-			typedef update_pbwt_task::pbwt_sample_vector pbwt_sample_vector;
+			// The first pass is not needed any more.
+			m_pbwt_ctx.set_fields_in_use(lb::pbwt::context_field::NONE);
+			m_pbwt_ctx.clear_unused_fields();
 			
-			segmentation_container container;
+			pbwt_context pbwt_ctx(m_delegate->sequences(), m_delegate->alphabet(), lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS);
+			pbwt_ctx.set_sample_rate(std::numeric_limits <std::uint64_t>::max());
+			pbwt_ctx.prepare();
 			
-			// Iterate the divergence samples from the second one. Try to join the rightmost segment to the current
-			// segment run by calculating its size with respect to the current left bound. If the size is less than the size 
-			// calculated with DP, continue. Otherwise, end the current run (to the previously iterated sample) and start a new run.
-			std::size_t current_lb(m_update_pbwt_tasks.front()->left_bound()); // Left bound.
-			std::size_t prev_size(m_segmentation_traceback_res.front().segment_size);
-			auto *prev_sample(&m_update_pbwt_tasks.front()->samples().front());
+			auto const take_sample([&pbwt_ctx](std::size_t const rb){
+				pbwt_ctx.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(rb, [](){});
+				
+				pbwt_sample_type sample;
+				sample.set_fields_in_use(
+					static_cast <lb::pbwt::context_field>(
+						lb::pbwt::context_field::INPUT_PERMUTATION | lb::pbwt::context_field::INPUT_DIVERGENCE
+					)
+				);
+				sample.copy_fields_in_use(pbwt_ctx);
+				return sample;
+			});
 			
 			// Progress tracking.
 			m_current_step = 0;
 			m_step_max = m_segmentation_traceback_res.size();
 			m_delegate->context_will_merge_segments(*this);
 			
-			auto pbwt_samples(m_update_pbwt_tasks	| ranges::view::transform([](auto &task) -> pbwt_sample_vector & { return task->samples(); })
-							  						| ranges::view::join);
-			for (auto const &tup : ranges::view::zip(pbwt_samples, m_segmentation_traceback_res) | ranges::view::drop(1))
+			// Same as in find_segments_greedy() but only the sample at the previous traceback position is kept.
+			std::size_t current_lb(m_segmentation_traceback_res.front().lb);
+			std::size_t prev_size(m_segmentation_traceback_res.front().segment_size);
+			auto prev_sample(take_sample(m_segmentation_traceback_res.front().rb));
+			
+			for (auto const &dp_arg : m_segmentation_traceback_res | ranges::view::drop(1))
 			{
-				auto &sample(std::get <0>(tup));
-				auto const &dp_arg(std::get <1>(tup));
+				auto sample(take_sample(dp_arg.rb));
 				assert(sample.sequence_idx() == dp_arg.rb);
 				
-				auto const sample_size(sample.unique_substring_count_lhs(current_lb));
+				auto const sample_size(count_distinct_substrings(sample, current_lb));
 				if (sample_size <= m_max_segment_size)
 					prev_size = sample_size;
 				else
 				{
-					container.reduced_traceback.emplace_back(current_lb, prev_sample->sequence_idx(), prev_size);
+					auto const prev_rb(prev_sample.sequence_idx());
+					segmentation_dp_arg const reduced_arg(current_lb, prev_rb, prev_size);
 					prev_size = dp_arg.segment_size;
 					
-					current_lb = prev_sample->sequence_idx();
-					container.reduced_pbwt_samples.emplace_back(std::move(*prev_sample));
+					current_lb = prev_rb;
+					m_delegate->context_did_find_reduced_segment(*this, reduced_arg, std::move(prev_sample));
 				}
 				
-				prev_sample = &sample;
+				prev_sample = std::move(sample);
 				m_current_step.fetch_add(1, std::memory_order_relaxed);
 			}
 			
+			segmentation_dp_arg const reduced_arg(current_lb, prev_sample.sequence_idx(), prev_size);
+			m_delegate->context_did_find_reduced_segment(*this, reduced_arg, std::move(prev_sample));
+			m_current_step.fetch_add(1, std::memory_order_relaxed);
+			
+			dispatch_async(dispatch_get_main_queue(), ^{
+				m_delegate->context_did_finish_second_pass(*this);
+			});
+		});
+	}
+	
+	
+	void segmentation_lp_context::find_segments_greedy()
+	{
+		dispatch_async(*m_producer_queue, ^{
+			
+			segmentation_container container;
+			
+			// Iterate the divergence samples from the second one. Try to join the rightmost segment to the current
+			// segment run by calculating its size with respect to the current left bound. If the size is less than the size 
+			// calculated with DP, continue. Otherwise, end the current run (to the previously iterated sample) and start a new run.
+			// Only the samples at the ends of the runs are retained.
+			// Since the segment size w.r.t. a fixed left bound is non-decreasing in the right bound, the end of each run
+			// may be searched for instead of checking each sample; see find_run_end().
+			sample_position_vector positions;
+			positions.reserve(m_segmentation_traceback_res.size());
+			for (auto const &task_ptr : m_update_pbwt_tasks)
+			{
+				for (std::size_t i(0), count(task_ptr->right_bound_count()); i < count; ++i)
+				{
+					assert(task_ptr->right_bound(i) == m_segmentation_traceback_res[positions.size()].rb);
+					positions.emplace_back(task_ptr.get(), i);
+				}
+			}
+			assert(m_segmentation_traceback_res.size() == positions.size());
+			
+			std::size_t current_lb(m_update_pbwt_tasks.front()->left_bound()); // Left bound.
+			std::size_t prev_size(m_segmentation_traceback_res.front().segment_size);
+			
+			// Progress tracking.
+			m_current_step = 0;
+			m_step_max = m_segmentation_traceback_res.size();
+			m_delegate->context_will_merge_segments(*this);
+			
+			std::size_t begin(1);
+			std::size_t span(1);
+			while (true)
+			{
+				// Find the first sample that does not fit with the current left bound.
+				std::size_t last_fitting_size(0);
+				auto const end(find_run_end(positions, begin, current_lb, span, last_fitting_size));
+				if (begin < end)
+					prev_size = last_fitting_size;
+				
+				m_current_step.store(end, std::memory_order_relaxed);
+				if (positions.size() == end)
+					break;
+				
+				// End the current run to the previous sample.
+				auto const &[prev_task, prev_idx] = positions[end - 1];
+				auto const prev_rb(prev_task->right_bound(prev_idx));
+				container.reduced_traceback.emplace_back(current_lb, prev_rb, prev_size);
+				prev_task->retain_sample(prev_idx);
+				prev_size = m_segmentation_traceback_res[end].segment_size;
+				current_lb = prev_rb;
+				
+				// Expect the next run to be about as long as the current one.
+				span = end - begin + 1;
+				begin = end + 1;
+			}
+			
+			auto const &[last_task, last_idx] = positions.back();
 			container.max_segment_size = m_max_segment_size;
-			container.reduced_traceback.emplace_back(current_lb, prev_sample->sequence_idx(), prev_size);
-			container.reduced_pbwt_samples.emplace_back(std::move(*prev_sample));
-			m_update_pbwt_tasks.clear();
+			container.reduced_traceback.emplace_back(current_lb, last_task->right_bound(last_idx), prev_size);
+			last_task->retain_sample(last_idx);
 			
-			m_current_step.fetch_add(1, std::memory_order_relaxed);
+			m_current_step.store(positions.size(), std::memory_order_relaxed);
+			
+			if (!m_delegate->should_use_lazy_pbwt_snapshots())
+			{
+				finish_finding_segments(std::move(container));
+				return;
+			}
+			
+			// Recalculate the retained samples. Use a pointer since blocks copy the captured variables.
+			auto *container_ptr(new segmentation_container(std::move(container)));
+			m_update_samples_group.reset(dispatch_group_create());
+			for (auto const &task_ptr : m_update_pbwt_tasks)
+			{
+				auto *task(task_ptr.get());
+				dispatch_group_async(*m_update_samples_group, *m_producer_queue, ^{
+					task->materialize_retained_samples();
+				});
+			}
 			
-			lb::dispatch_async_fn(dispatch_get_main_queue(), [this, container{std::move(container)}]() mutable {
-				m_delegate->context_did_merge_segments(*this, std::move(container));
+			dispatch_group_notify(*m_update_samples_group, *m_producer_queue, ^{
+				std::unique_ptr <segmentation_container> container(container_ptr);
+				m_sample_scratch_file.reset();
+				finish_finding_segments(std::move(*container));
 			});
 		});
 	}
 	
 	
-	void calculate_segmentation_lp_dp_arg(
-		typename pbwt_context::divergence_count_list const &divergence_value_counts,
-		segmentation_traceback_vector const &segmentation_traceback_dp,
-		segmentation_traceback_vector_rmq const &segmentation_traceback_dp_rmq,
-		std::size_t const seq_count,
-		std::size_t const segment_length,
-		std::size_t const lb,	// Inclusive.
-		std::size_t const text_pos,
-		segmentation_dp_arg &min_arg
-	)
+	std::size_t segmentation_lp_context::find_run_end(
+		sample_position_vector const &positions,
+		std::size_t const begin,
+		std::size_t const lb,
+		std::size_t const initial_span,
+		std::size_t &last_fitting_size
+	) const
 	{
-		// Take the current divergence values and their counts in divergence value order.
-		auto it(divergence_value_counts.cbegin_pairs());
-		auto const end(divergence_value_counts.cend_pairs());
-		assert(it != end);
+		// Find the first position in [begin, positions.size()) the segment size of which w.r.t. lb exceeds
+		// the maximum segment size. Since the size is non-decreasing, all of the preceding positions fit.
+		// Evaluate up to s_speculation_width evenly spaced positions at a time in parallel. Until a position
+		// that does not fit has been found, double the span of the positions after each round (galloping);
+		// afterwards narrow the range to the evaluated positions that surround the first one that does not fit.
+		// When the range is short enough, every position in it is evaluated, so the result is exact.
+		std::array <std::size_t, s_speculation_width> probes{};
+		std::array <std::size_t, s_speculation_width> sizes{};
 		
-		// Find the minimum, similar to Ukkonen's equation 1.
-		std::size_t segment_size_diff(it->second);
-		
-		std::size_t dp_lb(lb);
-		std::size_t dp_rb(it->first); // Initial value not used.
-		
-		// Consider the whole range in case the segment size is smaller than seq_count.
-		if (lb == dp_rb)
+		std::size_t lo(begin);				// Every position before lo fits.
+		std::size_t hi(positions.size());	// Position hi does not fit unless it is the end.
+		std::size_t span(std::clamp <std::size_t>(initial_span, 1, s_speculation_width));
+		bool found_end(false);
+		while (lo < hi)
 		{
-			auto const segment_size(seq_count - segment_size_diff);
-			segmentation_dp_arg const current_arg(lb, 1 + text_pos, segment_size, segment_size);
-			if (current_arg < min_arg)
-				min_arg = current_arg;
-			
-			++it;
-			dp_rb = it->first;
-			segment_size_diff += it->second;
-		}
-		
-		++it;
-		while (true)
-		{
-			if (it == end)
-				break;
+			auto const limit(found_end ? hi : std::min(hi, lo + span));
+			auto const count(std::min(s_speculation_width, limit - lo));
+			for (std::size_t i(0); i < count; ++i)
+				probes[i] = lo + ((1 + i) * (limit - lo)) / count - 1;
+			
+			auto const calculate_size([&positions, &probes, &sizes, lb](std::size_t const i){
+				auto const &[task, idx] = positions[probes[i]];
+				sizes[i] = task->segment_size(idx, lb);
+			});
 			
-			// Range of possible cutting points.
-			dp_lb = dp_rb;
-			dp_rb = it->first;
-			std::size_t dp_rb_c(dp_rb);
-			assert(0 != it->first);
-			assert(dp_lb < dp_rb);
-			assert(dp_rb <= 1 + text_pos);
-			
-			// Check if the range needs to and can be contracted.
-			// First, verify that the current segment fits after the DP search range.
-			if (text_pos + 2 - segment_length < dp_rb_c)
-				dp_rb_c = text_pos + 2 - segment_length;
-			
-			// Second, verify that one segment fits before the DP search range.
-			// (Considering segment end positions; it must hold that lb + segment_length ≤ dp_lb.)
-			if (dp_lb < lb + segment_length)
+			if (1 == count || m_delegate->should_run_single_threaded())
 			{
-				if (lb + segment_length < dp_rb_c)
-					dp_lb = lb + segment_length;
-				else
-					goto continue_loop;
+				for (std::size_t i(0); i < count; ++i)
+					calculate_size(i);
+			}
+			else
+			{
+				lb::parallel_for_each(
+					ranges::view::iota(std::size_t(0), count),
+					[&calculate_size](std::size_t const i, std::size_t const){ calculate_size(i); }
+				);
 			}
 			
-			// Check that the range is still valid.
-			if (dp_lb < dp_rb_c)
+			// Find the first evaluated position that does not fit.
+			std::size_t k(0);
+			while (k < count && sizes[k] <= m_max_segment_size)
+				++k;
+			
+			if (k)
 			{
-				// Convert to segmentation_traceback indexing.
-				assert(segment_length <= dp_lb);
-				assert(segment_length <= dp_rb_c);
-				auto const dp_lb_tb(dp_lb - segment_length);
-				auto const dp_rb_tb(dp_rb_c - segment_length);
-				auto const idx(segmentation_traceback_dp_rmq(dp_lb_tb, dp_rb_tb));
-				
-				auto const &boundary_segment(segmentation_traceback_dp[idx]);
-				auto const lhs(boundary_segment.segment_max_size);
-				auto const rhs(seq_count - segment_size_diff);
-				
-				segmentation_dp_arg current_arg(idx + segment_length, 1 + text_pos, lb::max_ct(lhs, rhs), rhs);
-				if (current_arg < min_arg)
-					min_arg = current_arg;
+				lo = 1 + probes[k - 1];
+				last_fitting_size = sizes[k - 1];
 			}
 			
-			// Next iteration.
-		continue_loop:
-			segment_size_diff += it->second;
-			++it;
+			if (k < count)
+			{
+				hi = probes[k];
+				found_end = true;
+			}
+			else if (!found_end)
+			{
+				span *= 2;
+			}
 		}
+		
+		return hi;
+	}
+	
+	
+	void segmentation_lp_context::finish_finding_segments(segmentation_container &&container)
+	{
+		// Move the retained samples in traceback order.
+		container.reduced_pbwt_samples.reserve(container.reduced_traceback.size());
+		for (auto const &task_ptr : m_update_pbwt_tasks)
+			task_ptr->take_retained_samples(container.reduced_pbwt_samples);
+		libbio_assert_eq(container.reduced_traceback.size(), container.reduced_pbwt_samples.size());
+		m_update_pbwt_tasks.clear();
+		
+		lb::dispatch_async_fn(dispatch_get_main_queue(), [this, container{std::move(container)}]() mutable {
+			m_delegate->context_did_merge_segments(*this, std::move(container));
+		});
 	}
 }
@@ -3,12 +3,65 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <algorithm>
+#include <cstring>
+#include <founder_sequences/segmentation_cache.hh>
 #include <founder_sequences/segmentation_sp_context.hh>
+#include <libbio/algorithm.hh>
+#include <numeric>
+#include <unordered_map>
 
+namespace fseq = founder_sequences;
 namespace lb = libbio;
 
 
+namespace {
+
+	// The hash table is divided into parts by the high bits of the hashes s.t. the parts may be filled in parallel.
+	constexpr std::size_t s_shard_bits(6);
+	constexpr std::size_t s_shard_count(1 << s_shard_bits);
+	
+	
+	inline std::size_t shard(std::uint64_t const hash)
+	{
+		return hash >> (64 - s_shard_bits);
+	}
+	
+	
+	// Compare the characters in [lb, rb) starting from the last one, which is the order of the sequences in the PBWT
+	// since the compressed alphabet preserves the order of the characters.
+	inline int compare_reversed(fseq::sequence const &lhs, fseq::sequence const &rhs, std::size_t const lb, std::size_t rb)
+	{
+		while (lb < rb)
+		{
+			--rb;
+			if (lhs[rb] != rhs[rb])
+				return (lhs[rb] < rhs[rb] ? -1 : 1);
+		}
+		return 0;
+	}
+}
+
+
 namespace founder_sequences {
+
+	template <typename t_fn>
+	void segmentation_sp_context::for_each_index(std::size_t const count, t_fn &&fn) const
+	{
+		if (count <= 1 || m_delegate->should_run_single_threaded())
+		{
+			for (std::size_t i(0); i < count; ++i)
+				fn(i);
+		}
+		else
+		{
+			lb::parallel_for_each(
+				ranges::view::iota(std::size_t(0), count),
+				[&fn](std::size_t const i, std::size_t const){ fn(i); }
+			);
+		}
+	}
+	
 	
 	void segmentation_sp_context::output_sequence(std::ostream &os, sequence const &seq) const
 	{
@@ -18,12 +71,86 @@ namespace founder_sequences {
 	}
 	
 	
+	void segmentation_sp_context::group_sequences(
+		std::vector <std::uint64_t> const &hashes,
+		std::uint32_t const *indices_begin,
+		std::uint32_t const *indices_end,
+		std::vector <sequence_run> &dst
+	) const
+	{
+		// The indices are in increasing order, so the first sequence of each run is the first one in the PBWT order
+		// unless the run is determined by a proper suffix of the prefix.
+		auto const &sequences(m_delegate->sequences());
+		auto const length(m_rb - m_lb);
+		std::unordered_map <std::uint64_t, std::vector <std::uint32_t>> runs_by_hash;	// Indices in dst.
+		for (auto it(indices_begin); it != indices_end; ++it)
+		{
+			auto const seq_idx(*it);
+			auto const &seq(sequences[seq_idx]);
+			auto &candidates(runs_by_hash[hashes[seq_idx]]);
+			
+			// Compare the substrings in case the hashes collide.
+			auto const run_it(std::find_if(candidates.begin(), candidates.end(), [&](std::uint32_t const run_idx){
+				auto const &other(sequences[dst[run_idx].first]);
+				return 0 == std::memcmp(seq.data() + m_lb, other.data() + m_lb, length);
+			}));
+			
+			if (candidates.end() == run_it)
+			{
+				candidates.push_back(dst.size());
+				dst.emplace_back(seq_idx, 1);
+			}
+			else
+			{
+				auto &run(dst[*run_it]);
+				++run.second;
+				if (m_lb && compare_reversed(seq, sequences[run.first], 0, m_lb) < 0)
+					run.first = seq_idx;
+			}
+		}
+	}
+	
+	
 	void segmentation_sp_context::process()
 	{
-		m_ctx.prepare();
-		m_ctx.process <>(m_rb, [](){});
+		auto const &sequences(m_delegate->sequences());
+		auto const seq_count(sequences.size());
+		
+		// Hash the substrings in parallel.
+		std::vector <std::uint64_t> hashes(seq_count);
+		for_each_index(seq_count, [this, &sequences, &hashes](std::size_t const i){
+			hashes[i] = hash_bytes(sequences[i].data() + m_lb, m_rb - m_lb, 0);
+		});
+		
+		// Distribute the sequence indices to the parts of the hash table with counting sort, which keeps them in order.
+		std::vector <std::uint32_t> shard_offsets(1 + s_shard_count, 0);
+		for (auto const hash : hashes)
+			++shard_offsets[1 + shard(hash)];
+		std::partial_sum(shard_offsets.begin(), shard_offsets.end(), shard_offsets.begin());
+		
+		std::vector <std::uint32_t> indices(seq_count);
+		{
+			auto positions(shard_offsets);
+			for (std::size_t i(0); i < seq_count; ++i)
+				indices[positions[shard(hashes[i])]++] = i;
+		}
+		
+		// Group the sequences with identical substrings. Equal substrings have equal hashes, so the parts are independent.
+		std::vector <std::vector <sequence_run>> shard_runs(s_shard_count);
+		for_each_index(s_shard_count, [this, &hashes, &indices, &shard_offsets, &shard_runs](std::size_t const i){
+			group_sequences(hashes, indices.data() + shard_offsets[i], indices.data() + shard_offsets[1 + i], shard_runs[i]);
+		});
+		
+		// Output the runs in the PBWT order.
+		m_permutation.clear();
+		for (auto const &runs : shard_runs)
+			m_permutation.insert(m_permutation.end(), runs.begin(), runs.end());
+		
+		std::sort(m_permutation.begin(), m_permutation.end(), [this, &sequences](auto const &lhs, auto const &rhs){
+			return compare_reversed(sequences[lhs.first], sequences[rhs.first], m_lb, m_rb) < 0;
+		});
 		
-		m_max_segment_size = m_ctx.unique_substring_count_idxs_lhs(m_lb, m_permutation);
+		m_max_segment_size = m_permutation.size();
 		m_delegate->context_did_finish_traceback(*this);
 	}
 	
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <founder_sequences/task_scheduler.hh>
+
+
+namespace founder_sequences {
+
+	void task_scheduler::dispatch_tasks(dispatch_group_t group, dispatch_queue_t queue)
+	{
+		// Keep the original order for tasks of equal cost.
+		std::stable_sort(m_tasks.begin(), m_tasks.end(), [](auto const &lhs, auto const &rhs){
+			return lhs.first > rhs.first;
+		});
+		
+		for (auto const &pair : m_tasks)
+		{
+			auto *task(pair.second);
+			dispatch_group_async(group, queue, ^{
+				task->execute();
+			});
+		}
+		
+		m_tasks.clear();
+	}
+}
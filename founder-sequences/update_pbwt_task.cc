@@ -3,34 +3,157 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <algorithm>
+#include <founder_sequences/divergence_kernels.hh>
+#include <founder_sequences/segmentation_lp_dp.hh>
 #include <founder_sequences/update_pbwt_task.hh>
+#include <unordered_map>
 
 namespace lb = libbio;
 
 
 namespace founder_sequences {
 
-	void update_pbwt_task::execute()
+	void update_pbwt_task::prepare_pbwt_sample()
 	{
-		// Take the next right bound, update the sample up to it.
+		m_compressed_sample.decompress(m_pbwt_sample);
 		m_pbwt_sample.set_sample_rate(std::numeric_limits <std::uint64_t>::max());
-		for (auto const rb : m_right_bounds)
+		m_sequence_count = m_pbwt_sample.size();
+	}
+	
+	
+	void update_pbwt_task::copy_sample(std::size_t const rb)
+	{
+		m_pbwt_sample.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(rb, [](){});
+		
+		// Create a sample and copy the fields.
+		// FIXME: with pbwt_rmq, the input_permutation will be used as a buffer for RMQ calculation. It does not affect the calculation, though, since at the end of process(), the buffers will be swapped, and the final output permutations will end up as input permutations. API should be added for marking the buffers such that their contents are needed intact after calling process() or something along those lines.
+		auto &copied_sample(m_samples.emplace_back());
+		copied_sample.set_fields_in_use(
+			static_cast <lb::pbwt::context_field>(
+				lb::pbwt::context_field::INPUT_PERMUTATION | lb::pbwt::context_field::INPUT_DIVERGENCE
+			)
+		);
+		copied_sample.copy_fields_in_use(m_pbwt_sample);
+	}
+	
+	
+	void update_pbwt_task::execute()
+	{
+		if (m_is_lazy)
+		{
+			// Keep the compressed sample for materialize_retained_samples(). If it has been spilled, it is
+			// decompressed from the scratch file again.
+			prepare_pbwt_sample();
+			
+			// The sample may have been taken at the first right bound, in which case the counts are not available from process().
+			auto rb_it(m_right_bounds.cbegin());
+			auto const rb_end(m_right_bounds.cend());
+			if (m_pbwt_sample.sequence_idx() == *rb_it)
+			{
+				push_divergence_value_counts_from_sample();
+				++rb_it;
+			}
+			
+			// Store the divergence value counts of the last column before each right bound.
+			m_pbwt_sample.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(m_right_bounds.back(), [this, &rb_it, rb_end](){
+				if (rb_it != rb_end && 1 + m_pbwt_sample.sequence_idx() == *rb_it)
+				{
+					m_divergence_value_counts.push_back(m_pbwt_sample.output_divergence_value_counts());
+					++rb_it;
+				}
+			});
+			libbio_assert_eq(m_divergence_value_counts.size(), m_right_bounds.size());
+			m_divergence_value_counts.shrink_to_fit();
+		}
+		else
 		{
-			m_pbwt_sample.process <lb::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(rb, [](){});
+			prepare_pbwt_sample();
+			m_compressed_sample = compressed_pbwt_sample();
 			
-			// Create a sample and copy the fields.
-			// FIXME: with pbwt_rmq, the input_permutation will be used as a buffer for RMQ calculation. It does not affect the calculation, though, since at the end of process(), the buffers will be swapped, and the final output permutations will end up as input permutations. API should be added for marking the buffers such that their contents are needed intact after calling process() or something along those lines.
-			auto &copied_sample(m_samples.emplace_back());
-			copied_sample.set_fields_in_use(
-				static_cast <lb::pbwt::context_field>(
-					lb::pbwt::context_field::INPUT_PERMUTATION | lb::pbwt::context_field::INPUT_DIVERGENCE
-				)
-			);
-			copied_sample.copy_fields_in_use(m_pbwt_sample);
+			// Take the next right bound, update the sample up to it. Every copy is needed until the retained ones
+			// have been determined, so each of them is allocated separately; use the lazy mode to avoid this.
+			m_samples.reserve(m_right_bounds.size());
+			for (auto const rb : m_right_bounds)
+				copy_sample(rb);
 		}
 		
 		m_pbwt_sample.set_fields_in_use(lb::pbwt::context_field::NONE);
 		m_pbwt_sample.clear_unused_fields();
 		m_delegate->task_did_finish(*this);
 	}
+	
+	
+	void update_pbwt_task::push_divergence_value_counts_from_sample()
+	{
+		typedef divergence_value_count_cache::value_count_pair value_count_pair;
+		
+		// Count the values with a hash map s.t. only the distinct values need to be sorted.
+		std::unordered_map <std::uint32_t, std::uint32_t> counts;
+		for (auto const val : m_pbwt_sample.input_divergence())
+			++counts[val];
+		
+		std::vector <value_count_pair> pairs(counts.begin(), counts.end());
+		std::sort(pairs.begin(), pairs.end());
+		
+		m_divergence_value_counts.push_back(divergence_value_count_cache::counts_view(pairs.data(), pairs.data() + pairs.size()));
+	}
+	
+	
+	std::uint64_t update_pbwt_task::estimated_cost() const
+	{
+		// Processing each column and copying each sample take time proportional to the sequence count.
+		auto const column_count(m_right_bounds.back() - m_compressed_sample.sequence_idx());
+		return column_count + (m_is_lazy ? 0 : m_right_bounds.size());
+	}
+	
+	
+	std::size_t update_pbwt_task::segment_size(std::size_t const idx, std::size_t const lb) const
+	{
+		if (m_is_lazy)
+			return calculate_segmentation_lp_segment_size(m_divergence_value_counts[idx], m_sequence_count, lb);
+		
+		return count_distinct_substrings(m_samples[idx], lb);
+	}
+	
+	
+	void update_pbwt_task::materialize_retained_samples()
+	{
+		assert(m_is_lazy);
+		m_divergence_value_counts.clear();
+		m_divergence_value_counts.shrink_to_fit();
+		
+		if (m_retained_indices.empty())
+			return;
+		
+		prepare_pbwt_sample();
+		m_compressed_sample = compressed_pbwt_sample();
+		
+		m_samples.reserve(m_retained_indices.size());
+		for (auto const idx : m_retained_indices)
+			copy_sample(m_right_bounds[idx]);
+		
+		m_pbwt_sample.set_fields_in_use(lb::pbwt::context_field::NONE);
+		m_pbwt_sample.clear_unused_fields();
+	}
+	
+	
+	void update_pbwt_task::take_retained_samples(pbwt_sample_vector &dst)
+	{
+		if (m_is_lazy)
+		{
+			// Only the retained samples were materialized.
+			libbio_assert_eq(m_samples.size(), m_retained_indices.size());
+			for (auto &sample : m_samples)
+				dst.emplace_back(std::move(sample));
+		}
+		else
+		{
+			for (auto const idx : m_retained_indices)
+				dst.emplace_back(std::move(m_samples[idx]));
+		}
+		
+		m_samples.clear();
+		m_retained_indices.clear();
+	}
 }
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_ASSIGNMENT_SOLVER_HH
+#define FOUNDER_SEQUENCES_ASSIGNMENT_SOLVER_HH
+
+#include <cstdint>
+#include <founder_sequences/founder_sequences.hh>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Minimum cost assignment for a dense square cost matrix with the shortest augmenting path method
+	// (Jonker and Volgenant, Hungarian algorithm with potentials) in O(k³) time. The dual variables are
+	// initialised with row and column reductions, after which the rows may be assigned greedily to the
+	// columns with zero reduced cost. The remaining rows are assigned by finding shortest augmenting paths.
+	// The absolute values of the costs need to be less than 2^30.
+	class dense_assignment_solver
+	{
+	public:
+		typedef std::int32_t	cost_type;
+		typedef std::int64_t	potential_type;
+	
+	protected:
+		std::vector <potential_type>	m_row_potentials;
+		std::vector <potential_type>	m_column_potentials;
+		std::vector <potential_type>	m_min_reduced_costs;
+		std::vector <cost_type>			m_column_minima;
+		std::vector <std::uint32_t>		m_column_rows;			// Row assigned to each column.
+		std::vector <std::uint32_t>		m_previous_columns;		// Augmenting path.
+		std::vector <std::uint8_t>		m_visited_columns;
+	
+	public:
+		static constexpr std::uint32_t const UNASSIGNED{UINT32_MAX};
+		
+		// Find an assignment of minimum total cost. costs has size × size elements in row-major order.
+		// Stores the column of each row to dst and returns the total cost.
+		std::int64_t solve(cost_type const *costs, std::size_t const size, matching_vector &dst);
+	
+	protected:
+		void reduce(cost_type const *costs, std::size_t const size);
+		void assign_greedily(cost_type const *costs, std::size_t const size);
+		void augment(cost_type const *costs, std::size_t const size, std::uint32_t const row);
+	};
+}
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_AUCTION_ASSIGNMENT_SOLVER_HH
+#define FOUNDER_SEQUENCES_AUCTION_ASSIGNMENT_SOLVER_HH
+
+#include <cstdint>
+#include <dispatch/dispatch.h>
+#include <founder_sequences/founder_sequences.hh>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Maximum weight assignment for a dense square weight matrix with Bertsekas' auction algorithm and ε-scaling.
+	// The bids of the unassigned rows are computed in parallel (Jacobi variant) and the conflicts are resolved
+	// serially. The weights are multiplied by size + 1, so the assignment is optimal when ε reaches one. Otherwise
+	// the scaling is stopped as soon as the assignment is within the given relative gap of the dual upper bound.
+	class auction_assignment_solver
+	{
+	public:
+		typedef std::int32_t	weight_type;
+		typedef std::int64_t	price_type;
+	
+	protected:
+		std::vector <price_type>		m_prices;
+		std::vector <std::uint32_t>		m_object_owners;		// Row assigned to each column.
+		std::vector <std::uint32_t>		m_assignment;			// Column assigned to each row.
+		std::vector <std::uint32_t>		m_bidders;				// Unassigned rows.
+		std::vector <std::uint32_t>		m_next_bidders;
+		std::vector <std::uint32_t>		m_bid_objects;			// By bidder index.
+		std::vector <price_type>		m_bid_amounts;
+		std::vector <std::uint32_t>		m_best_bidders;			// By column.
+		std::vector <std::uint32_t>		m_bid_columns;			// Columns that received bids.
+		std::vector <price_type>		m_row_values;
+		dispatch_queue_t				m_queue{};				// Not owned.
+		double							m_optimality_gap{};
+		std::int64_t					m_upper_bound{};
+	
+	public:
+		static constexpr std::uint32_t const UNASSIGNED{UINT32_MAX};
+		
+		// Compute the bids in the given queue. Serial if nullptr.
+		void set_queue(dispatch_queue_t queue) { m_queue = queue; }
+		
+		// Accepted relative difference between the objective and its upper bound.
+		void set_optimality_gap(double const gap) { m_optimality_gap = gap; }
+		
+		// Find an assignment of (approximately) maximum total weight. weights has size × size elements in
+		// row-major order. Stores the column of each row to dst and returns the total weight.
+		std::int64_t solve(weight_type const *weights, std::size_t const size, matching_vector &dst);
+		
+		// Upper bound for the total weight from the dual solution of the previous call to solve().
+		std::int64_t upper_bound() const { return m_upper_bound; }
+	
+	protected:
+		template <typename t_fn>
+		void apply(std::size_t const count, std::size_t const work_per_item, t_fn &&fn) const;
+		
+		void run_phase(weight_type const *weights, std::size_t const size, price_type const scale, price_type const epsilon);
+		void calculate_bid(weight_type const *weights, std::size_t const size, price_type const scale, price_type const epsilon, std::size_t const bidder_idx);
+		std::int64_t dual_upper_bound(weight_type const *weights, std::size_t const size, price_type const scale);
+	};
+}
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_BENCHMARK_GREEDY_HH
+#define FOUNDER_SEQUENCES_BENCHMARK_GREEDY_HH
+
+#include <cstdint>
+#include <libbio/sequence_reader/sequence_reader.hh>
+
+
+namespace founder_sequences {
+
+	void benchmark_greedy(
+		char const *input_path,
+		libbio::sequence_reader::input_format const input_format,
+		std::size_t const segment_length
+	);
+}
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_BENCHMARK_RMQ_HH
+#define FOUNDER_SEQUENCES_BENCHMARK_RMQ_HH
+
+#include <cstdint>
+#include <libbio/sequence_reader/sequence_reader.hh>
+
+
+namespace founder_sequences {
+
+	struct rmq_benchmark_parameters
+	{
+		std::size_t			sample_rate{};
+		std::size_t			query_count{};
+		std::size_t			max_query_length{};		// Zero for no limit.
+		std::uint_fast32_t	random_seed{};
+	};
+	
+	void benchmark_rmq(
+		char const *input_path,
+		libbio::sequence_reader::input_format const input_format,
+		rmq_benchmark_parameters const &parameters
+	);
+}
+
+#endif
@@ -7,6 +7,7 @@
 #define FOUNDER_SEQUENCES_BIPARTITE_MATCHER_HH
 
 #include <atomic>
+#include <deque>
 #include <founder_sequences/founder_sequences.hh>
 #include <founder_sequences/matcher.hh>
 #include <founder_sequences/merge_segments_task.hh>
@@ -23,6 +24,7 @@ namespace founder_sequences
 	struct bipartite_matcher_delegate : public virtual matcher_delegate
 	{
 		virtual void matcher_did_finish(bipartite_matcher &matcher) = 0;
+		virtual bool should_keep_segment_texts() const = 0;	// If false, only a representative of each streamed text is kept after matching.
 	};
 	
 	
@@ -35,14 +37,18 @@ namespace founder_sequences
 		libbio::dispatch_ptr <dispatch_queue_t>		m_producer_queue;
 		libbio::dispatch_ptr <dispatch_queue_t>		m_consumer_queue;
 		std::vector <std::unique_ptr <task>>		m_tasks;
-		std::vector <matching_vector> 				m_matchings;
+		std::deque <matching_vector> 				m_matchings;
 		segment_text_matrix							m_segment_texts;
+		std::deque <std::atomic_uint8_t>			m_pending_matching_counts;	// For each streamed segment.
 		
 		// For merge_segments_tasks.
 		std::vector <std::uint32_t>					m_segment_text_permutation;
+		std::atomic_int64_t							m_matching_weight{};
+		std::atomic_int64_t							m_matching_weight_upper_bound{};
 		
 		substring_copy_number_matrix const			*m_substrings_to_output{};
 		bipartite_matcher_delegate					*m_delegate{};
+		bool										m_should_release_segment_texts{};
 		
 	public:
 		bipartite_matcher(
@@ -58,12 +64,20 @@ namespace founder_sequences
 		
 		void match() override;
 		void output_segments(std::ostream &stream, sequence_vector const &sequences) override;
-		void task_did_finish(merge_segments_task &task) override {}; // No-op.
+		void task_did_finish(merge_segments_task &task) override;
 		
 	protected:
+		void create_segment_texts_from_stream();
 		void create_initial_permutation();
 		void start_matching_tasks();
+		merge_segments_task &add_merge_segments_task(std::size_t const task_idx);
+		void segment_did_finish_matching(segment_text_vector &segment_texts, std::atomic_uint8_t &pending_matching_count) const;
 		void create_permutations_and_notify();
+		void create_permutations();
+		void compose_matchings(std::size_t const begin, std::size_t const end, matching_vector &dst) const;
+		void fill_permutations(std::size_t const begin, std::size_t const end, matching_vector &segment_text_permutation) const;
+		void log_matching_tasks() const;
+		void log_matching_weight() const;
 	};
 }
 
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_COMPRESSED_PBWT_SAMPLE_HH
+#define FOUNDER_SEQUENCES_COMPRESSED_PBWT_SAMPLE_HH
+
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/pbwt_sample_scratch_file.hh>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// A PBWT sample with the permutation and the divergence stored in a compact form.
+	// The permutation is bit-packed to the number of bits needed for the sequence indices. The divergence is stored
+	// as the distance from the sample position, which is typically much smaller than the position itself, and bit-packed
+	// to the number of bits needed for the greatest distance. Optionally both are compressed with deflate.
+	// The compressed data may also be moved to a scratch file, in which case only the offset is kept in memory.
+	class compressed_pbwt_sample
+	{
+	protected:
+		pbwt_sample_type			m_sample;				// Without the permutation and the divergence.
+		permutation_vector			m_permutation;
+		permutation_vector			m_divergence_distances;
+		std::vector <std::uint8_t>	m_deflated_data;		// Both of the above when deflated.
+		pbwt_sample_scratch_file	*m_scratch_file{};		// Not serialized.
+		std::uint64_t				m_spilled_offset{};
+		std::uint64_t				m_spilled_length{};
+		std::uint64_t				m_size{};
+		std::uint8_t				m_permutation_width{};
+		std::uint8_t				m_divergence_width{};
+		bool						m_is_deflated{false};
+		bool						m_is_spilled{false};
+	
+	public:
+		compressed_pbwt_sample() = default;
+		compressed_pbwt_sample(pbwt_sample_type &&sample, bool const should_deflate);
+		
+		std::size_t sequence_idx() const { return m_sample.sequence_idx(); }
+		std::uint64_t size_in_bytes() const;
+		bool is_spilled() const { return m_is_spilled; }
+		
+		// Move the compressed data to the scratch file, which needs to remain valid until the data has been restored.
+		void spill(pbwt_sample_scratch_file &scratch_file);
+		
+		// Read the compressed data back from the scratch file.
+		void unspill();
+		
+		// Restore the permutation and the divergence to dst. Spilled data are read from the mapping if the scratch file
+		// has been mapped. Does not modify this object, so the sample may be decompressed again.
+		void decompress(pbwt_sample_type &dst) const;
+		
+		template <typename t_archive>
+		void serialize(t_archive &ar, unsigned int const version);
+	
+	protected:
+		std::vector <std::uint64_t> packed_words() const;
+		void set_packed_words(std::uint64_t const *words);
+		void deflate();
+		std::vector <std::uint64_t> inflate(std::uint8_t const *data, std::size_t const length) const;
+		void unpack(std::uint64_t const *permutation_words, std::uint64_t const *divergence_words, pbwt_sample_type &dst) const;
+	};
+	
+	
+	template <typename t_archive>
+	void compressed_pbwt_sample::serialize(t_archive &ar, unsigned int const version)
+	{
+		// Spilled samples need to be restored before serializing.
+		assert(!m_is_spilled);
+		
+		ar & m_sample;
+		ar & m_permutation;
+		ar & m_divergence_distances;
+		ar & m_deflated_data;
+		ar & m_size;
+		ar & m_permutation_width;
+		ar & m_divergence_width;
+		ar & m_is_deflated;
+	}
+}
+
+#endif
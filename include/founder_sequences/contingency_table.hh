@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_CONTINGENCY_TABLE_HH
+#define FOUNDER_SEQUENCES_CONTINGENCY_TABLE_HH
+
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/segment_text.hh>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Numbers of sequences shared by the distinct substrings of two adjacent segments, i.e. the sizes of
+	// the intersections of their sequence index sets. Since the distinct substrings of a segment partition
+	// the sequences, the table may be built with one pass over the sequences in O(m + nnz) time.
+	// Only the non-zero cells are stored; the rows of the copied segment texts are empty.
+	class contingency_table
+	{
+	public:
+		struct cell
+		{
+			std::uint32_t	rhs_idx{};
+			std::uint32_t	count{};
+			
+			cell() = default;
+			
+			cell(std::uint32_t const rhs_idx_, std::uint32_t const count_):
+				rhs_idx(rhs_idx_),
+				count(count_)
+			{
+			}
+		};
+	
+	protected:
+		std::vector <cell>			m_cells;			// Non-zero cells of each lhs row.
+		std::vector <std::size_t>	m_row_offsets;
+		std::vector <std::uint32_t>	m_rhs_rows;			// Scratch, rhs row of each sequence.
+		std::vector <std::uint32_t>	m_counts;			// Scratch, indexed by rhs row.
+	
+	public:
+		void build(segment_text_vector const &lhs, segment_text_vector const &rhs);
+		
+		std::size_t row_count() const { return m_row_offsets.size() - 1; }
+		std::size_t nonzero_count() const { return m_cells.size(); }
+		
+		// Non-zero cells of the given lhs row.
+		std::span <cell const> row(std::size_t const lhs_idx) const
+		{
+			return std::span <cell const>(m_cells.data() + m_row_offsets[lhs_idx], m_row_offsets[1 + lhs_idx] - m_row_offsets[lhs_idx]);
+		}
+	};
+}
+
+#endif
@@ -45,6 +45,10 @@ namespace founder_sequences {
 		}
 		
 		void execute() override;
+		
+		// The sequence indices are only scattered to the texts, so the time is linear in the sequence count and
+		// the maximum segment size, which are the same for every segment. Hence these tasks are not scheduled by cost.
+		std::uint64_t estimated_cost() const override { return m_seq_count + m_max_segment_size; }
 	};
 }
 
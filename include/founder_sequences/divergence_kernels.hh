@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_DIVERGENCE_KERNELS_HH
+#define FOUNDER_SEQUENCES_DIVERGENCE_KERNELS_HH
+
+#include <cstdint>
+#include <founder_sequences/founder_sequences.hh>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Count the divergence values greater than lb. Uses AVX-512 or AVX2 if the processor supports them.
+	std::size_t count_divergence_values_greater_than(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb);
+	
+	// Store the indices of the divergence values greater than lb to dst in increasing order.
+	void find_divergence_values_greater_than(std::uint32_t const *values, std::size_t const size, std::uint32_t const lb, std::vector <std::uint32_t> &dst);
+	
+	
+	// sdsl::int_vector <32> stores the values as 32-bit integers in the native byte order.
+	inline std::uint32_t const *divergence_data(pbwt_sample_type const &sample)
+	{
+		return reinterpret_cast <std::uint32_t const *>(sample.input_divergence().data());
+	}
+	
+	
+	// Number of distinct substrings in [lb, sample.sequence_idx()), i.e. the number of runs of sequences in
+	// the PBWT order whose divergence value is greater than lb. Same as pbwt_context::unique_substring_count_lhs().
+	inline std::size_t count_distinct_substrings(pbwt_sample_type const &sample, std::size_t const lb)
+	{
+		auto const &divergence(sample.input_divergence());
+		return count_divergence_values_greater_than(divergence_data(sample), divergence.size(), lb);
+	}
+	
+	
+	// Store the first sequence index of each run and the length of the run to dst. Returns the number of runs.
+	// Same as pbwt_context::unique_substring_count_idxs_lhs(); t_dst needs to provide emplace_back(idx, count).
+	template <typename t_dst>
+	std::size_t find_distinct_substrings(pbwt_sample_type const &sample, std::size_t const lb, std::vector <std::uint32_t> &run_starts, t_dst &dst)
+	{
+		auto const &permutation(sample.input_permutation());
+		auto const &divergence(sample.input_divergence());
+		auto const size(divergence.size());
+		
+		run_starts.clear();
+		find_divergence_values_greater_than(divergence_data(sample), size, lb, run_starts);
+		
+		dst.clear();
+		auto const run_count(run_starts.size());
+		for (std::size_t i(0); i < run_count; ++i)
+		{
+			auto const begin(run_starts[i]);
+			auto const end(1 + i < run_count ? run_starts[1 + i] : size);
+			dst.emplace_back(permutation[begin], end - begin);
+		}
+		
+		return run_count;
+	}
+	
+	
+	template <typename t_dst>
+	std::size_t find_distinct_substrings(pbwt_sample_type const &sample, std::size_t const lb, t_dst &dst)
+	{
+		std::vector <std::uint32_t> run_starts;
+		return find_distinct_substrings(sample, lb, run_starts, dst);
+	}
+}
+
+#endif
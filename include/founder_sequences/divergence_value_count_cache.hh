@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_DIVERGENCE_VALUE_COUNT_CACHE_HH
+#define FOUNDER_SEQUENCES_DIVERGENCE_VALUE_COUNT_CACHE_HH
+
+#include <cassert>
+#include <cstdint>
+#include <founder_sequences/pbwt_sample_scratch_file.hh>
+#include <utility>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Stores the divergence value counts of each processed column in one contiguous vector.
+	// The counts do not depend on the segment length bound, so the DP may be run multiple times
+	// without re-calculating the PBWT. The pairs may be moved to a scratch file while adding the columns,
+	// in which case they are accessed from the mapped file after all of them have been spilled.
+	class divergence_value_count_cache
+	{
+	public:
+		typedef std::pair <std::uint32_t, std::uint32_t>	value_count_pair;
+		
+		// Provides the same interface as pbwt_context::divergence_count_list for the DP.
+		class counts_view
+		{
+		protected:
+			value_count_pair const	*m_begin{};
+			value_count_pair const	*m_end{};
+		
+		public:
+			counts_view() = default;
+			
+			counts_view(value_count_pair const *begin, value_count_pair const *end):
+				m_begin(begin),
+				m_end(end)
+			{
+			}
+			
+			value_count_pair const *cbegin_pairs() const { return m_begin; }
+			value_count_pair const *cend_pairs() const { return m_end; }
+			std::size_t size() const { return m_end - m_begin; }
+		};
+	
+	protected:
+		std::vector <value_count_pair>	m_pairs;				// The pairs not spilled yet.
+		std::vector <std::size_t>		m_offsets{0};
+		value_count_pair const			*m_mapped_pairs{};		// All of the pairs after map_spilled().
+		std::size_t						m_spilled_pair_count{};
+	
+	public:
+		// Append the counts of the next column.
+		template <typename t_counts>
+		void push_back(t_counts const &counts);
+		
+		counts_view operator[](std::size_t const idx) const;
+		std::size_t size() const { return m_offsets.size() - 1; }
+		std::size_t pair_count() const { return m_spilled_pair_count + m_pairs.size(); }
+		std::uint64_t memory_size() const { return m_pairs.size() * sizeof(value_count_pair) + m_offsets.size() * sizeof(std::size_t); }
+		
+		// Append the pairs stored in memory to the scratch file, which may not be used for anything else.
+		void spill(pbwt_sample_scratch_file &scratch_file);
+		
+		// Spill the remaining pairs and map the scratch file for operator[].
+		void map_spilled(pbwt_sample_scratch_file &scratch_file);
+		
+		void clear();
+		void shrink_to_fit() { m_pairs.shrink_to_fit(); m_offsets.shrink_to_fit(); }
+	};
+	
+	
+	template <typename t_counts>
+	void divergence_value_count_cache::push_back(t_counts const &counts)
+	{
+		auto it(counts.cbegin_pairs());
+		auto const end(counts.cend_pairs());
+		while (it != end)
+		{
+			m_pairs.emplace_back(it->first, it->second);
+			++it;
+		}
+		m_offsets.push_back(m_spilled_pair_count + m_pairs.size());
+	}
+	
+	
+	inline auto divergence_value_count_cache::operator[](std::size_t const idx) const -> counts_view
+	{
+		assert(1 + idx < m_offsets.size());
+		assert(m_mapped_pairs || 0 == m_spilled_pair_count);
+		auto const *data(m_mapped_pairs ? m_mapped_pairs : m_pairs.data());
+		return counts_view(data + m_offsets[idx], data + m_offsets[1 + idx]);
+	}
+	
+	
+	inline void divergence_value_count_cache::spill(pbwt_sample_scratch_file &scratch_file)
+	{
+		assert(!m_mapped_pairs);
+		if (m_pairs.empty())
+			return;
+		
+		auto const *begin(reinterpret_cast <std::uint8_t const *>(m_pairs.data()));
+		pbwt_sample_scratch_file::buffer_type buffer(begin, begin + m_pairs.size() * sizeof(value_count_pair));
+		auto const offset(scratch_file.append_async(std::move(buffer)));
+		assert(offset == m_spilled_pair_count * sizeof(value_count_pair));
+		
+		m_spilled_pair_count += m_pairs.size();
+		m_pairs.clear();
+	}
+	
+	
+	inline void divergence_value_count_cache::map_spilled(pbwt_sample_scratch_file &scratch_file)
+	{
+		spill(scratch_file);
+		m_pairs.shrink_to_fit();
+		scratch_file.map();
+		m_mapped_pairs = reinterpret_cast <value_count_pair const *>(scratch_file.mapped_data());
+	}
+	
+	
+	inline void divergence_value_count_cache::clear()
+	{
+		m_pairs.clear();
+		m_offsets.clear();
+		m_offsets.push_back(0);
+		m_mapped_pairs = nullptr;
+		m_spilled_pair_count = 0;
+	}
+}
+
+#endif
@@ -6,6 +6,7 @@
 #ifndef FOUNDER_SEQUENCES_FOUNDER_SEQUENCES_HH
 #define FOUNDER_SEQUENCES_FOUNDER_SEQUENCES_HH
 
+#include <founder_sequences/range_maximum.hh>
 #include <libbio/cxxcompat.hh>
 #include <libbio/consecutive_alphabet.hh>
 #include <libbio/dispatch.hh>
@@ -16,18 +17,31 @@
 #include <vector>
 
 
+// Values for FOUNDER_SEQUENCES_PBWT_RMQ, which may be set with PBWT_RMQ when building (see README.md).
+#define FOUNDER_SEQUENCES_PBWT_RMQ_SCT			1	// Succinct, sdsl::range_maximum_sct.
+#define FOUNDER_SEQUENCES_PBWT_RMQ_SPARSE_TABLE	2	// Plain sparse table.
+#define FOUNDER_SEQUENCES_PBWT_RMQ_BLOCK		3	// Sparse table over blocks.
+#define FOUNDER_SEQUENCES_PBWT_RMQ_DYNAMIC		4	// libbio::pbwt::dynamic_pbwt_rmq.
+
+#ifndef FOUNDER_SEQUENCES_PBWT_RMQ
+#	define FOUNDER_SEQUENCES_PBWT_RMQ FOUNDER_SEQUENCES_PBWT_RMQ_SCT
+#endif
+
+
 namespace founder_sequences {
 	
 	enum class running_mode : std::uint8_t {
 		GENERATE_FOUNDERS = 0,
-		STORE_SEGMENTATION
+		STORE_SEGMENTATION,
+		ESTIMATE_SEGMENT_SIZES
 	};
 	
 	enum class segment_joining : std::uint8_t {
 		GREEDY = 0,
 		BIPARTITE_MATCHING,
 		RANDOM,
-		PBWT_ORDER
+		PBWT_ORDER,
+		HYBRID		// Bipartite matching, exact or approximate depending on the segment pair.
 	};
 	
 	enum class bipartite_set_scoring : std::uint8_t {
@@ -35,6 +49,14 @@ namespace founder_sequences {
 		INTERSECTION
 	};
 	
+	enum class matching_backend : std::uint8_t {
+		DENSE_ASSIGNMENT = 0,
+		LEMON,
+		SPARSE_FLOW,
+		AUCTION,
+		GREEDY
+	};
+	
 	typedef std::span <std::uint8_t const>					sequence;
 	typedef std::vector <std::uint32_t>						matching_vector;
 	typedef std::vector <sequence>							sequence_vector;
@@ -52,12 +74,24 @@ namespace founder_sequences {
 		sdsl::int_vector <32>,				/* character_index_vector */
 		sdsl::int_vector <32>				/* string_index_vector */
 	> pbwt_rmq;
+	
+	// Range maximum query support for the divergence values, selected with FOUNDER_SEQUENCES_PBWT_RMQ.
+#if FOUNDER_SEQUENCES_PBWT_RMQ == FOUNDER_SEQUENCES_PBWT_RMQ_SCT
+	typedef sdsl::range_maximum_sct <>::type							pbwt_ci_rmq;
+#elif FOUNDER_SEQUENCES_PBWT_RMQ == FOUNDER_SEQUENCES_PBWT_RMQ_SPARSE_TABLE
+	typedef sparse_table_rmq <sdsl::int_vector <32>>					pbwt_ci_rmq;
+#elif FOUNDER_SEQUENCES_PBWT_RMQ == FOUNDER_SEQUENCES_PBWT_RMQ_BLOCK
+	typedef block_sparse_table_rmq <sdsl::int_vector <32>>				pbwt_ci_rmq;
+#elif FOUNDER_SEQUENCES_PBWT_RMQ == FOUNDER_SEQUENCES_PBWT_RMQ_DYNAMIC
+	typedef pbwt_rmq													pbwt_ci_rmq;
+#else
+#	error "Unknown value for FOUNDER_SEQUENCES_PBWT_RMQ."
+#endif
 
 	typedef libbio::pbwt::pbwt_context <
 		sequence_vector,					/* sequence_vector */
 		alphabet_type,						/* alphabet_type */
-		//pbwt_rmq,							/* ci_rmq */
-		sdsl::range_maximum_sct <>::type,	/* ci_rmq */
+		pbwt_ci_rmq,						/* ci_rmq */
 		sdsl::int_vector <32>,				/* string_index_vector */
 		sdsl::int_vector <32>,				/* character_index_vector */
 		sdsl::int_vector <32>,				/* count_vector */
@@ -71,6 +105,9 @@ namespace founder_sequences {
 	{
 		virtual ~task() {}
 		virtual void execute() = 0;
+		
+		// Approximate running time relative to other tasks of the same kind, for scheduling.
+		virtual std::uint64_t estimated_cost() const = 0;
 	};
 }
 
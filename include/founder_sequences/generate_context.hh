@@ -8,6 +8,9 @@
 
 #include <founder_sequences/founder_sequences.hh>
 #include <founder_sequences/join_context.hh>
+#include <founder_sequences/segment_length_search_context.hh>
+#include <founder_sequences/segment_size_estimation_context.hh>
+#include <founder_sequences/segmentation_cache.hh>
 #include <founder_sequences/segmentation_dp_arg.hh>
 #include <founder_sequences/segmentation_lp_context.hh>
 #include <founder_sequences/segmentation_sp_context.hh>
@@ -65,12 +68,51 @@ namespace founder_sequences { namespace detail {
 		using progress_indicator_lp_data_source::progress_indicator_lp_data_source;
 		void progress_log_extra() const override {}
 	};
+	
+	class progress_indicator_sls_data_source final : public progress_indicator_data_source
+	{
+	protected:
+		segment_length_search_context	*m_context{};
+		
+	public:
+		progress_indicator_sls_data_source() = default;
+		progress_indicator_sls_data_source(segment_length_search_context &ctx):
+			m_context(&ctx)
+		{
+		}
+		
+		std::size_t progress_step_max() const override { return m_context->step_max(); }
+		std::size_t progress_current_step() const override { return m_context->current_step(); }
+		void progress_log_extra() const override {}
+	};
+	
+	class progress_indicator_sse_data_source final : public progress_indicator_data_source
+	{
+	protected:
+		segment_size_estimation_context	*m_context{};
+		
+	public:
+		progress_indicator_sse_data_source() = default;
+		progress_indicator_sse_data_source(segment_size_estimation_context &ctx):
+			m_context(&ctx)
+		{
+		}
+		
+		std::size_t progress_step_max() const override { return m_context->step_max(); }
+		std::size_t progress_current_step() const override { return m_context->current_step(); }
+		void progress_log_extra() const override {}
+	};
 }}
 
 
 namespace founder_sequences {
 	
-	class generate_context final : public segmentation_lp_context_delegate, public segmentation_sp_context_delegate, public join_context_delegate
+	class generate_context final :
+		public segmentation_lp_context_delegate,
+		public segmentation_sp_context_delegate,
+		public segment_length_search_context_delegate,
+		public segment_size_estimation_context_delegate,
+		public join_context_delegate
 	{
 		friend class detail::progress_indicator_gc_data_source;
 		
@@ -94,18 +136,45 @@ namespace founder_sequences {
 		std::atomic_uint32_t											m_current_step{};
 		std::atomic_uint32_t											m_step_max{};
 		
+		segment_size_estimation_parameters								m_estimation_parameters{};
+		
+		std::unique_ptr <segmentation_cache>							m_segmentation_cache;
+		std::uint64_t													m_input_hash{};
+		
+		std::string														m_checkpoint_directory;
+		std::chrono::seconds											m_checkpoint_interval{};
+		bool															m_should_resume_from_checkpoint{false};
+		
+		std::string														m_pbwt_sample_scratch_directory;
+		
+		// For the sample-free mode.
+		std::unique_ptr <pbwt_sample_channel>							m_sample_channel;
+		segmentation_container											m_streamed_container;
+		bool															m_is_sample_free{false};
+		
 		std::size_t														m_segment_length{};
+		std::uint32_t													m_max_founder_count{};
+		segmentation_traceback_vector									m_precalculated_traceback_dp;	// From the segment length bound search.
 		std::uint64_t													m_pbwt_sample_rate{};
+		std::uint64_t													m_memory_limit{};
+		std::uint64_t													m_pbwt_sample_memory_budget{};
+		bool															m_should_deflate_pbwt_samples{false};
+		bool															m_uses_lazy_pbwt_snapshots{false};
 		std::uint_fast32_t												m_random_seed{};
 		running_mode													m_running_mode{};
 		segment_joining													m_segment_joining_method{};
 		bipartite_set_scoring											m_bipartite_set_scoring{};
+		matching_backend												m_bipartite_matching_backend{};
+		double															m_auction_optimality_gap{};
+		std::uint32_t													m_hybrid_matching_threshold{};
+		matching_backend												m_hybrid_approximate_backend{matching_backend::GREEDY};
 		bool															m_use_single_thread{false};
 	
 	public:
 		generate_context(
 			running_mode const mode,
 			std::size_t const segment_length,
+			std::uint32_t const max_founder_count,
 			segment_joining const segment_joining_method,
 			bipartite_set_scoring const bipartite_set_scoring,
 			std::uint64_t const pbwt_sample_rate,
@@ -113,6 +182,7 @@ namespace founder_sequences {
 			bool const use_single_thread
 		):
 			m_segment_length(segment_length),
+			m_max_founder_count(max_founder_count),
 			m_pbwt_sample_rate(pbwt_sample_rate),
 			m_random_seed(random_seed),
 			m_running_mode(mode),
@@ -130,26 +200,63 @@ namespace founder_sequences {
 		alphabet_type const &alphabet() const override { return m_alphabet; }
 		std::size_t segment_length() const override { return m_segment_length; }
 		std::uint64_t pbwt_sample_rate() const override { return m_pbwt_sample_rate; }
+		std::uint64_t pbwt_sample_memory_budget() const override { return m_pbwt_sample_memory_budget; }
+		bool should_deflate_pbwt_samples() const override { return m_should_deflate_pbwt_samples; }
+		std::string const &pbwt_sample_scratch_directory() const override { return m_pbwt_sample_scratch_directory; }
+		bool should_use_lazy_pbwt_snapshots() const override { return m_uses_lazy_pbwt_snapshots; }
 		std::ostream &sequence_output_stream() override { return (m_founders_ostream.is_open() ? m_founders_ostream : std::cout); }
 		std::ostream &segments_output_stream() override { return *m_segments_ostream_ptr; }
+		bool should_output_segments() const override { return nullptr != m_segments_ostream_ptr; }
 		bipartite_set_scoring bipartite_set_scoring_method() const override { return m_bipartite_set_scoring; }
+		matching_backend bipartite_matching_backend() const override { return m_bipartite_matching_backend; }
+		double auction_optimality_gap() const override { return m_auction_optimality_gap; }
+		std::uint32_t hybrid_matching_threshold() const override { return m_hybrid_matching_threshold; }
+		matching_backend hybrid_approximate_backend() const override { return m_hybrid_approximate_backend; }
 		bool should_run_single_threaded() const override { return m_use_single_thread; }
 
 		void context_did_finish_traceback(segmentation_sp_context &ctx) override;
 		
+		void context_will_search_segment_length(segment_length_search_context &ctx) override;
+		void context_did_evaluate_segment_length(
+			segment_length_search_context &ctx,
+			std::size_t const step,
+			std::size_t const segment_length,
+			std::uint32_t const max_segment_size,
+			std::chrono::duration <double> const &duration
+		) override;
+		void context_did_finish_search(segment_length_search_context &ctx, std::size_t const segment_length, std::uint32_t const max_segment_size) override;
+		
+		void context_did_finish_estimation(segment_size_estimation_context &ctx) override;
+		
 		void context_will_follow_traceback(segmentation_lp_context &ctx) override;
 		void context_did_finish_traceback(segmentation_lp_context &ctx, std::size_t const segment_count, std::size_t const max_segment_size) override;
+		void context_will_exceed_pbwt_sample_memory_budget(segmentation_lp_context &ctx, std::uint64_t const required_bytes) override;
 		void context_will_start_update_samples_tasks(segmentation_lp_context &ctx) override;
 		void context_did_start_update_samples_tasks(segmentation_lp_context &ctx) override;
 		void context_did_update_pbwt_samples_to_traceback_positions(segmentation_lp_context &ctx) override;
 		void context_will_merge_segments(segmentation_lp_context &ctx) override;
 		void context_did_merge_segments(segmentation_lp_context &ctx, segmentation_container &&container) override;
+		void context_did_find_reduced_segment(segmentation_lp_context &ctx, segmentation_dp_arg const &dp_arg, pbwt_sample_type &&sample) override;
+		void context_did_finish_second_pass(segmentation_lp_context &ctx) override;
 		
 		void join_segments_and_output(segmentation_container &&container);
 		
 		void context_will_output_founders(join_context &ctx) override;
 		void context_did_output_founders(join_context &ctx) override;
 		
+		void set_estimation_parameters(segment_size_estimation_parameters const &parameters) { m_estimation_parameters = parameters; }
+		void set_checkpoint_parameters(char const *directory, std::chrono::seconds const interval, bool const should_resume);
+		void set_cache_directory(char const *directory);
+		void set_memory_limit(std::uint64_t const limit) { m_memory_limit = limit; }
+		void set_deflates_pbwt_samples(bool const should_deflate) { m_should_deflate_pbwt_samples = should_deflate; }
+		void set_scratch_directory(char const *directory) { m_pbwt_sample_scratch_directory = (directory ? directory : ""); }
+		void set_sample_free(bool const is_sample_free) { m_is_sample_free = is_sample_free; }
+		void set_uses_lazy_pbwt_snapshots(bool const uses_lazy_snapshots) { m_uses_lazy_pbwt_snapshots = uses_lazy_snapshots; }
+		void set_bipartite_matching_backend(matching_backend const backend) { m_bipartite_matching_backend = backend; }
+		void set_auction_optimality_gap(double const gap) { m_auction_optimality_gap = gap; }
+		void set_hybrid_matching_threshold(std::uint32_t const threshold) { m_hybrid_matching_threshold = threshold; }
+		void set_hybrid_approximate_backend(matching_backend const backend) { m_hybrid_approximate_backend = backend; }
+		
 		void prepare(
 			char const *segmentation_input_path,
 			char const *segmentation_output_path,
@@ -169,13 +276,22 @@ namespace founder_sequences {
 		void load_input(char const *input_path, libbio::sequence_reader::input_format const input_file_format);
 		void check_input() const;
 		void generate_alphabet_and_continue();
+		void fit_sample_rate_to_memory_limit();
 		void generate_founders(std::size_t const lb, std::size_t const rb);
 	
+		void search_segment_length_and_continue();
+		void estimate_segment_sizes();
 		void calculate_segmentation(std::size_t const lb, std::size_t const rb);
 		void calculate_segmentation_short_path(std::size_t const lb, std::size_t const rb);
 		void calculate_segmentation_long_path(std::size_t const lb, std::size_t const rb);
 		
 		void check_traceback_size(segmentation_context &ctx);
+		bool can_stream_reduced_segments() const;
+		void start_second_pass(segmentation_lp_context &ctx, std::size_t const max_segment_size);
+		
+		segmentation_cache_key cache_key() const;
+		bool load_cached_segmentation(segmentation_container &container);
+		void store_cached_segmentation(segmentation_container const &container);
 		
 		void load_segmentation_from_file(segmentation_container &container);
 		void save_segmentation_to_file(segmentation_container const &container);
@@ -88,6 +88,8 @@ namespace founder_sequences
 		void output_segments(std::ostream &stream, sequence_vector const &sequences) override;
 		
 	protected:
+		void match_sequential();
+		void match_parallel();	// Needs all of the samples at once.
 	};
 }
 
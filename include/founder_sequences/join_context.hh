@@ -8,6 +8,7 @@
 
 #include <founder_sequences/bipartite_matcher.hh>
 #include <founder_sequences/greedy_matcher.hh>
+#include <founder_sequences/pbwt_sample_channel.hh>
 #include <founder_sequences/segmentation_container.hh>
 #include <founder_sequences/segmentation_context.hh>
 #include <libbio/dispatch.hh>
@@ -22,6 +23,7 @@ namespace founder_sequences {
 	{
 		virtual void context_will_output_founders(join_context &ctx) = 0;
 		virtual void context_did_output_founders(join_context &ctx) = 0;
+		virtual bool should_output_segments() const = 0;
 	};
 	
 	
@@ -33,6 +35,13 @@ namespace founder_sequences {
 		
 		segmentation_container								m_segmentation_container{};
 		std::uint_fast32_t									m_random_seed{};
+		segment_joining										m_segment_joining{};
+		
+		// For taking the PBWT samples one at a time.
+		pbwt_sample_channel									*m_sample_channel{};	// If set, the samples are streamed.
+		libbio::dispatch_ptr <dispatch_queue_t>				m_stream_queue;			// For consuming the streamed samples.
+		pbwt_sample_type									m_current_sample;
+		std::size_t											m_next_sample_idx{};
 		
 		// For matching.
 		substring_copy_number_matrix						m_substring_copy_numbers;
@@ -59,6 +68,25 @@ namespace founder_sequences {
 		{
 		}
 		
+		// Take the reduced traceback and the PBWT samples from the channel as they are produced.
+		join_context(
+			join_context_delegate &delegate,
+			libbio::dispatch_ptr <dispatch_queue_t> &producer_queue,
+			libbio::dispatch_ptr <dispatch_queue_t> &consumer_queue,
+			pbwt_sample_channel &sample_channel,
+			std::uint32_t const max_segment_size,
+			std::uint_fast32_t const random_seed
+		):
+			m_producer_queue(producer_queue),
+			m_consumer_queue(consumer_queue),
+			m_random_seed(random_seed),
+			m_sample_channel(&sample_channel),
+			m_stream_queue(dispatch_queue_create("fi.iki.tsnorri.join-context-stream-queue", DISPATCH_QUEUE_SERIAL), false),
+			m_delegate(&delegate)
+		{
+			m_segmentation_container.max_segment_size = max_segment_size;
+		}
+		
 		void cleanup() { delete this; }
 		
 		void join_segments_and_output(segment_joining const seg_joining);
@@ -69,17 +97,35 @@ namespace founder_sequences {
 		std::uint32_t sequence_count() const override { return m_delegate->sequence_count(); }
 		std::uint32_t max_segment_size() const override { return m_segmentation_container.max_segment_size; }
 		std::vector <pbwt_sample_type> const &pbwt_samples() const override { return m_segmentation_container.reduced_pbwt_samples; }
+		pbwt_sample_type const *next_pbwt_sample() override;
+		bool is_streaming_pbwt_samples() const override { return nullptr != m_sample_channel; }
 		segmentation_traceback_vector const &reduced_traceback() const override { return m_segmentation_container.reduced_traceback; }
 		permutation_matrix &permutations() override { return m_permutations; }
 		bipartite_set_scoring bipartite_set_scoring_method() const override { return m_delegate->bipartite_set_scoring_method(); }
+		matching_backend bipartite_matching_backend() const override { return m_delegate->bipartite_matching_backend(); }
+		double auction_optimality_gap() const override { return m_delegate->auction_optimality_gap(); }
+		std::uint32_t hybrid_matching_threshold() const override;
+		matching_backend hybrid_approximate_backend() const override { return m_delegate->hybrid_approximate_backend(); }
+		bool should_run_single_threaded() const override { return m_delegate->should_run_single_threaded(); }
+		bool should_keep_segment_texts() const override { return m_delegate->should_output_segments(); }
 		
 		void matcher_did_finish(bipartite_matcher &matcher) override;
 		void matcher_did_finish(greedy_matcher &matcher) override;
 
 	protected:
 		void make_cumulative_sum(substring_copy_number_vector &vec) const;
+		void calculate_substring_copy_numbers(
+			segmentation_dp_arg const &dp_arg,
+			pbwt_sample_type const &sample,
+			substring_copy_number_vector &substring_cn
+		) const;
 		
 		void init_permutations();
+		permutation_vector make_permutation() const;
+		
+		void join_streamed_segments();
+		void start_joining();
+		void output_founders_in_permutation_order();
 		
 		void join_greedy();
 		void join_with_bipartite_matching();
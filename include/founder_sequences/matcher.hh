@@ -26,10 +26,17 @@ namespace founder_sequences {
 	
 		virtual libbio::dispatch_ptr <dispatch_queue_t> producer_queue() const = 0;	// Copy b.c. the pointer manages a reference counted object.
 		virtual libbio::dispatch_ptr <dispatch_queue_t> consumer_queue() const = 0;
-		virtual std::vector <pbwt_sample_type> const &pbwt_samples() const = 0;		// Reduced PBWT samples.
+		virtual std::vector <pbwt_sample_type> const &pbwt_samples() const = 0;		// Reduced PBWT samples, empty if streamed.
+		virtual pbwt_sample_type const *next_pbwt_sample() = 0;						// Reduced PBWT samples in order, nullptr after the last one. Invalidates the previous one.
+		virtual bool is_streaming_pbwt_samples() const = 0;							// If true, only next_pbwt_sample() may be used and it may block.
 		virtual segmentation_traceback_vector const &reduced_traceback() const = 0;
 		virtual permutation_matrix &permutations() = 0;
 		virtual bipartite_set_scoring bipartite_set_scoring_method() const = 0;
+		virtual matching_backend bipartite_matching_backend() const = 0;
+		virtual double auction_optimality_gap() const = 0;
+		virtual std::uint32_t hybrid_matching_threshold() const = 0;		// Segment pairs with more pairs of substrings that have common sequences are matched approximately.
+		virtual matching_backend hybrid_approximate_backend() const = 0;
+		virtual bool should_run_single_threaded() const = 0;
 	
 		virtual std::uint32_t sequence_count() const = 0;
 		virtual std::uint32_t max_segment_size() const = 0;
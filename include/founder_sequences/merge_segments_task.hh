@@ -7,6 +7,9 @@
 #define FOUNDER_SEQUENCES_MERGE_SEGMENTS_TASK_HH
 
 #include <atomic>
+#include <chrono>
+#include <dispatch/dispatch.h>
+#include <founder_sequences/contingency_table.hh>
 #include <founder_sequences/founder_sequences.hh>
 #include <founder_sequences/segment_text.hh>
 #include <founder_sequences/substring_copy_number.hh>
@@ -31,9 +34,9 @@ namespace founder_sequences {
 	{
 	protected:
 		typedef int32_t																weight_type;
+		typedef std::vector <weight_type>											weight_matrix_type;	// Row-major.
 		typedef lemon::FullBpGraph													graph_type;
 		typedef int32_t																edge_cost_type;
-		typedef std::vector <edge_cost_type>										edge_cost_vector_type;
 		typedef graph_type::EdgeMap <edge_cost_type>								edge_cost_map_type;
 		typedef lemon::MaxWeightedPerfectMatching <graph_type, edge_cost_map_type>	matching_type;	// No bipartite algorithms in Lemon 1.3.1.
 		
@@ -43,7 +46,16 @@ namespace founder_sequences {
 		segment_text_vector				*m_rhs{};
 		matching_vector					*m_matching{};
 		std::size_t						m_task_idx{};
+		dispatch_queue_t				m_auction_queue{};		// Not owned, may be nullptr.
+		std::int64_t					m_matching_weight{};
+		std::int64_t					m_matching_weight_upper_bound{};
+		std::size_t						m_shared_pair_count{};	// Pairs of distinct substrings with common sequences.
+		std::chrono::duration <double>	m_duration{};
+		double							m_auction_optimality_gap{};
+		std::uint32_t					m_hybrid_threshold{UINT32_MAX};
 		bipartite_set_scoring			m_bipartite_set_scoring_method{};
+		matching_backend				m_matching_backend{};
+		matching_backend				m_approximate_backend{};
 		
 	public:
 		merge_segments_task() = default;
@@ -54,47 +66,50 @@ namespace founder_sequences {
 			segment_text_vector &lhs,
 			segment_text_vector &rhs,
 			matching_vector &matching,
-			bipartite_set_scoring bipartite_set_scoring_method
+			bipartite_set_scoring bipartite_set_scoring_method,
+			matching_backend backend,
+			matching_backend approximate_backend,
+			std::uint32_t hybrid_threshold,
+			double auction_optimality_gap,
+			dispatch_queue_t auction_queue
 		):
 			m_delegate(&delegate),
 			m_lhs(&lhs),
 			m_rhs(&rhs),
 			m_matching(&matching),
 			m_task_idx(task_idx),
-			m_bipartite_set_scoring_method(bipartite_set_scoring_method)
+			m_auction_queue(auction_queue),
+			m_auction_optimality_gap(auction_optimality_gap),
+			m_hybrid_threshold(hybrid_threshold),
+			m_bipartite_set_scoring_method(bipartite_set_scoring_method),
+			m_matching_backend(backend),
+			m_approximate_backend(approximate_backend)
 		{
 		}
 		
+		// Number of distinct substrings on the larger side of the pair.
+		static std::size_t distinct_text_count(segment_text_vector const &lhs, segment_text_vector const &rhs);
+		
 		std::size_t task_index() const { return m_task_idx; }
+		std::size_t distinct_text_count() const { return distinct_text_count(*m_lhs, *m_rhs); }
+		std::size_t shared_pair_count() const { return m_shared_pair_count; }
+		matching_backend backend() const { return m_matching_backend; }	// The approximate one if it was chosen when executing.
+		std::chrono::duration <double> const &duration() const { return m_duration; }
+		std::int64_t matching_weight() const { return m_matching_weight; }
+		std::int64_t matching_weight_upper_bound() const { return m_matching_weight_upper_bound; }	// Equal to the weight unless approximated.
 		void execute() override;
+		std::uint64_t estimated_cost() const override;
 		
 	protected:
-		inline std::size_t edge_id(
-			graph_type const &graph,
-			std::size_t const li,
-			std::size_t const ri
-		);
-		
-		void copy_edge_weight(
-			graph_type const &graph,
-			edge_cost_vector_type &edge_costs,
-			std::size_t const li,
-			std::size_t const ri,
-			std::size_t const source_li,
-			std::size_t const source_ri
-		);
-		
-		void calculate_edge_weight(
-			graph_type const &graph,
-			edge_cost_vector_type &edge_costs,
-			std::size_t const li,
-			std::size_t const ri
-		);
+		weight_type intersection_weight_multiplier() const;
+		std::int64_t text_size_weight() const;
+		void calculate_edge_weights(contingency_table const &table, weight_type const sign, weight_matrix_type &weights) const;
 		
-		weight_type find_minimum_cost_matching(
-			graph_type const &graph,
-			edge_cost_map_type const &edge_costs
-		);
+		std::int64_t find_maximum_weight_matching_dense(weight_matrix_type const &costs);
+		std::int64_t find_maximum_weight_matching_lemon(weight_matrix_type const &weights);
+		std::int64_t find_maximum_weight_matching_sparse(contingency_table const &table);
+		std::int64_t find_maximum_weight_matching_auction(weight_matrix_type const &weights);
+		std::int64_t find_maximum_weight_matching_greedy(contingency_table const &table);
 	};
 }
 
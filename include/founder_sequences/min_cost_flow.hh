@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_MIN_COST_FLOW_HH
+#define FOUNDER_SEQUENCES_MIN_COST_FLOW_HH
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Minimum cost flow with successive shortest paths. The shortest paths are found with Dijkstra's algorithm
+	// using node potentials, so the edge costs need to be non-negative. Each edge is stored together with its
+	// reverse edge s.t. the reverse of edge e is e ^ 1.
+	class min_cost_flow
+	{
+	public:
+		typedef std::uint32_t	capacity_type;
+		typedef std::int64_t	cost_type;
+	
+	protected:
+		struct edge
+		{
+			std::uint32_t	target{};
+			capacity_type	capacity{};		// Residual.
+			cost_type		cost{};
+			
+			edge() = default;
+			
+			edge(std::uint32_t const target_, capacity_type const capacity_, cost_type const cost_):
+				target(target_),
+				capacity(capacity_),
+				cost(cost_)
+			{
+			}
+		};
+	
+	protected:
+		std::vector <edge>							m_edges;
+		std::vector <std::vector <std::uint32_t>>	m_adjacency;			// Edge indices by source node.
+		std::vector <cost_type>						m_potentials;
+		std::vector <cost_type>						m_distances;
+		std::vector <std::uint32_t>					m_previous_edges;
+	
+	public:
+		explicit min_cost_flow(std::size_t const node_count):
+			m_adjacency(node_count)
+		{
+		}
+		
+		// Add an edge and return its index.
+		std::size_t add_edge(std::uint32_t const source, std::uint32_t const target, capacity_type const capacity, cost_type const cost);
+		
+		// Flow on the edge with the given index.
+		capacity_type flow(std::size_t const edge_idx) const { return m_edges[edge_idx ^ 1].capacity; }
+		
+		// Send at most the given amount of flow from source to sink. Returns the amount of flow sent and its cost.
+		std::pair <capacity_type, cost_type> solve(std::uint32_t const source, std::uint32_t const sink, capacity_type const amount);
+	
+	protected:
+		bool find_shortest_path(std::uint32_t const source, std::uint32_t const sink);
+	};
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_PBWT_SAMPLE_CHANNEL_HH
+#define FOUNDER_SEQUENCES_PBWT_SAMPLE_CHANNEL_HH
+
+#include <condition_variable>
+#include <deque>
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/segmentation_dp_arg.hh>
+#include <mutex>
+
+
+namespace founder_sequences {
+
+	// Bounded queue for passing the PBWT samples at the reduced segment boundaries from the second PBWT pass
+	// to the segment joining step. Both push() and pop() block, so the producer and the consumer need to
+	// be executed on different threads.
+	class pbwt_sample_channel final
+	{
+	protected:
+		typedef std::pair <segmentation_dp_arg, pbwt_sample_type>	item_type;
+	
+	protected:
+		std::mutex					m_mutex;
+		std::condition_variable		m_cv;
+		std::deque <item_type>		m_items;
+		std::size_t					m_capacity{};
+		bool						m_is_closed{false};
+	
+	public:
+		explicit pbwt_sample_channel(std::size_t const capacity):
+			m_capacity(capacity)
+		{
+		}
+		
+		// Wait until there is space for the sample.
+		void push(segmentation_dp_arg const &dp_arg, pbwt_sample_type &&sample);
+		
+		// Called by the producer after the last sample.
+		void close();
+		
+		// Wait for the next sample. Returns false if the channel was closed and all samples have been taken.
+		bool pop(segmentation_dp_arg &dp_arg, pbwt_sample_type &sample);
+	};
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_PBWT_SAMPLE_SCRATCH_FILE_HH
+#define FOUNDER_SEQUENCES_PBWT_SAMPLE_SCRATCH_FILE_HH
+
+#include <atomic>
+#include <libbio/dispatch.hh>
+#include <string>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Temporary file for storing the PBWT samples outside the main memory. The data are appended asynchronously
+	// on a serial queue of its own and read back by mapping the file to memory after all of it has been written.
+	// The file is removed from the directory immediately after creating it.
+	class pbwt_sample_scratch_file final
+	{
+	public:
+		typedef std::vector <std::uint8_t>		buffer_type;
+	
+	protected:
+		libbio::dispatch_ptr <dispatch_queue_t>	m_queue;
+		libbio::dispatch_ptr <dispatch_group_t>	m_group;
+		std::uint64_t							m_size{};						// Accessed only on the producer queue.
+		std::atomic_uint64_t					m_pending_bytes{};
+		std::uint8_t const						*m_mapped_data{};
+		std::size_t								m_mapped_size{};
+		int										m_fd{-1};
+	
+	public:
+		explicit pbwt_sample_scratch_file(std::string const &directory);
+		~pbwt_sample_scratch_file();
+		
+		pbwt_sample_scratch_file(pbwt_sample_scratch_file const &) = delete;
+		pbwt_sample_scratch_file &operator=(pbwt_sample_scratch_file const &) = delete;
+		
+		// Reserve space for the buffer at the end of the file and write it asynchronously. Returns the offset of the data.
+		std::uint64_t append_async(buffer_type &&buffer);
+		
+		// Read the data from the mapping or, if the file has not been mapped yet, with pread. The data need to have been written.
+		void read(std::uint64_t const offset, std::size_t const length, std::uint8_t *dst) const;
+		
+		// Number of bytes passed to append_async but not yet written.
+		std::uint64_t pending_bytes() const { return m_pending_bytes.load(std::memory_order_relaxed); }
+		
+		// Wait for the pending writes to finish.
+		void wait();
+		
+		// Wait for the pending writes and map the file to memory for reading. May be called only once.
+		void map();
+		std::uint8_t const *mapped_data() const { return m_mapped_data; }
+		bool is_mapped() const { return nullptr != m_mapped_data; }
+	};
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_RANGE_MAXIMUM_HH
+#define FOUNDER_SEQUENCES_RANGE_MAXIMUM_HH
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Range maximum query support for the divergence arrays with the same interface as sdsl::range_maximum_sct <>::type,
+	// i.e. the support is constructed from a pointer to the values and operator()(lb, rb) returns the position of
+	// a maximum in the closed range [lb, rb]. The values may not be modified while the support is in use.
+	// Both of the classes below return the leftmost maximum.
+	
+	// Sparse table with the position of the maximum of each range of length 2^k. Uses O(n log n) words of memory
+	// but answers each query by comparing two values.
+	template <typename t_vector>
+	class sparse_table_rmq
+	{
+	protected:
+		t_vector const				*m_values{};
+		std::vector <std::uint32_t>	m_table;			// Levels 1, 2, … concatenated; level 0 would be the identity.
+		std::vector <std::size_t>	m_level_offsets;
+		std::size_t					m_size{};
+	
+	public:
+		sparse_table_rmq() = default;
+		explicit sparse_table_rmq(t_vector const *values);
+		
+		std::size_t size() const { return m_size; }
+		std::size_t operator()(std::size_t const lb, std::size_t const rb) const;
+	
+	protected:
+		std::size_t max_pos(std::size_t const lhs, std::size_t const rhs) const { return ((*m_values)[rhs] > (*m_values)[lhs] ? rhs : lhs); }
+		static std::size_t floor_log2(std::size_t const val) { assert(val); return 63 - __builtin_clzll(val); }
+	};
+	
+	
+	// Sparse table over the block maxima. The parts of the query range that do not cover a whole block are scanned.
+	// Uses O((n / t_block_size) log (n / t_block_size)) words of memory, which makes the construction faster and
+	// keeps the table in the cache for larger inputs.
+	template <typename t_vector, std::size_t t_block_size = 64>
+	class block_sparse_table_rmq
+	{
+		static_assert(0 < t_block_size);
+	
+	protected:
+		t_vector const				*m_values{};
+		std::vector <std::uint32_t>	m_table;			// Levels 0, 1, … concatenated; level 0 has the block maxima.
+		std::vector <std::size_t>	m_level_offsets;
+		std::size_t					m_size{};
+	
+	public:
+		block_sparse_table_rmq() = default;
+		explicit block_sparse_table_rmq(t_vector const *values);
+		
+		std::size_t size() const { return m_size; }
+		std::size_t operator()(std::size_t const lb, std::size_t const rb) const;
+	
+	protected:
+		std::size_t max_pos(std::size_t const lhs, std::size_t const rhs) const { return ((*m_values)[rhs] > (*m_values)[lhs] ? rhs : lhs); }
+		std::size_t scan(std::size_t const lb, std::size_t const rb) const;
+		static std::size_t floor_log2(std::size_t const val) { assert(val); return 63 - __builtin_clzll(val); }
+	};
+	
+	
+	template <typename t_vector>
+	sparse_table_rmq <t_vector>::sparse_table_rmq(t_vector const *values):
+		m_values(values),
+		m_size(values->size())
+	{
+		if (m_size < 2)
+			return;
+		
+		// Reserve space for all the levels.
+		auto const level_count(floor_log2(m_size));
+		{
+			std::size_t total_size(0);
+			for (std::size_t k(1); k <= level_count; ++k)
+				total_size += m_size - (std::size_t(1) << k) + 1;
+			m_table.reserve(total_size);
+			m_level_offsets.reserve(level_count);
+		}
+		
+		// Level 1 from the values, the remaining levels from the previous one.
+		m_level_offsets.push_back(0);
+		for (std::size_t i(0), count(m_size - 1); i < count; ++i)
+			m_table.push_back(max_pos(i, 1 + i));
+		
+		for (std::size_t k(2); k <= level_count; ++k)
+		{
+			auto const prev_offset(m_level_offsets.back());
+			auto const half(std::size_t(1) << (k - 1));
+			auto const count(m_size - (std::size_t(1) << k) + 1);
+			m_level_offsets.push_back(m_table.size());
+			for (std::size_t i(0); i < count; ++i)
+				m_table.push_back(max_pos(m_table[prev_offset + i], m_table[prev_offset + i + half]));
+		}
+	}
+	
+	
+	template <typename t_vector>
+	std::size_t sparse_table_rmq <t_vector>::operator()(std::size_t const lb, std::size_t const rb) const
+	{
+		assert(lb <= rb);
+		assert(rb < m_size);
+		
+		if (lb == rb)
+			return lb;
+		
+		auto const k(floor_log2(rb - lb + 1));
+		auto const offset(m_level_offsets[k - 1]);
+		return max_pos(m_table[offset + lb], m_table[offset + rb + 1 - (std::size_t(1) << k)]);
+	}
+	
+	
+	template <typename t_vector, std::size_t t_block_size>
+	block_sparse_table_rmq <t_vector, t_block_size>::block_sparse_table_rmq(t_vector const *values):
+		m_values(values),
+		m_size(values->size())
+	{
+		if (0 == m_size)
+			return;
+		
+		auto const block_count((m_size + t_block_size - 1) / t_block_size);
+		auto const level_count(1 + floor_log2(block_count));
+		{
+			std::size_t total_size(0);
+			for (std::size_t k(0); k < level_count; ++k)
+				total_size += block_count - (std::size_t(1) << k) + 1;
+			m_table.reserve(total_size);
+			m_level_offsets.reserve(level_count);
+		}
+		
+		// Level 0 from the blocks.
+		m_level_offsets.push_back(0);
+		for (std::size_t i(0); i < block_count; ++i)
+		{
+			auto const lb(i * t_block_size);
+			auto const rb(std::min(m_size, lb + t_block_size) - 1);
+			m_table.push_back(scan(lb, rb));
+		}
+		
+		for (std::size_t k(1); k < level_count; ++k)
+		{
+			auto const prev_offset(m_level_offsets.back());
+			auto const half(std::size_t(1) << (k - 1));
+			auto const count(block_count - (std::size_t(1) << k) + 1);
+			m_level_offsets.push_back(m_table.size());
+			for (std::size_t i(0); i < count; ++i)
+				m_table.push_back(max_pos(m_table[prev_offset + i], m_table[prev_offset + i + half]));
+		}
+	}
+	
+	
+	template <typename t_vector, std::size_t t_block_size>
+	std::size_t block_sparse_table_rmq <t_vector, t_block_size>::scan(std::size_t const lb, std::size_t const rb) const
+	{
+		auto retval(lb);
+		for (std::size_t i(1 + lb); i <= rb; ++i)
+			retval = max_pos(retval, i);
+		return retval;
+	}
+	
+	
+	template <typename t_vector, std::size_t t_block_size>
+	std::size_t block_sparse_table_rmq <t_vector, t_block_size>::operator()(std::size_t const lb, std::size_t const rb) const
+	{
+		assert(lb <= rb);
+		assert(rb < m_size);
+		
+		// Blocks that are completely inside the range.
+		auto const first_block((lb + t_block_size - 1) / t_block_size);
+		auto const block_limit((1 + rb) / t_block_size);
+		if (block_limit <= first_block)
+			return scan(lb, rb);
+		
+		auto const block_lb(first_block * t_block_size);
+		auto const block_rb(block_limit * t_block_size);	// Past the end.
+		
+		auto const k(floor_log2(block_limit - first_block));
+		auto const offset(m_level_offsets[k]);
+		auto retval(max_pos(m_table[offset + first_block], m_table[offset + block_limit - (std::size_t(1) << k)]));
+		
+		// Check the partial blocks. The left one is checked first s.t. the leftmost maximum is returned.
+		if (lb < block_lb)
+		{
+			auto const pos(scan(lb, block_lb - 1));
+			if (! ((*m_values)[pos] < (*m_values)[retval]))
+				retval = pos;
+		}
+		
+		if (block_rb <= rb)
+			retval = max_pos(retval, scan(block_rb, rb));
+		
+		return retval;
+	}
+}
+
+#endif
@@ -50,7 +50,11 @@ namespace founder_sequences {
 		void set_values(t_values const &values) { m_values = &values; }
 		void update(std::size_t last_idx);
 		std::size_t operator()(std::size_t beg, std::size_t end) const;
-	
+
+		// The values are not stored; set_values needs to be called after loading.
+		template <typename t_archive>
+		void serialize(t_archive &ar, unsigned int const version) { ar & m_precalc; }
+
 	protected:
 		std::size_t naive_min(std::size_t first, std::size_t last) const;
 	};
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_SEGMENT_LENGTH_SEARCH_CONTEXT_HH
+#define FOUNDER_SEQUENCES_SEGMENT_LENGTH_SEARCH_CONTEXT_HH
+
+#include <atomic>
+#include <chrono>
+#include <founder_sequences/segment_size_calculator.hh>
+#include <founder_sequences/segmentation_context.hh>
+#include <libbio/dispatch.hh>
+
+
+namespace founder_sequences {
+
+	class segment_length_search_context;
+	
+	
+	struct segment_length_search_context_delegate : public virtual segmentation_context_delegate
+	{
+		virtual void context_will_search_segment_length(segment_length_search_context &ctx) = 0;
+		virtual void context_did_evaluate_segment_length(
+			segment_length_search_context &ctx,
+			std::size_t const step,
+			std::size_t const segment_length,
+			std::uint32_t const max_segment_size,
+			std::chrono::duration <double> const &duration
+		) = 0;
+		
+		// segment_length is zero if no segment length bound produces few enough founders.
+		virtual void context_did_finish_search(segment_length_search_context &ctx, std::size_t const segment_length, std::uint32_t const max_segment_size) = 0;
+	};
+	
+	
+	// Find the greatest segment length bound s.t. the maximum segment size, i.e. the number of founders,
+	// does not exceed the given limit. The PBWT is calculated only once with segment_size_calculator;
+	// each search step consists of running the DP with the stored divergence value counts.
+	// The maximum segment size is non-decreasing w.r.t. the segment length bound, since any segmentation
+	// with segments not shorter than L + 1 is also a valid segmentation w.r.t. L.
+	// The DP vector of the found bound is kept s.t. its traceback may be followed directly.
+	class segment_length_search_context final
+	{
+	protected:
+		segment_size_calculator							m_calculator;
+		segmentation_traceback_vector					m_probe_traceback_dp;
+		segmentation_traceback_vector					m_found_traceback_dp;
+		libbio::dispatch_ptr <dispatch_queue_t>			m_queue;
+		std::uint32_t									m_max_founder_count{};
+		
+		// For status update.
+		std::atomic_size_t								m_step_max{};
+		std::atomic_size_t								m_current_step{};
+		
+		segment_length_search_context_delegate			*m_delegate{};
+	
+	public:
+		segment_length_search_context(
+			segment_length_search_context_delegate &delegate,
+			libbio::dispatch_ptr <dispatch_queue_t> &queue,
+			std::uint32_t const max_founder_count
+		):
+			m_calculator(delegate.sequences(), delegate.alphabet()),
+			m_queue(queue),
+			m_max_founder_count(max_founder_count),
+			m_delegate(&delegate)
+		{
+		}
+		
+		void cleanup() { delete this; }
+		
+		void search();
+		
+		std::uint32_t max_founder_count() const { return m_max_founder_count; }
+		bool uses_stored_divergence_value_counts() const { return m_calculator.uses_cache(); }
+		
+		// Need to be called before search.
+		void set_divergence_value_count_memory_limit(std::uint64_t const limit) { m_calculator.set_cache_memory_limit(limit); }
+		void set_scratch_directory(std::string const &directory) { m_calculator.set_scratch_directory(directory); }
+		
+		// The DP vector of the found segment length bound, empty if the segmentation consists of one segment.
+		segmentation_traceback_vector &traceback_dp() { return m_found_traceback_dp; }
+		
+		// For status update.
+		std::size_t step_max() const { return m_step_max; }
+		std::size_t current_step() const { return m_current_step.load(std::memory_order_relaxed); }
+	
+	protected:
+		std::uint32_t evaluate_segment_length(std::size_t const step, std::size_t const segment_length);
+	};
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_SEGMENT_SIZE_CALCULATOR_HH
+#define FOUNDER_SEQUENCES_SEGMENT_SIZE_CALCULATOR_HH
+
+#include <algorithm>
+#include <founder_sequences/divergence_value_count_cache.hh>
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/pbwt_sample_scratch_file.hh>
+#include <founder_sequences/segmentation_dp_arg.hh>
+#include <memory>
+#include <string>
+
+
+namespace founder_sequences {
+
+	// Calculate the maximum segment size of an optimal segmentation for multiple segment length bounds.
+	// The PBWT is calculated once and the divergence value counts of each column are stored,
+	// after which each bound only requires running the DP with the stored counts. If the counts
+	// would exceed the memory limit, they are moved to a scratch file if a directory has been given.
+	// Otherwise the PBWT is stopped and recalculated for each bound instead.
+	class segment_size_calculator final
+	{
+	protected:
+		sequence_vector const			*m_sequences{};
+		alphabet_type const				*m_alphabet{};
+		pbwt_context					m_pbwt_ctx;
+		divergence_value_count_cache	m_divergence_value_counts;
+		std::string						m_scratch_directory;
+		std::unique_ptr <pbwt_sample_scratch_file>	m_scratch_file;
+		std::uint64_t					m_cache_memory_limit{};
+		std::size_t						m_sequence_length{};
+		std::uint32_t					m_sequence_count{};
+		bool							m_uses_cache{true};
+	
+	public:
+		// By default, the stored counts may take as much memory as the input.
+		segment_size_calculator(sequence_vector const &sequences, alphabet_type const &alphabet):
+			m_sequences(&sequences),
+			m_alphabet(&alphabet),
+			m_pbwt_ctx(sequences, alphabet, libbio::pbwt::context_field::DIVERGENCE_VALUE_COUNTS),
+			m_sequence_length(sequences.empty() ? 0 : sequences.front().size()),
+			m_sequence_count(sequences.size())
+		{
+			m_cache_memory_limit = m_sequence_count * m_sequence_length;
+		}
+		
+		// Calculate the PBWT; the callback is called with the index of each processed column.
+		template <typename t_callback>
+		void fill_divergence_value_counts(t_callback &&callback);
+		
+		std::uint32_t calculate_max_segment_size(std::size_t const segment_length) const;
+		
+		// Also return the DP vector s.t. the traceback of the bound may be followed without running the DP again.
+		// The vector is left empty if the segmentation consists of one segment.
+		std::uint32_t calculate_max_segment_size(std::size_t const segment_length, segmentation_traceback_vector &traceback_dp) const;
+		
+		std::size_t sequence_length() const { return m_sequence_length; }
+		std::uint32_t sequence_count() const { return m_sequence_count; }
+		bool uses_cache() const { return m_uses_cache; }
+		
+		// Need to be called before fill_divergence_value_counts.
+		void set_cache_memory_limit(std::uint64_t const limit) { m_cache_memory_limit = limit; }
+		void set_scratch_directory(std::string const &directory) { m_scratch_directory = directory; }
+		
+		void clear() { m_divergence_value_counts.clear(); m_divergence_value_counts.shrink_to_fit(); m_scratch_file.reset(); }
+	};
+	
+	
+	template <typename t_callback>
+	void segment_size_calculator::fill_divergence_value_counts(t_callback &&callback)
+	{
+		// Sampling is not needed.
+		clear();
+		m_uses_cache = true;
+		m_pbwt_ctx.set_sample_rate(std::numeric_limits <std::uint64_t>::max());
+		m_pbwt_ctx.prepare();
+		
+		// Process the columns in chunks s.t. the memory use may be checked.
+		std::size_t const chunk_size(4096);
+		while (m_pbwt_ctx.sequence_idx() < m_sequence_length)
+		{
+			auto const chunk_limit(std::min(m_sequence_length, m_pbwt_ctx.sequence_idx() + chunk_size));
+			m_pbwt_ctx.process <libbio::pbwt::context_field::DIVERGENCE_VALUE_COUNTS>(
+				chunk_limit,
+				[this, &callback](){
+					auto const idx(m_pbwt_ctx.sequence_idx());
+					assert(m_divergence_value_counts.size() == idx);
+					m_divergence_value_counts.push_back(m_pbwt_ctx.output_divergence_value_counts());
+					callback(idx);
+				}
+			);
+			
+			if (m_cache_memory_limit < m_divergence_value_counts.memory_size())
+			{
+				// Without a scratch file, the remaining columns need not be processed.
+				if (m_scratch_directory.empty())
+				{
+					m_uses_cache = false;
+					clear();
+					break;
+				}
+				
+				// Wait for the previous chunk to be written s.t. at most two of them are kept in memory.
+				if (m_scratch_file)
+					m_scratch_file->wait();
+				else
+					m_scratch_file.reset(new pbwt_sample_scratch_file(m_scratch_directory));
+				
+				m_divergence_value_counts.spill(*m_scratch_file);
+			}
+		}
+		
+		// The PBWT is no longer needed.
+		m_pbwt_ctx.set_fields_in_use(libbio::pbwt::context_field::NONE);
+		m_pbwt_ctx.clear_unused_fields();
+		
+		if (m_scratch_file)
+			m_divergence_value_counts.map_spilled(*m_scratch_file);
+		
+		assert(!m_uses_cache || m_divergence_value_counts.size() == m_sequence_length);
+		m_divergence_value_counts.shrink_to_fit();
+	}
+}
+
+#endif
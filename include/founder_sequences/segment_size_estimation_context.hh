@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_SEGMENT_SIZE_ESTIMATION_CONTEXT_HH
+#define FOUNDER_SEQUENCES_SEGMENT_SIZE_ESTIMATION_CONTEXT_HH
+
+#include <atomic>
+#include <founder_sequences/segment_size_calculator.hh>
+#include <founder_sequences/segmentation_context.hh>
+#include <libbio/dispatch.hh>
+#include <ostream>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	class segment_size_estimation_context;
+	
+	
+	struct segment_size_estimation_parameters
+	{
+		std::size_t			row_count{};				// Zero for all rows.
+		std::size_t			window_length{};			// Zero for the whole sequence length.
+		std::size_t			replicates{1};
+		std::size_t			first_segment_length{1};
+		std::size_t			last_segment_length{1};		// Inclusive.
+		std::size_t			segment_length_step{1};
+		std::uint_fast32_t	random_seed{};
+	};
+	
+	
+	struct segment_size_estimate
+	{
+		std::size_t			segment_length{};
+		double				mean{};
+		double				standard_deviation{};
+		double				standard_error{};
+		std::uint32_t		min{};
+		std::uint32_t		max{};
+	};
+	
+	
+	struct segment_size_estimation_context_delegate : public virtual segmentation_context_delegate
+	{
+		virtual void context_did_finish_estimation(segment_size_estimation_context &ctx) = 0;
+	};
+	
+	
+	// Estimate the maximum segment size as a function of the segment length bound by running the DP
+	// on subsamples of the input. Each subsample (replicate) consists of a random subset of the rows
+	// and a window of the columns; the windows are placed at regular intervals. The replicates are
+	// processed in parallel and the PBWT is calculated only once for each of them.
+	class segment_size_estimation_context final
+	{
+	protected:
+		struct replicate
+		{
+			sequence_vector					sequences;
+			std::vector <std::uint32_t>		max_segment_sizes;
+		};
+	
+	protected:
+		std::vector <replicate>						m_replicates;
+		std::vector <std::size_t>					m_segment_lengths;
+		std::vector <segment_size_estimate>			m_estimates;
+		segment_size_estimation_parameters			m_parameters;
+		libbio::dispatch_ptr <dispatch_queue_t>		m_queue;
+		
+		// For status update.
+		std::atomic_size_t							m_step_max{};
+		std::atomic_size_t							m_current_step{};
+		
+		segment_size_estimation_context_delegate	*m_delegate{};
+	
+	public:
+		segment_size_estimation_context(
+			segment_size_estimation_context_delegate &delegate,
+			libbio::dispatch_ptr <dispatch_queue_t> &queue,
+			segment_size_estimation_parameters const &parameters
+		):
+			m_parameters(parameters),
+			m_queue(queue),
+			m_delegate(&delegate)
+		{
+		}
+		
+		void cleanup() { delete this; }
+		
+		void estimate();
+		std::vector <segment_size_estimate> const &estimates() const { return m_estimates; }
+		segment_size_estimation_parameters const &parameters() const { return m_parameters; }
+		void output_estimates(std::ostream &os) const;
+		
+		// For status update.
+		std::size_t step_max() const { return m_step_max; }
+		std::size_t current_step() const { return m_current_step.load(std::memory_order_relaxed); }
+	
+	protected:
+		void prepare_replicates();
+		void process_replicate(replicate &rep);
+		void calculate_estimates();
+	};
+}
+
+#endif
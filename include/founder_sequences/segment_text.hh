@@ -6,52 +6,88 @@
 #ifndef FOUNDER_SEQUENCES_SEGMENT_TEXT_HH
 #define FOUNDER_SEQUENCES_SEGMENT_TEXT_HH
 
+#include <cassert>
+#include <deque>
 #include <founder_sequences/founder_sequences.hh>
+#include <libbio/cxxcompat.hh>
 #include <ostream>
-#include <string>
 #include <vector>
 
 
 namespace founder_sequences {
+
+	class segment_text_vector;
 	
-	struct segment_text;
-	
-	typedef std::vector <segment_text>			segment_text_vector;
-	typedef std::vector <segment_text_vector>	segment_text_matrix;
+	// A deque so that the texts of the previous segments remain in place while the following ones are added.
+	typedef std::deque <segment_text_vector>	segment_text_matrix;
 	
 	
-	struct segment_text final
+	// The texts of one segment. The distinct substrings come first and their sequence indices are stored
+	// consecutively in one array (CSR). The remaining rows are copies, which only store the row of the
+	// distinct substring in question.
+	class segment_text_vector
 	{
-		std::vector <std::size_t>	sequence_indices;
-		std::size_t					copied_from{SIZE_MAX};
+	public:
+		typedef std::uint32_t						sequence_index;
+		typedef std::span <sequence_index const>	sequence_index_span;
+	
+	protected:
+		std::vector <sequence_index>	m_sequence_indices;		// Sorted within each text.
+		std::vector <std::uint32_t>		m_offsets{0};			// Start of each distinct text in m_sequence_indices.
+		std::vector <std::uint32_t>		m_copied_from;			// Source row of each copied text.
+	
+	public:
+		std::size_t size() const { return distinct_size() + m_copied_from.size(); }
+		std::size_t distinct_size() const { return m_offsets.size() - 1; }
 		
-		segment_text() = default;
+		bool is_copied(std::size_t const row) const { return distinct_size() <= row; }
+		std::size_t copied_from(std::size_t const row) const { assert(is_copied(row)); return m_copied_from[row - distinct_size()]; }
+		std::size_t row_number(std::size_t const row) const { return (is_copied(row) ? copied_from(row) : row); }
 		
-		segment_text(std::size_t copied_from_): copied_from(copied_from_) {}
+		// Sequence indices of the given row, empty for the copied texts.
+		inline sequence_index_span sequence_indices(std::size_t const row) const;
 		
-		bool is_copied() const { return SIZE_MAX != copied_from; }
-		std::size_t first_sequence_index() const { return sequence_indices.front(); }
-		std::uint32_t sequence_count() const { return sequence_indices.size(); }
-		std::size_t row_number(std::size_t const row) const { return (SIZE_MAX == copied_from ? row : copied_from); }
+		// Sequence indices of all of the distinct texts.
+		sequence_index_span sequence_indices() const { return sequence_index_span(m_sequence_indices); }
 		
-		// Write the text to the stream.
-		void write_text(
-			std::ostream &os,
-			segment_text_vector const &slice,
-			std::size_t const pos,
-			std::size_t const length,
-			sequence_vector const &sequences
-		) const;
+		std::uint32_t sequence_count(std::size_t const row) const { return sequence_indices(row).size(); }
+		std::size_t first_sequence_index(std::size_t const row) const { assert(!is_copied(row)); return m_sequence_indices[m_offsets[row]]; }
 		
-		// For statistics.
-		void write(
+		void clear();
+		void reserve(std::size_t const distinct_count, std::size_t const seq_count, std::size_t const size);
+		
+		// Add a distinct text with the given number of sequences and return the space for the sequence indices.
+		// Needs to be called before adding the copies.
+		std::span <sequence_index> add_text(std::size_t const seq_count);
+		
+		// Sequence indices of all of the distinct texts for filling them after the texts have been added.
+		std::span <sequence_index> mutable_sequence_indices() { return std::span <sequence_index>(m_sequence_indices); }
+		
+		// Add copies of the given distinct text.
+		void add_copies(std::size_t const row, std::size_t const count);
+		
+		// Keep only the first sequence index of each distinct text and release the others.
+		// The texts may still be written but the sequence counts are no longer valid.
+		void retain_first_sequence_indices();
+		
+		// Write the text of the given row to the stream.
+		void write_text(
 			std::ostream &os,
-			segment_text_vector const &slice,
+			std::size_t const row,
 			std::size_t const pos,
 			std::size_t const length,
 			sequence_vector const &sequences
 		) const;
 	};
+	
+	
+	auto segment_text_vector::sequence_indices(std::size_t const row) const -> sequence_index_span
+	{
+		if (is_copied(row))
+			return sequence_index_span();
+		
+		return sequence_index_span(m_sequence_indices.data() + m_offsets[row], m_offsets[1 + row] - m_offsets[row]);
+	}
 }
 
 #endif
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_SEGMENTATION_CACHE_HH
+#define FOUNDER_SEQUENCES_SEGMENTATION_CACHE_HH
+
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/segmentation_container.hh>
+#include <string>
+
+
+namespace founder_sequences {
+
+	// Non-cryptographic 64-bit hash, processes eight bytes at a time.
+	std::uint64_t hash_bytes(std::uint8_t const *data, std::size_t const length, std::uint64_t const seed);
+	
+	// Hash the sequences in parallel and combine the hashes in order.
+	std::uint64_t hash_sequences(sequence_vector const &sequences);
+	
+	// Same as above but only the given number of columns from the start of each sequence.
+	std::uint64_t hash_sequence_prefixes(sequence_vector const &sequences, std::size_t const length);
+	
+	// Hash the serialized alphabet.
+	std::uint64_t hash_alphabet(alphabet_type const &alphabet);
+	
+	
+	struct segmentation_cache_key
+	{
+		std::uint64_t	input_hash{};
+		std::uint64_t	alphabet_hash{};
+		std::uint64_t	sequence_count{};
+		std::uint64_t	sequence_length{};
+		std::uint64_t	segment_length{};		// Zero if the bound is determined from max_founder_count.
+		std::uint64_t	max_founder_count{};	// Zero if the segment length bound was given.
+		
+		bool operator==(segmentation_cache_key const &other) const;
+		bool operator!=(segmentation_cache_key const &other) const { return !(*this == other); }
+		std::string file_name() const;
+	};
+	
+	
+	struct segmentation_cache_metadata
+	{
+		std::string		input_path;
+		std::uint64_t	creation_time{};
+	};
+	
+	
+	// Stores the segmentation containers of earlier runs in a directory, one file per key.
+	class segmentation_cache final
+	{
+	protected:
+		std::string		m_directory;
+	
+	public:
+		explicit segmentation_cache(std::string const &directory):
+			m_directory(directory)
+		{
+		}
+		
+		std::string const &directory() const { return m_directory; }
+		
+		bool load(
+			segmentation_cache_key const &key,
+			segmentation_cache_metadata &metadata,
+			segmentation_container &container
+		) const;
+		
+		// Returns false if the entry could not be written.
+		bool store(
+			segmentation_cache_key const &key,
+			segmentation_cache_metadata const &metadata,
+			segmentation_container const &container
+		) const;
+	
+	protected:
+		std::string path(segmentation_cache_key const &key) const { return m_directory + '/' + key.file_name(); }
+	};
+}
+
+
+namespace boost { namespace serialization {
+
+	template <typename t_archive>
+	void serialize(t_archive &ar, founder_sequences::segmentation_cache_key &key, unsigned int const version)
+	{
+		ar & key.input_hash;
+		ar & key.alphabet_hash;
+		ar & key.sequence_count;
+		ar & key.sequence_length;
+		ar & key.segment_length;
+		ar & key.max_founder_count;
+	}
+	
+	
+	template <typename t_archive>
+	void serialize(t_archive &ar, founder_sequences::segmentation_cache_metadata &metadata, unsigned int const version)
+	{
+		ar & metadata.input_path;
+		ar & metadata.creation_time;
+	}
+}}
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_SEGMENTATION_CHECKPOINT_HH
+#define FOUNDER_SEQUENCES_SEGMENTATION_CHECKPOINT_HH
+
+#include <atomic>
+#include <chrono>
+#include <founder_sequences/compressed_pbwt_sample.hh>
+#include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/segmentation_dp_arg.hh>
+#include <libbio/dispatch.hh>
+#include <string>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Identifies the input and the parameters s.t. a checkpoint is not resumed with a different input.
+	struct segmentation_checkpoint_header
+	{
+		std::uint64_t	sequence_count{};
+		std::uint64_t	sequence_length{};
+		std::uint64_t	segment_length{};
+		std::uint64_t	pbwt_sample_rate{};
+		std::uint64_t	lb{};
+		std::uint64_t	rb{};
+		
+		bool operator==(segmentation_checkpoint_header const &other) const;
+		bool operator!=(segmentation_checkpoint_header const &other) const { return !(*this == other); }
+		
+		// Check if other has the same sequences and parameters except for new columns appended to the sequences.
+		// The PBWT sample rate depends on the sequence length and hence is not compared.
+		bool can_be_extended_to(segmentation_checkpoint_header const &other) const;
+	};
+	
+	
+	// State of segmentation_lp_context in generate_traceback_part_3 after processing the columns up to next_column.
+	struct segmentation_checkpoint
+	{
+		segmentation_checkpoint_header					header;
+		std::uint64_t									next_column{};
+		std::uint64_t									prefix_hash{};			// Hash of the columns before next_column.
+		std::uint64_t									sample_rate{};			// Current rate, may differ from the one in the header after thinning.
+		pbwt_sample_type								pbwt_state;
+		segmentation_traceback_vector					traceback_dp;			// Prefix of the DP vector. The RMQ data structure is rebuilt from it.
+		std::vector <compressed_pbwt_sample>			pbwt_samples;			// Only the samples not written before when writing; may be spilled.
+		
+		// Check if the checkpoint was written after processing all the columns in generate_traceback_part_3.
+		// Such a checkpoint may be used to continue with new columns appended to the sequences.
+		bool is_final() const { return next_column + header.segment_length == header.rb; }
+	};
+	
+	
+	// Writes the checkpoints to a directory on a serial queue of its own s.t. the column loop is not stalled.
+	// The directory contains “samples.0” or “samples.1” to which the new PBWT samples are appended on each
+	// write, and “state” that has the remaining data, the samples file in use and the size of its valid part.
+	// After thinning, all of the samples are written to the other samples file, and the previous one is removed
+	// only after the state file has been replaced. The state file is replaced atomically and the previous one
+	// is kept as “state.prev”.
+	class segmentation_checkpoint_writer final
+	{
+	protected:
+		typedef std::chrono::steady_clock				clock_type;
+	
+	protected:
+		std::string										m_directory;
+		sequence_vector const							*m_sequences{};
+		libbio::dispatch_ptr <dispatch_queue_t>			m_queue;
+		libbio::dispatch_ptr <dispatch_group_t>			m_group;
+		clock_type::duration							m_interval{};
+		clock_type::time_point							m_previous_write_time{};
+		std::size_t										m_written_sample_count{};	// Accessed only on the producer queue.
+		std::size_t										m_written_column{};			// Accessed only on the producer queue.
+		bool											m_should_rewrite_samples{false};	// Accessed only on the producer queue.
+		std::uint64_t									m_samples_file_size{};		// Accessed only on the writer queue.
+		std::uint8_t									m_samples_file_index{};		// Accessed only on the writer queue.
+		std::atomic_bool								m_is_writing{false};
+		std::atomic_bool								m_did_fail{false};
+	
+	public:
+		segmentation_checkpoint_writer(std::string const &directory, std::chrono::seconds const interval, sequence_vector const &sequences);
+		
+		std::string const &directory() const { return m_directory; }
+		
+		// Remove the files of an earlier run.
+		void reset();
+		
+		// Continue after load_segmentation_checkpoint.
+		void set_resumed_state(
+			std::size_t const written_sample_count,
+			std::size_t const written_column,
+			std::uint8_t const samples_file_index,
+			std::uint64_t const samples_file_size
+		);
+		
+		// Rewrite the samples file on the next write since the samples written so far were changed.
+		void samples_did_change();
+		
+		// Check if enough time has passed since the previous write and the previous write has finished.
+		bool should_write() const;
+		
+		// Write the checkpoint asynchronously. traceback_dp needs to stay valid until the write has finished
+		// and the values before checkpoint.next_column - segment_length + 1 must not be modified.
+		// The spilled samples are read from scratch_file on the writer queue.
+		void write_async(
+			std::unique_ptr <segmentation_checkpoint> &&checkpoint,
+			segmentation_traceback_vector const &traceback_dp,
+			pbwt_sample_scratch_file *scratch_file
+		);
+		
+		std::size_t written_sample_count() const { return m_written_sample_count; }
+		std::size_t written_column() const { return m_written_column; }
+		bool did_fail() const { return m_did_fail.load(std::memory_order_relaxed); }
+		
+		// Wait for the pending write to finish.
+		void wait();
+	
+	protected:
+		void write(
+			segmentation_checkpoint &checkpoint,
+			segmentation_traceback_vector const &traceback_dp,
+			pbwt_sample_scratch_file *scratch_file,
+			std::size_t const sample_count,
+			bool const should_rewrite_samples
+		);
+	};
+	
+	
+	// Load the latest valid checkpoint from the given directory. The current state file is tried first, then the previous one.
+	// A final checkpoint is also accepted if the expected header has more columns. In either case, the processed columns
+	// of the given sequences need to match the hash stored in the checkpoint.
+	// On success, the samples file in use and the size of its valid part are stored to samples_file_index and samples_file_size.
+	bool load_segmentation_checkpoint(
+		std::string const &directory,
+		segmentation_checkpoint_header const &expected_header,
+		sequence_vector const &sequences,
+		segmentation_checkpoint &checkpoint,
+		std::uint8_t &samples_file_index,
+		std::uint64_t &samples_file_size
+	);
+}
+
+
+namespace boost { namespace serialization {
+
+	template <typename t_archive>
+	void serialize(t_archive &ar, founder_sequences::segmentation_checkpoint_header &header, unsigned int const version)
+	{
+		ar & header.sequence_count;
+		ar & header.sequence_length;
+		ar & header.segment_length;
+		ar & header.pbwt_sample_rate;
+		ar & header.lb;
+		ar & header.rb;
+	}
+}}
+
+#endif
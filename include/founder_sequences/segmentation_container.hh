@@ -7,6 +7,7 @@
 #define FOUNDER_SEQUENCES_SEGMENTATION_CONTAINER_HH
 
 #include <founder_sequences/founder_sequences.hh>
+#include <founder_sequences/segmentation_dp_arg.hh>
 #include <vector>
 
 
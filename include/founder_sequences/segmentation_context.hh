@@ -24,6 +24,10 @@ namespace founder_sequences {
 		virtual alphabet_type const &alphabet() const = 0;
 		virtual sequence_vector const &sequences() const = 0;
 		virtual bipartite_set_scoring bipartite_set_scoring_method() const = 0;
+		virtual matching_backend bipartite_matching_backend() const = 0;
+		virtual double auction_optimality_gap() const = 0;
+		virtual std::uint32_t hybrid_matching_threshold() const = 0;
+		virtual matching_backend hybrid_approximate_backend() const = 0;
 		virtual bool should_run_single_threaded() const = 0;
 		
 		virtual std::uint32_t sequence_count() const = 0;
@@ -7,11 +7,15 @@
 #define FOUNDER_SEQUENCES_SEGMENTATION_LP_CONTEXT_HH
 
 #include <founder_sequences/bipartite_matcher.hh>
+#include <founder_sequences/compressed_pbwt_sample.hh>
 #include <founder_sequences/greedy_matcher.hh>
+#include <founder_sequences/pbwt_sample_scratch_file.hh>
+#include <founder_sequences/segmentation_checkpoint.hh>
 #include <founder_sequences/segmentation_container.hh>
 #include <founder_sequences/segmentation_context.hh>
 #include <founder_sequences/segmentation_dp_arg.hh>
 #include <founder_sequences/substring_copy_number.hh>
+#include <founder_sequences/task_scheduler.hh>
 #include <founder_sequences/update_pbwt_task.hh>
 #include <libbio/dispatch.hh>
 
@@ -46,15 +50,24 @@ namespace founder_sequences {
 	{
 		virtual std::size_t segment_length() const = 0;
 		virtual std::uint64_t pbwt_sample_rate() const = 0;
+		virtual std::uint64_t pbwt_sample_memory_budget() const = 0; // Zero for no limit.
+		virtual bool should_deflate_pbwt_samples() const = 0;
+		virtual std::string const &pbwt_sample_scratch_directory() const = 0; // Empty for keeping the samples in memory.
+		virtual bool should_use_lazy_pbwt_snapshots() const = 0;
 		virtual alphabet_type const &alphabet() const = 0;
 		virtual sequence_vector const &sequences() const = 0;
 		virtual void context_will_follow_traceback(segmentation_lp_context &ctx) = 0;
 		virtual void context_did_finish_traceback(segmentation_lp_context &ctx, std::size_t const segment_count, std::size_t const max_segment_size) = 0;
+		virtual void context_will_exceed_pbwt_sample_memory_budget(segmentation_lp_context &ctx, std::uint64_t const required_bytes) = 0;
 		virtual void context_will_start_update_samples_tasks(segmentation_lp_context &ctx) = 0;
 		virtual void context_did_start_update_samples_tasks(segmentation_lp_context &ctx) = 0;
 		virtual void context_did_update_pbwt_samples_to_traceback_positions(segmentation_lp_context &ctx) = 0;
 		virtual void context_will_merge_segments(segmentation_lp_context &ctx) = 0;
 		virtual void context_did_merge_segments(segmentation_lp_context &ctx, segmentation_container &&container) = 0;
+		
+		// For find_segments_greedy_second_pass().
+		virtual void context_did_find_reduced_segment(segmentation_lp_context &ctx, segmentation_dp_arg const &dp_arg, pbwt_sample_type &&sample) = 0;
+		virtual void context_did_finish_second_pass(segmentation_lp_context &ctx) = 0;
 	};
 	
 	
@@ -64,6 +77,8 @@ namespace founder_sequences {
 	{
 	protected:
 		typedef std::vector <std::size_t>					text_position_vector;
+		typedef std::vector <compressed_pbwt_sample>		compressed_pbwt_sample_vector;
+		typedef std::vector <std::pair <update_pbwt_task *, std::size_t>>	sample_position_vector;	// Task and right bound index.
 
 	protected:
 		pbwt_context										m_pbwt_ctx;
@@ -71,14 +86,29 @@ namespace founder_sequences {
 		segmentation_traceback_vector						m_segmentation_traceback_dp;
 		segmentation_traceback_vector_rmq					m_segmentation_traceback_dp_rmq;
 		std::uint32_t										m_max_segment_size{};
+		bool												m_uses_precalculated_traceback{false};
 		
 		libbio::dispatch_ptr <dispatch_queue_t>				m_producer_queue;	// May be parallel.
 		libbio::dispatch_ptr <dispatch_queue_t>				m_consumer_queue;	// Needs to be serial.
 		
+		// The samples taken by m_pbwt_ctx are moved here after processing each range of columns.
+		compressed_pbwt_sample_vector						m_samples;
+		std::unique_ptr <pbwt_sample_scratch_file>			m_sample_scratch_file;	// If set, the compressed data are moved here.
+		
 		// For updating the PBWT samples.
 		std::vector <std::unique_ptr <update_pbwt_task>>	m_update_pbwt_tasks;
 		libbio::dispatch_ptr <dispatch_group_t>				m_update_samples_group;
 		
+		// For keeping the PBWT samples within the memory budget.
+		std::uint64_t										m_sample_memory_budget{};
+		std::uint64_t										m_sample_memory{};
+		std::uint64_t										m_sample_rate{};
+		std::size_t											m_measured_sample_count{};
+		
+		// For checkpointing.
+		std::unique_ptr <segmentation_checkpoint_writer>	m_checkpoint_writer;
+		std::unique_ptr <segmentation_checkpoint>			m_resumed_checkpoint;
+		
 		// For matching.
 		substring_copy_number_matrix						m_substring_copy_numbers;
 		std::unique_ptr <matcher>							m_matcher;
@@ -116,10 +146,27 @@ namespace founder_sequences {
 		
 		void cleanup() { delete this; }
 		
+		// Write checkpoints while calculating the traceback.
+		void set_checkpoint_writer(std::unique_ptr <segmentation_checkpoint_writer> &&writer) { m_checkpoint_writer = std::move(writer); }
+		
+		// Load the latest checkpoint s.t. generate_traceback continues from it. Needs to be called before generate_traceback.
+		bool load_checkpoint(std::size_t const lb, std::size_t const rb);
+		std::size_t resumed_column() const { return (m_resumed_checkpoint ? m_resumed_checkpoint->next_column : 0); }
+		
 		void generate_traceback(std::size_t lb, std::size_t rb);
+		
+		// Follow the traceback of a DP vector calculated with the same segment length bound, e.g. by segment_size_calculator,
+		// instead of calculating it. No PBWT samples are taken, so find_segments_greedy_second_pass needs to be used.
+		void follow_precalculated_traceback(segmentation_traceback_vector &&traceback_dp);
+		bool uses_precalculated_traceback() const { return m_uses_precalculated_traceback; }
+		
 		void update_samples_to_traceback_positions();
 		void find_segments_greedy();
 		
+		// Instead of updating the stored samples, recalculate the PBWT and pass the samples at the reduced segment
+		// boundaries to the delegate as soon as they have been determined.
+		void find_segments_greedy_second_pass();
+		
 		// For status update.
 		std::size_t step_max() const { return m_step_max; }
 		std::size_t current_step() const { return m_current_step.load(std::memory_order_relaxed); }
@@ -132,11 +179,32 @@ namespace founder_sequences {
 		void generate_traceback_part_3(std::size_t const lb, std::size_t const rb);
 		void generate_traceback_part_4(std::size_t const lb, std::size_t const rb);
 		
+		std::size_t sample_count() const { return m_samples.size() + m_pbwt_ctx.samples().size(); }
+		void store_new_samples();
+		std::size_t find_run_end(
+			sample_position_vector const &positions,
+			std::size_t const begin,
+			std::size_t const lb,
+			std::size_t const initial_span,
+			std::size_t &last_fitting_size
+		) const;
+		void finish_finding_segments(segmentation_container &&container);
+		
+		void measure_sample_memory();
+		void thin_samples();
+		void limit_sample_memory();
+		void limit_sample_memory_for_update_tasks();
+		
+		segmentation_checkpoint_header checkpoint_header(std::size_t const lb, std::size_t const rb) const;
+		void resume_from_checkpoint();
+		void write_checkpoint(std::size_t const lb, std::size_t const rb);
+		
 		void follow_traceback();
 		
-		void start_update_sample_task(
+		void create_update_sample_task(
+			task_scheduler &scheduler,
 			std::size_t const lb,
-			pbwt_sample_type &&sample,
+			compressed_pbwt_sample &&sample,
 			text_position_vector &&right_bounds
 		);
 	};
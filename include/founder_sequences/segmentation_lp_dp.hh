@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_SEGMENTATION_LP_DP_HH
+#define FOUNDER_SEQUENCES_SEGMENTATION_LP_DP_HH
+
+#include <cassert>
+#include <founder_sequences/segmentation_dp_arg.hh>
+#include <libbio/algorithm.hh>
+
+
+namespace founder_sequences {
+
+	// Calculate the DP argument for the column at text_pos.
+	// t_counts needs to provide the divergence values and their counts in divergence value order
+	// with cbegin_pairs() and cend_pairs(), like pbwt_context::divergence_count_list.
+	template <typename t_counts>
+	void calculate_segmentation_lp_dp_arg(
+		t_counts const &divergence_value_counts,
+		segmentation_traceback_vector const &segmentation_traceback_dp,
+		segmentation_traceback_vector_rmq const &segmentation_traceback_dp_rmq,
+		std::size_t const seq_count,
+		std::size_t const segment_length,
+		std::size_t const lb,	// Inclusive.
+		std::size_t const text_pos,
+		segmentation_dp_arg &min_arg
+	)
+	{
+		// Take the current divergence values and their counts in divergence value order.
+		auto it(divergence_value_counts.cbegin_pairs());
+		auto const end(divergence_value_counts.cend_pairs());
+		assert(it != end);
+		
+		// Find the minimum, similar to Ukkonen's equation 1.
+		std::size_t segment_size_diff(it->second);
+		
+		std::size_t dp_lb(lb);
+		std::size_t dp_rb(it->first); // Initial value not used.
+		
+		// Consider the whole range in case the segment size is smaller than seq_count.
+		if (lb == dp_rb)
+		{
+			auto const segment_size(seq_count - segment_size_diff);
+			segmentation_dp_arg const current_arg(lb, 1 + text_pos, segment_size, segment_size);
+			if (current_arg < min_arg)
+				min_arg = current_arg;
+			
+			++it;
+			dp_rb = it->first;
+			segment_size_diff += it->second;
+		}
+		
+		++it;
+		while (true)
+		{
+			if (it == end)
+				break;
+			
+			// Range of possible cutting points.
+			dp_lb = dp_rb;
+			dp_rb = it->first;
+			std::size_t dp_rb_c(dp_rb);
+			assert(0 != it->first);
+			assert(dp_lb < dp_rb);
+			assert(dp_rb <= 1 + text_pos);
+			
+			// Check if the range needs to and can be contracted.
+			// First, verify that the current segment fits after the DP search range.
+			if (text_pos + 2 - segment_length < dp_rb_c)
+				dp_rb_c = text_pos + 2 - segment_length;
+			
+			// Second, verify that one segment fits before the DP search range.
+			// (Considering segment end positions; it must hold that lb + segment_length ≤ dp_lb.)
+			if (dp_lb < lb + segment_length)
+			{
+				if (lb + segment_length < dp_rb_c)
+					dp_lb = lb + segment_length;
+				else
+					goto continue_loop;
+			}
+			
+			// Check that the range is still valid.
+			if (dp_lb < dp_rb_c)
+			{
+				// Convert to segmentation_traceback indexing.
+				assert(segment_length <= dp_lb);
+				assert(segment_length <= dp_rb_c);
+				auto const dp_lb_tb(dp_lb - segment_length);
+				auto const dp_rb_tb(dp_rb_c - segment_length);
+				auto const idx(segmentation_traceback_dp_rmq(dp_lb_tb, dp_rb_tb));
+				
+				auto const &boundary_segment(segmentation_traceback_dp[idx]);
+				auto const lhs(boundary_segment.segment_max_size);
+				auto const rhs(seq_count - segment_size_diff);
+				
+				segmentation_dp_arg current_arg(idx + segment_length, 1 + text_pos, libbio::max_ct(lhs, rhs), rhs);
+				if (current_arg < min_arg)
+					min_arg = current_arg;
+			}
+			
+			// Next iteration.
+		continue_loop:
+			segment_size_diff += it->second;
+			++it;
+		}
+	}
+	
+	
+	// Calculate the number of distinct substrings in [lb, rb) where rb is the column after the one the counts of which are given.
+	// A sequence is a copy of the preceding one in the PBWT order if its divergence value is at most lb.
+	template <typename t_counts>
+	std::uint32_t calculate_segmentation_lp_segment_size(
+		t_counts const &divergence_value_counts,
+		std::size_t const seq_count,
+		std::size_t const lb
+	)
+	{
+		std::size_t segment_size_diff(0);
+		auto it(divergence_value_counts.cbegin_pairs());
+		auto const end(divergence_value_counts.cend_pairs());
+		while (it != end && it->first <= lb)
+		{
+			segment_size_diff += it->second;
+			++it;
+		}
+		
+		return seq_count - segment_size_diff;
+	}
+	
+	
+	// Calculate the size of the segment that ends at the column the counts of which are given, in case the columns before
+	// the current one cannot be split into two segments, i.e. the column count is less than 2L.
+	template <typename t_counts>
+	std::uint32_t calculate_segmentation_lp_initial_segment_size(
+		t_counts const &divergence_value_counts,
+		std::size_t const seq_count,
+		std::size_t const lb
+	)
+	{
+		// Calculate the segment size by finding the range of the relevant key
+		// (which is “lb” in this case b.c. the column count is less than 2L,
+		// so the range is at most [counts.begin(), counts.begin() + 1))
+		// and subtracting the count from the sequence count.
+		std::size_t segment_size_diff(0);
+		auto const begin(divergence_value_counts.cbegin_pairs());
+		if (divergence_value_counts.cend_pairs() != begin && lb == begin->first)
+			segment_size_diff = begin->second;
+		
+		return seq_count - segment_size_diff;
+	}
+}
+
+#endif
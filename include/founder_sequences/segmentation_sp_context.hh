@@ -10,7 +10,7 @@
 
 
 namespace founder_sequences {
-	
+
 	class segmentation_sp_context;
 	
 	
@@ -18,26 +18,28 @@ namespace founder_sequences {
 	{
 		virtual void context_did_finish_traceback(segmentation_sp_context &ctx) = 0;
 	};
-
+	
 	
 	// Short path; just count the distinct strings and output.
+	// The PBWT is not needed since the sequences may be grouped by hashing the substrings.
 	class segmentation_sp_context final : public segmentation_context
 	{
 	protected:
-		pbwt_context											m_ctx;
-		std::vector <std::pair <std::uint32_t, std::uint32_t>>	m_permutation;
+		typedef std::pair <std::uint32_t, std::uint32_t>		sequence_run;	// First sequence index in the PBWT order, count.
+	
+	protected:
+		std::vector <sequence_run>								m_permutation;
 		std::size_t												m_lb{};
 		std::size_t												m_rb{};
 		std::uint32_t											m_max_segment_size{};
 		segmentation_sp_context_delegate						*m_delegate{};
-
+	
 	public:
 		segmentation_sp_context(
 			segmentation_sp_context_delegate &delegate,
 			std::size_t lb,
 			std::size_t rb
 		):
-			m_ctx(delegate.sequences(), delegate.alphabet()),
 			m_lb(lb),
 			m_rb(rb),
 			m_delegate(&delegate)
@@ -49,8 +51,18 @@ namespace founder_sequences {
 		void process();
 		void output_founders() const;
 		void output_segments() const;
-		
+	
 	protected:
+		template <typename t_fn>
+		void for_each_index(std::size_t const count, t_fn &&fn) const;
+		
+		void group_sequences(
+			std::vector <std::uint64_t> const &hashes,
+			std::uint32_t const *indices_begin,
+			std::uint32_t const *indices_end,
+			std::vector <sequence_run> &dst
+		) const;
+		
 		void output_sequence(std::ostream &os, sequence const &seq) const;
 	};
 }
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2018 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef FOUNDER_SEQUENCES_TASK_SCHEDULER_HH
+#define FOUNDER_SEQUENCES_TASK_SCHEDULER_HH
+
+#include <founder_sequences/founder_sequences.hh>
+#include <libbio/dispatch.hh>
+#include <vector>
+
+
+namespace founder_sequences {
+
+	// Collects tasks and submits them in decreasing order of their estimated cost. Since the queue
+	// starts the tasks in submission order, the expensive ones are started first and the cheap ones
+	// fill the gaps at the end instead of a few expensive ones leaving most of the threads idle.
+	class task_scheduler final
+	{
+	protected:
+		typedef std::pair <std::uint64_t, task *>	cost_task_pair;
+	
+	protected:
+		std::vector <cost_task_pair>				m_tasks;
+	
+	public:
+		// The task needs to remain valid until it has been executed.
+		void add_task(task &task) { m_tasks.emplace_back(task.estimated_cost(), &task); }
+		void reserve(std::size_t const count) { m_tasks.reserve(count); }
+		std::size_t size() const { return m_tasks.size(); }
+		
+		// Submit the collected tasks to the queue and remove them from the scheduler.
+		void dispatch_tasks(dispatch_group_t group, dispatch_queue_t queue);
+	};
+}
+
+#endif
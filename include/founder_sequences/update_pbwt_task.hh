@@ -6,6 +6,8 @@
 #ifndef FOUNDER_SEQUENCES_UPDATE_PBWT_TASK_HH
 #define FOUNDER_SEQUENCES_UPDATE_PBWT_TASK_HH
 
+#include <founder_sequences/compressed_pbwt_sample.hh>
+#include <founder_sequences/divergence_value_count_cache.hh>
 #include <founder_sequences/founder_sequences.hh>
 #include <vector>
 
@@ -20,6 +22,9 @@ namespace founder_sequences {
 	};
 	
 	
+	// Update a PBWT sample to each of the given right bounds. In the lazy mode, only the divergence value counts
+	// are stored for each right bound, which suffices for calculating the segment sizes. The permutation and
+	// the divergence are then recalculated only for the right bounds that have been retained.
 	class update_pbwt_task final : public task
 	{
 	protected:
@@ -29,11 +34,16 @@ namespace founder_sequences {
 		typedef std::vector <pbwt_sample_type>	pbwt_sample_vector;
 		
 	protected:
-		pbwt_sample_type			m_pbwt_sample;
-		pbwt_sample_vector			m_samples;
-		index_vector				m_right_bounds;
-		std::size_t					m_left_bound{};
-		update_pbwt_task_delegate	*m_delegate{};
+		compressed_pbwt_sample			m_compressed_sample;	// Decompressed when executing. Kept (spilled if possible) until materialize_retained_samples() in the lazy mode.
+		pbwt_sample_type				m_pbwt_sample;
+		pbwt_sample_vector				m_samples;				// One for each right bound or, in the lazy mode, for each retained one.
+		divergence_value_count_cache	m_divergence_value_counts;	// Lazy mode only.
+		index_vector					m_right_bounds;
+		index_vector					m_retained_indices;
+		std::size_t						m_left_bound{};
+		std::uint32_t					m_sequence_count{};
+		update_pbwt_task_delegate		*m_delegate{};
+		bool							m_is_lazy{false};
 		
 	public:
 		update_pbwt_task() = default;
@@ -41,20 +51,43 @@ namespace founder_sequences {
 		update_pbwt_task(
 			update_pbwt_task_delegate &delegate,
 			std::size_t const left_bound,
-			pbwt_sample_type &&pbwt_sample,
-			index_vector &&right_bounds
+			compressed_pbwt_sample &&pbwt_sample,
+			index_vector &&right_bounds,
+			bool const is_lazy
 		):
-			m_pbwt_sample(std::move(pbwt_sample)),
+			m_compressed_sample(std::move(pbwt_sample)),
 			m_right_bounds(std::move(right_bounds)),
 			m_left_bound(left_bound),
-			m_delegate(&delegate)
+			m_delegate(&delegate),
+			m_is_lazy(is_lazy)
 		{
 		}
 		
-		pbwt_sample_vector &samples() { return m_samples; }
-		pbwt_sample_vector const &samples() const { return m_samples; }
 		std::size_t left_bound() const { return m_left_bound; }
+		std::size_t right_bound_count() const { return m_right_bounds.size(); }
+		std::size_t right_bound(std::size_t const idx) const { return m_right_bounds[idx]; }
+		bool is_lazy() const { return m_is_lazy; }
+		
+		// Number of distinct substrings in [lb, right_bound(idx)).
+		std::size_t segment_size(std::size_t const idx, std::size_t const lb) const;
+		
+		// Mark the sample at right_bound(idx) as needed. The indices need to be given in increasing order.
+		void retain_sample(std::size_t const idx) { m_retained_indices.push_back(idx); }
+		bool has_retained_samples() const { return !m_retained_indices.empty(); }
+		
+		// Recalculate the retained samples in the lazy mode.
+		void materialize_retained_samples();
+		
+		// Move the retained samples to dst in right bound order.
+		void take_retained_samples(pbwt_sample_vector &dst);
+		
 		void execute() override;
+		std::uint64_t estimated_cost() const override;
+		
+	protected:
+		void prepare_pbwt_sample();
+		void copy_sample(std::size_t const rb);
+		void push_divergence_value_counts_from_sample();
 	};
 }
 